@@ -1,5 +1,5 @@
 /* =========================================================================
-   Shortest Route in Small City (KNN graph + Dijkstra + Yen K=2)
+   Shortest Route in Small City (KNN graph + CH/Dijkstra + Yen K-shortest)
    Modules:
      (1) Input UX
      (2) Graph Builder
@@ -14,50 +14,96 @@
 #include <math.h>
 #include <ctype.h>
 #include <time.h>
+#include <sys/stat.h>
+#include "geoindex.h"
+#include "ch.h"
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
 #endif
 
 /* =============================== CONFIG ================================= */
-#define MAXV    1500
+#ifndef MAXV
+#define MAXV    1500              /* most places loaded, longest path */
+#endif
 #define NAMELEN 64
-#define MAXE    (MAXV*16)
 #define INF     1e18
 #define PLACES_FILE "places.txt"
+#define CH_SUFFIX ".ch"           /* hierarchy is cached as places.txt.ch */
+#define ROUTES_DEFAULT 2          /* best + alternatives shown; ECO_ROUTES overrides */
+#define ROUTES_MAX 10
 
 /* Average speeds (km/h) used for ETA estimates */
 #define CAR_KMH 40.0
 #define BIKE_KMH 15.0
 #define WALK_KMH 5.0
 
-/* ============================ SHARED DATA =============================== */
-static int V = 0;
-static char names[MAXV][NAMELEN];
-static double lat[MAXV], lon[MAXV];
-
-/* adjacency list using arrays */
-static int head[MAXV];
-static int to[MAXE], nxt[MAXE];
-static double w[MAXE];
-static int E = 0;
-
-/* Path container */
+/* ============================ GRAPH OBJECT ============================== */
+/* Everything a query reads. Filled by load_places()/build_knn_*() and
+   prepare_ch(), then read-only: any number of threads may search one graph
+   at the same time, each with its own RouteQuery (section 3).
+   Adjacency is a linked list over the edge arrays; edges come in pairs,
+   e and e^1 being the two directions of one road. */
+typedef struct {
+    int V;
+    char (*names)[NAMELEN];
+    double *lat, *lon;
+    int *head;                 /* V: first edge out of each place, -1 if none */
+    int *to, *nxt;             /* E */
+    double *w;                 /* E: length in km */
+    int E, cap_e;
+    ContractionHierarchy ch;   /* valid when ch_ready */
+    int ch_ready;
+} RouteGraph;
+
+/* Routes packed back to back: route i is nodes[off[i] .. off[i]+len[i]).
+   dev[i] is where it leaves the route it was spurred from (Yen). */
 typedef struct {
-    int len;
-    int nodes[MAXV];
-    double cost;
-} Path;
+    int n, cap;
+    int *off, *len, *dev;
+    double *cost;
+    int *nodes, nn, ncap;
+} PathSet;
 
 /* ============================== UTILS =================================== */
 static void die(const char *m){ fprintf(stderr,"%s\n",m); exit(1); }
 
+static void pathset_free(PathSet *ps){
+    free(ps->off); free(ps->len); free(ps->dev); free(ps->cost); free(ps->nodes);
+    memset(ps,0,sizeof(*ps));
+}
+
+/* Append a route; returns its index */
+static int pathset_add(PathSet *ps,const int *nodes,int len,double cost,int dev){
+    if(ps->n==ps->cap){
+        int nc=ps->cap?ps->cap*2:8;
+        ps->off=(int*)realloc(ps->off,sizeof(int)*nc); ps->len=(int*)realloc(ps->len,sizeof(int)*nc);
+        ps->dev=(int*)realloc(ps->dev,sizeof(int)*nc); ps->cost=(double*)realloc(ps->cost,sizeof(double)*nc);
+        if(!ps->off||!ps->len||!ps->dev||!ps->cost) die("Memory error in path set.");
+        ps->cap=nc;
+    }
+    if(ps->nn+len>ps->ncap){
+        int nc=ps->ncap?ps->ncap*2:256;
+        while(nc<ps->nn+len) nc*=2;
+        ps->nodes=(int*)realloc(ps->nodes,sizeof(int)*nc);
+        if(!ps->nodes) die("Memory error in path set.");
+        ps->ncap=nc;
+    }
+    int i=ps->n++;
+    ps->off[i]=ps->nn; ps->len[i]=len; ps->dev[i]=dev; ps->cost[i]=cost;
+    memcpy(ps->nodes+ps->nn,nodes,sizeof(int)*len);
+    ps->nn+=len;
+    return i;
+}
+
+static const int *pathset_nodes(const PathSet *ps,int i){ return ps->nodes+ps->off[i]; }
+
 /* Haversine (km) for indices */
-static double haversine_km_idx(int i, int j){
+static double haversine_km_idx(const RouteGraph *g, int i, int j){
     const double R=6371.0;
-    double la1=lat[i]*M_PI/180.0, la2=lat[j]*M_PI/180.0;
-    double dlat=(lat[j]-lat[i])*(M_PI/180.0);
-    double dlon=(lon[j]-lon[i])*(M_PI/180.0);
+    double la1=g->lat[i]*M_PI/180.0, la2=g->lat[j]*M_PI/180.0;
+    double dlat=(g->lat[j]-g->lat[i])*(M_PI/180.0);
+    double dlon=(g->lon[j]-g->lon[i])*(M_PI/180.0);
     double a=sin(dlat/2)*sin(dlat/2)+cos(la1)*cos(la2)*sin(dlon/2)*sin(dlon/2);
     double c=2*atan2(sqrt(a),sqrt(1-a));
     return R*c;
@@ -102,29 +148,29 @@ static int levenshtein_ci(const char *s1, const char *s2){
 }
 
 /* ======================= (1) INPUT UX MODULE ============================ */
-static int ask_place_interactive(const char *prompt){
+static int ask_place_interactive(const RouteGraph *g, const char *prompt){
     char q[256];
     printf("\n%s (type a name or part of it, case-insensitive): ", prompt);
     if (scanf("%255s", q)!=1) die("Input error.");
 
-    for(int i=0;i<V;i++) if (strcasecmp(names[i], q)==0){ printf("✔ Selected: %s\n", names[i]); return i; }
+    for(int i=0;i<g->V;i++) if (strcasecmp(g->names[i], q)==0){ printf("✔ Selected: %s\n", g->names[i]); return i; }
 
     int cand_idx[64], cc=0;
-    for(int i=0;i<V && cc<64;i++) if (ci_contains(names[i], q)) cand_idx[cc++]=i;
+    for(int i=0;i<g->V && cc<64;i++) if (ci_contains(g->names[i], q)) cand_idx[cc++]=i;
 
     if (cc>0){
         printf("Found %d matches. Choose one by number:\n", cc);
-        for(int k=0;k<cc;k++) printf("  %2d) %s\n", k+1, names[cand_idx[k]]);
+        for(int k=0;k<cc;k++) printf("  %2d) %s\n", k+1, g->names[cand_idx[k]]);
         printf(": ");
         int pick=0; if (scanf("%d",&pick)!=1 || pick<1 || pick>cc) die("Bad selection.");
-        printf("✔ Selected: %s\n", names[cand_idx[pick-1]]);
+        printf("✔ Selected: %s\n", g->names[cand_idx[pick-1]]);
         return cand_idx[pick-1];
     }
 
     struct { int idx, dist; } best[5];
     for(int b=0;b<5;b++){ best[b].idx=-1; best[b].dist=9999; }
-    for(int i=0;i<V;i++){
-        int d=levenshtein_ci(names[i], q);
+    for(int i=0;i<g->V;i++){
+        int d=levenshtein_ci(g->names[i], q);
         for(int b=0;b<5;b++){
             if (d<best[b].dist){
                 for(int s=4;s>b;s--) best[s]=best[s-1];
@@ -133,159 +179,637 @@ static int ask_place_interactive(const char *prompt){
         }
     }
     printf("No direct matches. Did you mean:\n");
-    for(int b=0;b<5 && best[b].idx!=-1;b++) printf("  %2d) %s\n", b+1, names[best[b].idx]);
+    for(int b=0;b<5 && best[b].idx!=-1;b++) printf("  %2d) %s\n", b+1, g->names[best[b].idx]);
     printf(": ");
     int pick=0; if (scanf("%d",&pick)!=1 || pick<1 || pick>5 || best[pick-1].idx==-1) die("Bad selection.");
-    printf("✔ Selected: %s\n", names[best[pick-1].idx]);
+    printf("✔ Selected: %s\n", g->names[best[pick-1].idx]);
     return best[pick-1].idx;
 }
 
 /* ======================= (2) GRAPH BUILDER MODULE ======================= */
-static void reset_graph(){ for(int i=0;i<MAXV;i++) head[i]=-1; E=0; }
+static void route_graph_free(RouteGraph *g){
+    free(g->names); free(g->lat); free(g->lon); free(g->head);
+    free(g->to); free(g->nxt); free(g->w);
+    if(g->ch_ready) ch_free(&g->ch);
+    memset(g,0,sizeof(*g));
+}
+
+/* Room for n places (names/coordinates left for the caller), no edges */
+static void route_graph_alloc(RouteGraph *g, int n){
+    route_graph_free(g);
+    int cap=n>0?n:1;
+    g->names=malloc(sizeof(*g->names)*cap);
+    g->lat=(double*)malloc(sizeof(double)*cap);
+    g->lon=(double*)malloc(sizeof(double)*cap);
+    g->head=(int*)malloc(sizeof(int)*cap);
+    if(!g->names||!g->lat||!g->lon||!g->head) die("Memory error in graph.");
+    g->V=n;
+}
+
+static void reset_graph(RouteGraph *g){
+    for(int i=0;i<g->V;i++) g->head[i]=-1;
+    g->E=0;
+    if(g->ch_ready){ ch_free(&g->ch); g->ch_ready=0; }
+}
 
-static void add_edge(int u,int v,double ww){
-    if(u<0||u>=V||v<0||v>=V||u==v) return;
-    if(E+2>=MAXE) die("Edge capacity exceeded (raise MAXE).");
-    to[E]=v; w[E]=ww; nxt[E]=head[u]; head[u]=E++;
-    to[E]=u; w[E]=ww; nxt[E]=head[v]; head[v]=E++;
+static void add_edge(RouteGraph *g,int u,int v,double ww){
+    if(u<0||u>=g->V||v<0||v>=g->V||u==v) return;
+    if(g->E+2>g->cap_e){
+        int nc=g->cap_e?g->cap_e*2:64;
+        g->to=(int*)realloc(g->to,sizeof(int)*nc);
+        g->nxt=(int*)realloc(g->nxt,sizeof(int)*nc);
+        g->w=(double*)realloc(g->w,sizeof(double)*nc);
+        if(!g->to||!g->nxt||!g->w) die("Memory error in graph.");
+        g->cap_e=nc;
+    }
+    int E=g->E;
+    g->to[E]=v; g->w[E]=ww; g->nxt[E]=g->head[u]; g->head[u]=E++;
+    g->to[E]=u; g->w[E]=ww; g->nxt[E]=g->head[v]; g->head[v]=E++;
+    g->E=E;
 }
 
-static void load_places(){
-    FILE *fp=fopen(PLACES_FILE,"r");
+static void load_places(RouteGraph *g, const char *fn){
+    FILE *fp=fopen(fn,"r");
     if(!fp){ perror("open places.txt"); exit(1); }
-    V=0;
-    while(V<MAXV && fscanf(fp,"%63s %lf %lf", names[V], &lat[V], &lon[V])==3) V++;
+    route_graph_alloc(g,MAXV);
+    int n=0;
+    while(n<MAXV && fscanf(fp,"%63s %lf %lf", g->names[n], &g->lat[n], &g->lon[n])==3) n++;
     fclose(fp);
-    if(V<2) die("Need at least 2 places in places.txt (format: Name lat lon)");
-    reset_graph();
+    if(n<2) die("Need at least 2 places in places.txt (format: Name lat lon)");
+    g->V=n;
+    reset_graph(g);
 }
 
-static void build_knn_fixed(int k){
-    reset_graph();
+/* k-d tree builder, O(V log V) for well-spread places; same edges as
+   the brute-force reference in bench.c up to ties between equidistant
+   neighbours */
+static void build_knn_fixed(RouteGraph *g, int k){
+    int V=g->V;
+    reset_graph(g);
     if (k<1) k=1;
     if (V-1<k) k=V-1;
 
-    double *dists=(double*)malloc(sizeof(double)*V);
-    int *idx=(int*)malloc(sizeof(int)*V);
-    if(!dists||!idx) die("Memory error in KNN.");
+    GeoIndex gi;
+    int *idx=(int*)malloc(sizeof(int)*k);
+    double *dists=(double*)malloc(sizeof(double)*k);
+    if(!idx||!dists||!geoindex_build(&gi,V,g->lat,g->lon)) die("Memory error in KNN.");
 
     for(int u=0;u<V;u++){
-        for(int v=0;v<V;v++){ dists[v]=(u==v)?INF:haversine_km_idx(u,v); idx[v]=v; }
-        for(int i=0;i<k && i<V;i++){
-            int mi=i;
-            for(int j=i+1;j<V;j++) if(dists[j]<dists[mi]) mi=j;
-            double td=dists[i]; dists[i]=dists[mi]; dists[mi]=td;
-            int ti=idx[i]; idx[i]=idx[mi]; idx[mi]=ti;
-        }
-        int kk=(k<V)?k:V;
-        for(int i=0;i<kk;i++){ int v=idx[i]; if(v!=u) add_edge(u,v,haversine_km_idx(u,v)); }
+        int got=geoindex_knn(&gi,g->lat,g->lon,u,k,idx,dists);
+        for(int i=0;i<got;i++) add_edge(g,u,idx[i],haversine_km_idx(g,u,idx[i]));
     }
+    geoindex_free(&gi);
     free(dists); free(idx);
-    printf("\n[Graph Builder] Built %d-NN undirected graph with %d edges (V=%d)\n", k, E/2, V);
+    printf("\n[Graph Builder] Built %d-NN undirected graph with %d edges (V=%d)\n", k, g->E/2, V);
+}
+
+/* Contraction hierarchy over the KNN graph, cached next to the places file.
+   The file carries a fingerprint of the graph, so an edited places.txt
+   (or a different k) triggers a rebuild instead of a stale load. */
+static uint64_t graph_fingerprint(const RouteGraph *g){
+    uint64_t h=1469598103934665603ULL;
+    h=ch_fnv1a(h,&g->V,sizeof(g->V));
+    h=ch_fnv1a(h,&g->E,sizeof(g->E));
+    h=ch_fnv1a(h,g->to,sizeof(int)*g->E);
+    h=ch_fnv1a(h,g->w,sizeof(double)*g->E);
+    return h;
+}
+
+static void prepare_ch(RouteGraph *g, const char *places_fn){
+    if(g->ch_ready){ ch_free(&g->ch); g->ch_ready=0; }
+    char fn[512];
+    snprintf(fn,sizeof(fn),"%s%s",places_fn,CH_SUFFIX);
+    uint64_t fp=graph_fingerprint(g);
+    if(ch_load(&g->ch,fn,fp) && g->ch.n==g->V){
+        printf("[Graph Builder] Loaded contraction hierarchy from %s\n", fn);
+    } else {
+        /* edges are stored in pairs: e and e^1 are the two directions */
+        int ne=g->E/2;
+        int *eu=(int*)malloc(sizeof(int)*(ne>0?ne:1)), *ev=(int*)malloc(sizeof(int)*(ne>0?ne:1));
+        double *ew=(double*)malloc(sizeof(double)*(ne>0?ne:1));
+        if(!eu||!ev||!ew) die("Memory error in CH.");
+        for(int i=0;i<ne;i++){ eu[i]=g->to[2*i+1]; ev[i]=g->to[2*i]; ew[i]=g->w[2*i]; }
+        clock_t c0=clock();
+        ch_build(&g->ch,g->V,ne,eu,ev,ew);
+        free(eu); free(ev); free(ew);
+        printf("[Graph Builder] Contracted %d places (%d upward arcs) in %.2fs\n",
+               g->V, g->ch.m, (double)(clock()-c0)/CLOCKS_PER_SEC);
+        if(!ch_save(&g->ch,fn,fp)) printf("⚠ Could not write %s\n", fn);
+    }
+    g->ch_ready=1;
+}
+
+/* The interactive app's graph. It only depends on places.txt, so it is
+   kept between ecopath() calls until the file changes. */
+static RouteGraph app_graph;
+static time_t graph_mtime=0;
+static int graph_ready=0;
+
+static RouteGraph *ensure_graph(){
+    struct stat st;
+    time_t mt=(stat(PLACES_FILE,&st)==0)?st.st_mtime:0;
+    if(graph_ready && mt==graph_mtime) return &app_graph;
+    load_places(&app_graph,PLACES_FILE);
+    int k = 8;
+    if (app_graph.V-1 < k) k = app_graph.V-1;
+    if (k < 2 && app_graph.V >= 3) k = 2;
+    build_knn_fixed(&app_graph,k);
+    prepare_ch(&app_graph,PLACES_FILE);
+    graph_mtime=mt; graph_ready=1;
+    return &app_graph;
 }
 
 /* ===================== (3) SHORTEST PATHS MODULE ======================== */
-static int parent[MAXV];
-static double distv[MAXV];
-static int used[MAXV];
 
-static int minQ(){
+/* Frontier: binary min-heap of vertices with pos[] for decrease-key */
+typedef struct {
+    int *q, *pos, n;
+    double *key;
+} VHeap;
+
+/* Per-query context: all mutable search state plus the search options.
+   Give each thread its own and reuse it across queries against any graph
+   of at most cap places; the graph itself is only read.
+   - Search state is reset lazily: an entry of distv/used/parent/potv (and
+     the backward distb/usedb/succb) is valid only while its stamp equals
+     the current epoch, so starting a search is O(1) and Yen's spur
+     searches only pay for the vertices they reach. touch()/touchb() load
+     the defaults on first access.
+   - hf drives every forward search; its key is distv[v], plus
+     haversine_km_idx(v,t) when use_astar is set (w[e] is itself the
+     haversine, so the potential is consistent). hb is the backward queue
+     of the bidirectional search. ref_queue=1 switches back to the original
+     O(V) minQ() scan (plain Dijkstra), kept as a reference mode to check
+     the heap against. settled_cnt counts pops of the last search. */
+typedef struct {
+    int cap;
+    int ref_queue;
+    int use_astar;            /* A* potential towards the target */
+    int use_bidir;            /* bidirectional search; takes precedence over A* */
+    int use_ch;               /* best route from the contraction hierarchy when ready */
+
+    double *distv, *potv;
+    int *parent, *used;
+    double *distb;            /* backward side: cost v->t */
+    int *succb, *usedb;       /* next vertex towards t */
+    unsigned *stampf, *stampb, epoch;
+    int *pathmark, pathstamp;
+    VHeap hf, hb;
+    int astar_t;
+    int settled_cnt;
+    int best_settled;         /* settled_cnt of the last best_path() */
+    ChWorkspace ch_ws;
+    int *pathbuf;             /* cap: scratch route */
+
+    /* Yen: reverse shortest-path tree towards t, and the spur restrictions */
+    double *distt;            /* cost v->t, INF if unreachable */
+    int *succt;               /* next vertex towards t */
+    unsigned *banned, *hopban, banstamp;  /* root-path vertices; spur->v hops taken before */
+} RouteQuery;
+
+static int vheap_init(VHeap *h,int n){
+    h->q=(int*)malloc(sizeof(int)*n); h->pos=(int*)malloc(sizeof(int)*n);
+    h->key=(double*)malloc(sizeof(double)*n); h->n=0;
+    if(!h->q||!h->pos||!h->key) return 0;
+    for(int i=0;i<n;i++) h->pos[i]=-1;
+    return 1;
+}
+
+static void vheap_free(VHeap *h){ free(h->q); free(h->pos); free(h->key); memset(h,0,sizeof(*h)); }
+
+static void route_query_free(RouteQuery *q){
+    free(q->distv); free(q->potv); free(q->parent); free(q->used);
+    free(q->distb); free(q->succb); free(q->usedb);
+    free(q->stampf); free(q->stampb); free(q->pathmark);
+    free(q->pathbuf); free(q->distt); free(q->succt); free(q->banned); free(q->hopban);
+    vheap_free(&q->hf); vheap_free(&q->hb);
+    if(q->ch_ws.dist[0]) ch_workspace_free(&q->ch_ws);
+    memset(q,0,sizeof(*q));
+}
+
+/* Context for graphs of up to n places with the default options */
+static void route_query_init(RouteQuery *q,int n){
+    memset(q,0,sizeof(*q));
+    int cap=n>0?n:1;
+    q->cap=cap;
+    q->use_astar=1; q->use_ch=1;
+    q->astar_t=-1;
+    q->distv=(double*)malloc(sizeof(double)*cap); q->potv=(double*)malloc(sizeof(double)*cap);
+    q->parent=(int*)malloc(sizeof(int)*cap); q->used=(int*)malloc(sizeof(int)*cap);
+    q->distb=(double*)malloc(sizeof(double)*cap);
+    q->succb=(int*)malloc(sizeof(int)*cap); q->usedb=(int*)malloc(sizeof(int)*cap);
+    q->stampf=(unsigned*)calloc(cap,sizeof(unsigned)); q->stampb=(unsigned*)calloc(cap,sizeof(unsigned));
+    q->pathmark=(int*)calloc(cap,sizeof(int));
+    q->pathbuf=(int*)malloc(sizeof(int)*cap);
+    q->distt=(double*)malloc(sizeof(double)*cap); q->succt=(int*)malloc(sizeof(int)*cap);
+    q->banned=(unsigned*)calloc(cap,sizeof(unsigned)); q->hopban=(unsigned*)calloc(cap,sizeof(unsigned));
+    if(!q->distv||!q->potv||!q->parent||!q->used||!q->distb||!q->succb||!q->usedb||
+       !q->stampf||!q->stampb||!q->pathmark||!q->pathbuf||!q->distt||!q->succt||!q->banned||!q->hopban||
+       !vheap_init(&q->hf,cap)||!vheap_init(&q->hb,cap)||!ch_workspace_init(&q->ch_ws,cap))
+        die("Memory error in query context.");
+}
+
+/* Grow q for an n-place graph, keeping its options */
+static void route_query_reserve(RouteQuery *q,int n){
+    if(q->cap>=n) return;
+    RouteQuery o=*q;
+    route_query_free(q);
+    route_query_init(q,n);
+    q->ref_queue=o.ref_queue; q->use_astar=o.use_astar; q->use_bidir=o.use_bidir; q->use_ch=o.use_ch;
+}
+
+static void touch(RouteQuery *q,int v){
+    if(q->stampf[v]==q->epoch) return;
+    q->stampf[v]=q->epoch; q->distv[v]=INF; q->used[v]=0; q->parent[v]=-1; q->potv[v]=-1.0;
+}
+
+static void touchb(RouteQuery *q,int v){
+    if(q->stampb[v]==q->epoch) return;
+    q->stampb[v]=q->epoch; q->distb[v]=INF; q->usedb[v]=0; q->succb[v]=-1;
+}
+
+/* Next epoch; on wrap-around every stamp is cleared once */
+static void new_epoch(RouteQuery *q){
+    if(++q->epoch==0){
+        memset(q->stampf,0,sizeof(unsigned)*q->cap); memset(q->stampb,0,sizeof(unsigned)*q->cap);
+        q->epoch=1;
+    }
+}
+
+static int minQ(const RouteGraph *g,RouteQuery *q){
     double best=INF; int bi=-1;
-    for(int i=0;i<V;i++) if(!used[i] && distv[i]<best){ best=distv[i]; bi=i; }
+    for(int i=0;i<g->V;i++) touch(q,i);
+    for(int i=0;i<g->V;i++) if(!q->used[i] && q->distv[i]<best){ best=q->distv[i]; bi=i; }
     return bi;
 }
 
-static double ecodijkstra(int s,int t){
-    for(int i=0;i<V;i++){ distv[i]=INF; used[i]=0; parent[i]=-1; }
-    distv[s]=0.0;
+static void hswap(VHeap *h,int a,int b){
+    int x=h->q[a], y=h->q[b];
+    h->q[a]=y; h->pos[y]=a;
+    h->q[b]=x; h->pos[x]=b;
+}
+
+static void hup(VHeap *h,int i){
+    while(i>0){
+        int p=(i-1)/2;
+        if(h->key[h->q[p]]<=h->key[h->q[i]]) break;
+        hswap(h,i,p); i=p;
+    }
+}
+
+static void hdown(VHeap *h,int i){
+    for(;;){
+        int l=2*i+1, r=l+1, m=i;
+        if(l<h->n && h->key[h->q[l]]<h->key[h->q[m]]) m=l;
+        if(r<h->n && h->key[h->q[r]]<h->key[h->q[m]]) m=r;
+        if(m==i) break;
+        hswap(h,i,m); i=m;
+    }
+}
+
+/* Only the vertices still queued carry a slot, so this is O(queue size) */
+static void hclear(VHeap *h){
+    for(int i=0;i<h->n;i++) h->pos[h->q[i]]=-1;
+    h->n=0;
+}
+
+static void hpush(VHeap *h,int v,double key){
+    h->key[v]=key;
+    if(h->pos[v]<0){ h->q[h->n]=v; h->pos[v]=h->n++; }
+    hup(h,h->pos[v]);
+}
+
+static int hpop(VHeap *h){
+    if(h->n==0) return -1;
+    int u=h->q[0];
+    h->n--;
+    if(h->n>0){ h->q[0]=h->q[h->n]; h->pos[h->q[0]]=0; hdown(h,0); }
+    h->pos[u]=-1;
+    return u;
+}
+
+/* Reset per-search state and seed the queue with s; t is the A* target */
+static void q_init(RouteQuery *q,int s,int t){
+    new_epoch(q);
+    hclear(&q->hf); q->settled_cnt=0;
+    q->astar_t=t;
+    touch(q,s); touch(q,t);
+    q->distv[s]=0.0;
+    if(!q->ref_queue) hpush(&q->hf,s,0.0);
+}
+
+/* Call after distv[v] has been lowered */
+static void q_update(const RouteGraph *g,RouteQuery *q,int v){
+    if(q->ref_queue) return;
+    double key=q->distv[v];
+    if(q->use_astar && q->astar_t>=0){
+        if(q->potv[v]<0) q->potv[v]=haversine_km_idx(g,v,q->astar_t)*(1.0-1e-12);
+        key+=q->potv[v];
+    }
+    hpush(&q->hf,v,key);
+}
+
+static int q_pop(const RouteGraph *g,RouteQuery *q){
+    int u=q->ref_queue?minQ(g,q):hpop(&q->hf);
+    if(u!=-1) q->settled_cnt++;
+    return u;
+}
+
+/* Bidirectional Dijkstra (graph is undirected, so the backward search uses
+   the same adjacency). mu is the best s-t cost through any vertex reached
+   by both sides; once the two queue minima sum to at least mu nothing
+   shorter can appear. The s-t path is then spliced into parent[] so
+   build_path() reads it as usual. */
+static double bidijkstra(const RouteGraph *g,RouteQuery *q,int s,int t){
+    new_epoch(q);
+    hclear(&q->hf); hclear(&q->hb); q->settled_cnt=0;
+    touch(q,s); touch(q,t); touchb(q,s); touchb(q,t);
+    q->distv[s]=0.0; q->distb[t]=0.0;
+    hpush(&q->hf,s,0.0); hpush(&q->hb,t,0.0);
+    double mu=(s==t)?0.0:INF;
+    int meet=(s==t)?s:-1;
+
+    while(q->hf.n>0 && q->hb.n>0){
+        double tf=q->hf.key[q->hf.q[0]], tb=q->hb.key[q->hb.q[0]];
+        if(tf+tb>=mu) break;
+        int fwd=(tf<=tb);
+        VHeap *h=fwd?&q->hf:&q->hb;
+        double *dme=fwd?q->distv:q->distb, *dot=fwd?q->distb:q->distv;
+        int *pme=fwd?q->parent:q->succb, *ume=fwd?q->used:q->usedb;
+        int u=hpop(h); q->settled_cnt++;
+        ume[u]=1;
+        for(int e=g->head[u]; e!=-1; e=g->nxt[e]){
+            int v=g->to[e];
+            touch(q,v); touchb(q,v);
+            if(ume[v]) continue;
+            double alt=dme[u]+g->w[e];
+            if(alt<dme[v]){ dme[v]=alt; pme[v]=u; hpush(h,v,alt); }
+            if(dot[v]<INF/2 && dme[v]+dot[v]<mu){ mu=dme[v]+dot[v]; meet=v; }
+        }
+    }
+    if(meet<0){ q->distv[t]=INF; return INF; }
+
+    /* with zero-length edges the two half paths may share a vertex; split
+       at the last shared one so the spliced path stays simple */
+    q->pathstamp++;
+    for(int v=meet; v!=-1; v=q->parent[v]) q->pathmark[v]=q->pathstamp;
+    for(int v=meet; v!=-1; v=q->succb[v]) if(q->pathmark[v]==q->pathstamp) meet=v;
+    for(int v=meet; q->succb[v]!=-1; v=q->succb[v]) q->parent[q->succb[v]]=v;
+    q->distv[t]=mu;
+    return mu;
+}
+
+/* ECO_SEARCH=ch|dijkstra|astar|bidir selects the search at runtime.
+   Default: ch for the best route; Yen's spur searches always run A* on
+   the reverse shortest-path tree. */
+static void pick_search_mode(RouteQuery *q){
+    const char *m=getenv("ECO_SEARCH");
+    if(!m) return;
+    q->use_ch=(strcasecmp(m,"ch")==0);
+    q->use_astar=q->use_ch||(strcasecmp(m,"astar")==0);
+    q->use_bidir=(strcasecmp(m,"bidir")==0);
+}
+
+/* s-t distance in the current mode, leaving the path in q->parent[] */
+static double ecodijkstra(const RouteGraph *g,RouteQuery *q,int s,int t){
+    if(q->use_bidir && !q->ref_queue) return bidijkstra(g,q,s,t);
+    q_init(q,s,t);
     for(;;){
-        int u=minQ(); if(u==-1) break;
-        used[u]=1; if(u==t) break;
-        for(int e=head[u]; e!=-1; e=nxt[e]){
-            int v=to[e];
-            double alt=distv[u]+w[e];
-            if(alt<distv[v]){ distv[v]=alt; parent[v]=u; }
+        int u=q_pop(g,q); if(u==-1) break;
+        q->used[u]=1; if(u==t) break;
+        for(int e=g->head[u]; e!=-1; e=g->nxt[e]){
+            int v=g->to[e];
+            touch(q,v);
+            double alt=q->distv[u]+g->w[e];
+            if(alt<q->distv[v]){ q->distv[v]=alt; q->parent[v]=u; q_update(g,q,v); }
         }
     }
-    return distv[t];
+    return q->distv[t];
 }
 
-static int build_path(int t,int *out){
-    if(distv[t]>=INF/2) return 0;
-    int tmp[MAXV], k=0;
-    for(int v=t; v!=-1; v=parent[v]) tmp[k++]=v;
-    for(int i=0;i<k;i++) out[i]=tmp[k-1-i];
+static int build_path(RouteQuery *q,int t,int *out){
+    touch(q,t);
+    if(q->distv[t]>=INF/2) return 0;
+    int k=0;
+    for(int v=t; v!=-1; v=q->parent[v]) k++;
+    int i=k;
+    for(int v=t; v!=-1; v=q->parent[v]) out[--i]=v;
     return k;
 }
 
-static int equal_paths(const Path *a, const Path *b){
-    if(a->len!=b->len) return 0;
-    for(int i=0;i<a->len;i++) if(a->nodes[i]!=b->nodes[i]) return 0;
-    return 1;
+/* Best s-t route appended to out; CH query when available, else the search
+   mode. Returns its cost, INF (nothing appended) if unreachable. */
+static double best_path(const RouteGraph *g,RouteQuery *q,int s,int t,PathSet *out){
+    if(q->use_ch && g->ch_ready){
+        int len=0;
+        double c=ch_query(&g->ch,&q->ch_ws,s,t,q->pathbuf,&len,q->cap);
+        q->best_settled=q->ch_ws.settled;
+        if(c>=CH_INF/2) return INF;
+        pathset_add(out,q->pathbuf,len,c,0);
+        return c;
+    }
+    double c=ecodijkstra(g,q,s,t);
+    q->best_settled=q->settled_cnt;
+    if(c>=INF/2) return INF;
+    pathset_add(out,q->pathbuf,build_path(q,t,q->pathbuf),c,0);
+    return c;
 }
 
-/* Skip one specific undirected edge during relaxation */
-static int skip_u=-1, skip_v=-1;
+/* Length of the lightest road u-v, INF if none */
+static double edge_len(const RouteGraph *g,int u,int v){
+    double best=INF;
+    for(int e=g->head[u]; e!=-1; e=g->nxt[e]) if(g->to[e]==v && g->w[e]<best) best=g->w[e];
+    return best;
+}
 
-static double dijkstra_skip_edge(int s,int t){
-    for(int i=0;i<V;i++){ distv[i]=INF; used[i]=0; parent[i]=-1; }
-    distv[s]=0.0;
+/* Full Dijkstra from t: distt[v] = cost v->t, succt[v] = next vertex on
+   that route. Blocking vertices or roads never makes a route cheaper, so
+   distt is an exact-where-unblocked A* potential for every spur search. */
+static void reverse_tree(const RouteGraph *g,RouteQuery *q,int t){
+    for(int v=0;v<g->V;v++){ q->distt[v]=INF; q->succt[v]=-1; }
+    hclear(&q->hf);
+    q->distt[t]=0.0;
+    hpush(&q->hf,t,0.0);
     for(;;){
-        int u=minQ(); if(u==-1) break;
-        used[u]=1; if(u==t) break;
-        for(int e=head[u]; e!=-1; e=nxt[e]){
-            int v=to[e];
-            if((u==skip_u && v==skip_v) || (u==skip_v && v==skip_u)) continue;
-            double alt=distv[u]+w[e];
-            if(alt<distv[v]){ distv[v]=alt; parent[v]=u; }
+        int u=hpop(&q->hf); if(u==-1) break;
+        q->settled_cnt++;
+        for(int e=g->head[u]; e!=-1; e=g->nxt[e]){
+            int v=g->to[e];
+            double alt=q->distt[u]+g->w[e];
+            if(alt<q->distt[v]){ q->distt[v]=alt; q->succt[v]=u; hpush(&q->hf,v,alt); }
         }
     }
-    return distv[t];
-}
-
-/* Yen's K-shortest with K up to 2 (best + one alt) */
-static int yen_k2_paths(int s,int t,Path *out){
-    double best=ecodijkstra(s,t);
-    if(best>=INF/2) return 0;
-    out[0].cost=best;
-    out[0].len=build_path(t,out[0].nodes);
-    int count=1;
-
-    Path A[64]; int Ac=0;
-    Path *prev=&out[0];
-    for(int i=0;i<prev->len-1;i++){
-        skip_u=prev->nodes[i];
-        skip_v=prev->nodes[i+1];
-        double c=dijkstra_skip_edge(prev->nodes[i], t);
-        if(c>=INF/2) continue;
-
-        int tmp[MAXV], kk=0;
-        for(int v=t; v!=-1; v=parent[v]) tmp[kk++]=v;
-        int spur_len=kk, spur_nodes[MAXV];
-        for(int z=0; z<kk; z++) spur_nodes[z]=tmp[kk-1-z];
-
-        Path cand; cand.len=0; cand.cost=0.0;
-        for(int j=0;j<=i;j++){
-            cand.nodes[cand.len++]=prev->nodes[j];
-            if(j>0) cand.cost += haversine_km_idx(prev->nodes[j-1], prev->nodes[j]);
-        }
-        for(int j=1;j<spur_len;j++){
-            cand.nodes[cand.len++]=spur_nodes[j];
-            cand.cost += haversine_km_idx(spur_nodes[j-1], spur_nodes[j]);
+}
+
+static int is_banned(const RouteQuery *q,int v){ return q->banned[v]==q->banstamp; }
+
+/* Cheapest spur..t route avoiding banned vertices and banned first hops
+   (spur itself is never banned). Uses the tree route when it qualifies;
+   otherwise A* on distt. Route left in pathbuf; returns cost. */
+static double spur_search(const RouteGraph *g,RouteQuery *q,int spur,int t,int *len){
+    int ok=q->succt[spur]!=-1 && q->hopban[q->succt[spur]]!=q->banstamp;
+    for(int v=q->succt[spur]; ok && v!=-1; v=q->succt[v]) ok=!is_banned(q,v);
+    if(ok){
+        int k=0;
+        for(int v=spur; v!=-1; v=q->succt[v]) q->pathbuf[k++]=v;
+        *len=k;
+        return q->distt[spur];
+    }
+    new_epoch(q);
+    hclear(&q->hf);
+    touch(q,spur); touch(q,t);
+    q->distv[spur]=0.0;
+    hpush(&q->hf,spur,q->distt[spur]);
+    for(;;){
+        int u=hpop(&q->hf); if(u==-1) break;
+        q->settled_cnt++;
+        q->used[u]=1; if(u==t) break;
+        for(int e=g->head[u]; e!=-1; e=g->nxt[e]){
+            int v=g->to[e];
+            if(is_banned(q,v) || q->distt[v]>=INF/2) continue;
+            if(u==spur && q->hopban[v]==q->banstamp) continue;
+            touch(q,v);
+            double alt=q->distv[u]+g->w[e];
+            if(alt<q->distv[v]){ q->distv[v]=alt; q->parent[v]=u; hpush(&q->hf,v,alt+q->distt[v]); }
         }
+    }
+    if(q->distv[t]>=INF/2) return INF;
+    *len=build_path(q,t,q->pathbuf);
+    return q->distv[t];
+}
+
+/* FNV-1a of a vertex sequence, to spot duplicate candidates */
+static uint64_t route_hash(const int *nodes,int len){
+    return ch_fnv1a(1469598103934665603ULL,nodes,sizeof(int)*(size_t)len);
+}
+
+/* Candidate min-heap over PathSet indices, ordered by cost */
+static void cand_push(int *h,int *n,const PathSet *c,int id){
+    int i=(*n)++;
+    while(i>0){
+        int p=(i-1)/2;
+        if(c->cost[h[p]]<=c->cost[id]) break;
+        h[i]=h[p]; i=p;
+    }
+    h[i]=id;
+}
 
-        int dup=0;
-        for(int p=0;p<Ac;p++) if(equal_paths(&A[p], &cand)){ dup=1; break; }
-        if(!dup && Ac<64) A[Ac++]=cand;
+static int cand_pop(int *h,int *n,const PathSet *c){
+    int top=h[0], last=h[--(*n)], i=0;
+    for(;;){
+        int l=2*i+1, r=l+1, m=l;
+        if(l>=*n) break;
+        if(r<*n && c->cost[h[r]]<c->cost[h[l]]) m=r;
+        if(c->cost[h[m]]>=c->cost[last]) break;
+        h[i]=h[m]; i=m;
     }
+    if(*n>0) h[i]=last;
+    return top;
+}
 
-    skip_u = skip_v = -1; /* reset skip edge */
+/* Yen's K shortest loopless routes s->t into out (cleared first), cheapest
+   first; returns how many were found. The best route comes from
+   best_path() (CH when ready). Spurs then start at each vertex from the
+   route's deviation index on (earlier spurs were taken by its parent). A
+   spur bans the root-path vertices and the first hops of every accepted
+   route sharing that root, and reuses the reverse tree: its own tree route
+   when that avoids the bans, A* on the exact tree distances otherwise.
+   Candidates live in a cost heap, deduplicated by hash. */
+static int ksp_paths(const RouteGraph *g,RouteQuery *q,int s,int t,int K,PathSet *out){
+    out->n=out->nn=0;
+    if(K<1) return 0;
+    if(best_path(g,q,s,t,out)>=INF/2) return 0;
+    if(K==1) return 1;
+    int best_settled=q->best_settled;
+    q->settled_cnt=0;
+    reverse_tree(g,q,t);
+
+    PathSet cand; memset(&cand,0,sizeof(cand));
+    int *heap=NULL, hn=0, hcap=0, hashcap=0;
+    uint64_t *hash=NULL;
+    double *prefix=(double*)malloc(sizeof(double)*q->cap);
+    int *route=(int*)malloc(sizeof(int)*q->cap);
+    if(!prefix||!route) die("Memory error in K-shortest paths.");
+
+    /* candidate 0 mirrors the best route so it is never proposed again */
+    cand.n=cand.nn=0;
+    pathset_add(&cand,pathset_nodes(out,0),out->len[0],out->cost[0],0);
+    hash=(uint64_t*)malloc(sizeof(uint64_t)*(hashcap=16));
+    if(!hash) die("Memory error in K-shortest paths.");
+    hash[0]=route_hash(pathset_nodes(out,0),out->len[0]);
+
+    while(out->n<K){
+        int k=out->n-1;
+        const int *P=pathset_nodes(out,k);
+        int plen=out->len[k];
+        prefix[0]=0.0;
+        for(int i=1;i<plen;i++) prefix[i]=prefix[i-1]+edge_len(g,P[i-1],P[i]);
+
+        for(int i=out->dev[k]; i<plen-1; i++){
+            P=pathset_nodes(out,k);
+            int spur=P[i];
+            if(++q->banstamp==0){
+                memset(q->banned,0,sizeof(unsigned)*q->cap); memset(q->hopban,0,sizeof(unsigned)*q->cap);
+                q->banstamp=1;
+            }
+            for(int j=0;j<i;j++) q->banned[P[j]]=q->banstamp;
+            for(int a=0;a<out->n;a++){
+                const int *A=pathset_nodes(out,a);
+                if(out->len[a]>i+1 && memcmp(A,P,sizeof(int)*(size_t)(i+1))==0) q->hopban[A[i+1]]=q->banstamp;
+            }
+            int slen=0;
+            double sc=spur_search(g,q,spur,t,&slen);
+            if(sc>=INF/2) continue;
+
+            memcpy(route,P,sizeof(int)*(size_t)i);
+            memcpy(route+i,q->pathbuf,sizeof(int)*(size_t)slen);
+            int rlen=i+slen;
+            uint64_t h=route_hash(route,rlen);
+            int dup=0;
+            for(int c=0;c<cand.n && !dup;c++)
+                dup=hash[c]==h && cand.len[c]==rlen &&
+                    memcmp(pathset_nodes(&cand,c),route,sizeof(int)*(size_t)rlen)==0;
+            if(dup) continue;
+            int id=pathset_add(&cand,route,rlen,prefix[i]+sc,i);
+            if(id>=hashcap){
+                hash=(uint64_t*)realloc(hash,sizeof(uint64_t)*(hashcap*=2));
+                if(!hash) die("Memory error in K-shortest paths.");
+            }
+            hash[id]=h;
+            if(hn==hcap){
+                heap=(int*)realloc(heap,sizeof(int)*(hcap=hcap?hcap*2:64));
+                if(!heap) die("Memory error in K-shortest paths.");
+            }
+            cand_push(heap,&hn,&cand,id);
+        }
+        if(hn==0) break;
+        int c=cand_pop(heap,&hn,&cand);
+        pathset_add(out,pathset_nodes(&cand,c),cand.len[c],cand.cost[c],cand.dev[c]);
+    }
+    q->best_settled=best_settled;
+    pathset_free(&cand);
+    free(heap); free(hash); free(prefix); free(route);
+    return out->n;
+}
 
-    if(Ac==0) return count;
-    int besti=0;
-    for(int i=1;i<Ac;i++) if(A[i].cost < A[besti].cost) besti=i;
-    out[count++]=A[besti];
-    return count;
+/* Distance matrix out[i*nt+j] (INF if unreachable). With the hierarchy it
+   takes ns+nt upward searches (bucket many-to-many); without, one point
+   query per entry. Returns 0 on allocation failure. */
+static int route_matrix(const RouteGraph *g,RouteQuery *q,const int *src,int ns,const int *dst,int nt,double *out){
+    if(g->ch_ready){
+        if(!ch_many_to_many(&g->ch,&q->ch_ws,src,ns,dst,nt,out)) return 0;
+        q->best_settled=q->ch_ws.settled;
+        for(long long i=0;i<(long long)ns*nt;i++) if(out[i]>=CH_INF/2) out[i]=INF;
+        return 1;
+    }
+    q->best_settled=0;
+    for(int i=0;i<ns;i++)
+        for(int j=0;j<nt;j++){
+            double c=ecodijkstra(g,q,src[i],dst[j]);
+            q->best_settled+=q->settled_cnt;
+            out[(long long)i*nt+j]=c>=INF/2?INF:c;
+        }
+    return 1;
 }
 
 /* ========================== (4) UI MAP MODULE =========================== */
@@ -307,25 +831,13 @@ static double compute_time_min(double distance_km, double speed_kmh){
     return (distance_km / speed_kmh) * 60.0;
 }
 
-/* ----- Modified write_html: now supports drawing alternative route too ----- */
-static void write_html(const char *fn, Path *paths, int K /* K == number of found routes, up to 2 */){
+/* ----- write_html: best route solid, alternatives dashed in their own colours ----- */
+static void write_html(const RouteGraph *g, const char *fn, const PathSet *paths){
+    static const char *colors[]={"#0066FF","#FF7A00","#2CA02C","#9467BD","#D62728",
+                                 "#8C564B","#E377C2","#17BECF","#BCBD22","#7F7F7F"};
+    const int ncolors=(int)(sizeof(colors)/sizeof(colors[0]));
     FILE *f=fopen(fn,"w"); if(!f){ perror("html"); return; }
-    int cidx=(paths[0].len>0)?paths[0].nodes[0]:0;
-
-    /* Compute times for best route (and alternative if present) */
-    double best_km = paths[0].cost;
-    double best_car_min = compute_time_min(best_km, CAR_KMH);
-    double best_bike_min = compute_time_min(best_km, BIKE_KMH);
-    double best_walk_min = compute_time_min(best_km, WALK_KMH);
-
-    double alt_km=0.0, alt_car_min=0.0, alt_bike_min=0.0, alt_walk_min=0.0;
-    int has_alt = (K>1 && paths[1].len>0);
-    if (has_alt) {
-        alt_km = paths[1].cost;
-        alt_car_min = compute_time_min(alt_km, CAR_KMH);
-        alt_bike_min = compute_time_min(alt_km, BIKE_KMH);
-        alt_walk_min = compute_time_min(alt_km, WALK_KMH);
-    }
+    int cidx=(paths->n>0 && paths->len[0]>0)?pathset_nodes(paths,0)[0]:0;
 
     fprintf(f,
 "<!doctype html><html><head><meta charset='utf-8'/>"
@@ -343,33 +855,26 @@ static void write_html(const char *fn, Path *paths, int K /* K == number of foun
 ".mode .num{font-weight:700;font-size:14px}.title{font-size:14px;margin-bottom:6px}"
 "</style></head><body><div id='map'></div>\n");
 
-    /* Panel with best route + times */
+    /* Panel: best route + times, then each alternative */
     fprintf(f, "<div class='panel'>");
-    fprintf(f, "<div class='title'><b>Best route (road-snapped)</b></div>\n");
-    fprintf(f, "<div class='best'>Distance: %.3f km<br/>\n", best_km);
-    fprintf(f, "<div class='modes'>");
-    fprintf(f, "<div class='mode' title='Car'><div>🚗</div><div class='num'>%.0f min</div><div class='small'>by car</div></div>", best_car_min);
-    fprintf(f, "<div class='mode' title='Bike'><div>🚴</div><div class='num'>%.0f min</div><div class='small'>by bike</div></div>", best_bike_min);
-    fprintf(f, "<div class='mode' title='Walk'><div>🚶</div><div class='num'>%.0f min</div><div class='small'>on foot</div></div>", best_walk_min);
-    fprintf(f, "</div>\n");
-
-    fprintf(f, "<div style='margin-top:8px'>");
-    for(int j=0;j<paths[0].len;j++){
-        fprintf(f, "%s%s", names[paths[0].nodes[j]], (j+1<paths[0].len?" ➜ ":""));
-    }
-    fprintf(f, "</div></div>\n");
-
-    if (has_alt){
-        fprintf(f, "<div class='alt'><b>Alternative</b><br/>Distance: %.3f km<br/>\n", alt_km);
+    for(int r=0;r<paths->n;r++){
+        const int *nodes=pathset_nodes(paths,r);
+        double km=paths->cost[r];
+        if(r==0){
+            fprintf(f, "<div class='title'><b>Best route (road-snapped)</b></div>\n");
+            fprintf(f, "<div class='best'>Distance: %.3f km<br/>\n", km);
+        } else {
+            fprintf(f, "<div class='alt' style='border-left:4px solid %s'><b>Alternative %d</b><br/>Distance: %.3f km (+%.1f%%)<br/>\n",
+                    colors[r%ncolors], r, km, paths->cost[0]>0?(km/paths->cost[0]-1.0)*100.0:0.0);
+        }
         fprintf(f, "<div class='modes'>");
-        fprintf(f, "<div class='mode'><div>🚗</div><div class='num'>%.0f min</div><div class='small'>by car</div></div>", alt_car_min);
-        fprintf(f, "<div class='mode'><div>🚴</div><div class='num'>%.0f min</div><div class='small'>by bike</div></div>", alt_bike_min);
-        fprintf(f, "<div class='mode'><div>🚶</div><div class='num'>%.0f min</div><div class='small'>on foot</div></div>", alt_walk_min);
+        fprintf(f, "<div class='mode' title='Car'><div>🚗</div><div class='num'>%.0f min</div><div class='small'>by car</div></div>", compute_time_min(km, CAR_KMH));
+        fprintf(f, "<div class='mode' title='Bike'><div>🚴</div><div class='num'>%.0f min</div><div class='small'>by bike</div></div>", compute_time_min(km, BIKE_KMH));
+        fprintf(f, "<div class='mode' title='Walk'><div>🚶</div><div class='num'>%.0f min</div><div class='small'>on foot</div></div>", compute_time_min(km, WALK_KMH));
         fprintf(f, "</div>\n");
         fprintf(f, "<div style='margin-top:8px'>");
-        for(int j=0;j<paths[1].len;j++){
-            fprintf(f, "%s%s", names[paths[1].nodes[j]], (j+1<paths[1].len?" ➜ ":""));
-        }
+        for(int j=0;j<paths->len[r];j++)
+            fprintf(f, "%s%s", g->names[nodes[j]], (j+1<paths->len[r]?" ➜ ":""));
         fprintf(f, "</div></div>\n");
     }
 
@@ -381,48 +886,26 @@ static void write_html(const char *fn, Path *paths, int K /* K == number of foun
 "var map=L.map('map').setView([%f,%f],15);\n"
 "L.tileLayer('https://{s}.tile.openstreetmap.org/{z}/{x}/{y}.png',"
 "{maxZoom:19,attribution:'&copy; OpenStreetMap'}).addTo(map);\n",
-        lat[cidx], lon[cidx]
+        g->lat[cidx], g->lon[cidx]
     );
 
-    /* route0 nodes array */
-    fprintf(f, "var route0_nodes=[\n");
-    for(int j=0;j<paths[0].len;j++){
-        int v=paths[0].nodes[j];
-        fprintf(f,"  {lat:%0.6f, lon:%0.6f}%s\n", lat[v], lon[v], (j+1<paths[0].len?",":""));
-    }
-    fprintf(f, "];\n");
-
-    /* route0 names array (escaped) */
-    fprintf(f, "var route0_names=[");
-    for(int j=0;j<paths[0].len;j++){
-        int v=paths[0].nodes[j];
-        char safe[256]; js_escape(names[v], safe, sizeof(safe));
-        fprintf(f,"\"%s\"%s", safe, (j+1<paths[0].len?",":""));
-    }
-    fprintf(f, "];\n");
-
-    /* If alternative exists, write its nodes & names */
-    if (has_alt) {
-        fprintf(f, "var route1_nodes=[\n");
-        for(int j=0;j<paths[1].len;j++){
-            int v=paths[1].nodes[j];
-            fprintf(f,"  {lat:%0.6f, lon:%0.6f}%s\n", lat[v], lon[v], (j+1<paths[1].len?",":""));
-        }
-        fprintf(f, "];\n");
-        fprintf(f, "var route1_names=[");
-        for(int j=0;j<paths[1].len;j++){
-            int v=paths[1].nodes[j];
-            char safe[256]; js_escape(names[v], safe, sizeof(safe));
-            fprintf(f,"\"%s\"%s", safe, (j+1<paths[1].len?",":""));
+    /* routes: nodes, escaped names and colour of each */
+    fprintf(f, "var routes=[\n");
+    for(int r=0;r<paths->n;r++){
+        const int *nodes=pathset_nodes(paths,r);
+        fprintf(f, "  {color:'%s', nodes:[", colors[r%ncolors]);
+        for(int j=0;j<paths->len[r];j++)
+            fprintf(f,"{lat:%0.6f, lon:%0.6f}%s", g->lat[nodes[j]], g->lon[nodes[j]], (j+1<paths->len[r]?",":""));
+        fprintf(f, "], names:[");
+        for(int j=0;j<paths->len[r];j++){
+            char safe[256]; js_escape(g->names[nodes[j]], safe, sizeof(safe));
+            fprintf(f,"\"%s\"%s", safe, (j+1<paths->len[r]?",":""));
         }
-        fprintf(f, "];\n");
-    } else {
-        fprintf(f, "var route1_nodes=null;\nvar route1_names=null;\n");
+        fprintf(f, "]}%s\n", (r+1<paths->n?",":""));
     }
+    fprintf(f, "];\n");
 
     fprintf(f,
-"var primaryColor='#0066FF';\n"
-"var altColor='#FF7A00';\n"
 "function drawStraight(nodes, color){var latlngs=nodes.map(n=>[n.lat,n.lon]);return L.polyline(latlngs,{weight:6,color:color,opacity:1.0}).addTo(map);} \n"
 "async function osrmRoute(a,b){\n"
 "  var url=`https://router.project-osrm.org/route/v1/driving/${a.lon},${a.lat};${b.lon},${b.lat}?overview=full&geometries=geojson`;\n"
@@ -442,23 +925,17 @@ static void write_html(const char *fn, Path *paths, int K /* K == number of foun
 "  return L.polyline(all,{weight:6,color:color,opacity:0.95}).addTo(map);\n"
 "}\n"
 "(async function(){\n"
-"  var layers=[];\n" /* collect polylines for fitBounds */ 
-"  var nodes0=route0_nodes;\n" 
-"  for(let i=0;i<nodes0.length;i++){ L.marker([nodes0[i].lat,nodes0[i].lon]).addTo(map).bindPopup(route0_names[i]); }\n"
-"  try{ var pl0=await drawSnapped(nodes0, primaryColor); layers.push(pl0); }\n"
-"  catch(e){ var pl0=drawStraight(nodes0, primaryColor); layers.push(pl0); }\n"
-);
-
-    if (has_alt) {
-        fprintf(f,
-"  var nodes1=route1_nodes;\n"
-"  for(let i=0;i<nodes1.length;i++){ L.circleMarker([nodes1[i].lat,nodes1[i].lon],{radius:4,fillOpacity:1}).addTo(map).bindPopup(route1_names[i]); }\n"
-"  try{ var pl1=await drawSnapped(nodes1, altColor); pl1.setStyle({dashArray:'8,6'}); layers.push(pl1); }\n"
-"  catch(e){ var pl1=drawStraight(nodes1, altColor); pl1.setStyle({dashArray:'8,6'}); layers.push(pl1); }\n"
-);
-    }
-
-    fprintf(f,
+"  var layers=[];\n" /* collect polylines for fitBounds */
+"  for(let r=routes.length-1;r>=0;r--){\n" /* best drawn last, on top */
+"    var rt=routes[r], pl;\n"
+"    for(let i=0;i<rt.nodes.length;i++){\n"
+"      if(r==0) L.marker([rt.nodes[i].lat,rt.nodes[i].lon]).addTo(map).bindPopup(rt.names[i]);\n"
+"      else L.circleMarker([rt.nodes[i].lat,rt.nodes[i].lon],{radius:4,fillOpacity:1,color:rt.color}).addTo(map).bindPopup(rt.names[i]);\n"
+"    }\n"
+"    try{ pl=await drawSnapped(rt.nodes, rt.color); }catch(e){ pl=drawStraight(rt.nodes, rt.color); }\n"
+"    if(r>0) pl.setStyle({dashArray:'8,6'});\n"
+"    layers.push(pl);\n"
+"  }\n"
 "  var fg=L.featureGroup(layers);\n"
 "  if(layers.length) map.fitBounds(fg.getBounds(), {padding:[20,20]});\n"
 "})();\n"
@@ -481,19 +958,20 @@ static void try_open(const char *fn){
    - 📌 Optimized route (best path, i.e., routes[0])
    - 📌 Total distance covered (km)
    - 📌 Approx times for car/bike/walk (minutes)
-   Also optionally lists the alternative route if present.
+   Then each alternative route with its extra distance and times.
 */
-static void display_results(Path *routes, int found){
+static void display_results(const RouteGraph *g, const PathSet *routes){
     printf("\n==================== Result Display ====================\n");
     /* BEST route summary */
+    const int *best=pathset_nodes(routes,0);
     printf("📌 Optimized route: ");
-    for (int j=0; j<routes[0].len; j++){
+    for (int j=0; j<routes->len[0]; j++){
         if (j) printf(" -> ");
-        printf("%s", names[routes[0].nodes[j]]);
+        printf("%s", g->names[best[j]]);
     }
-    printf("\n📌 Total distance covered: %.3f km\n", routes[0].cost);
+    printf("\n📌 Total distance covered: %.3f km\n", routes->cost[0]);
 
-    double best_km = routes[0].cost;
+    double best_km = routes->cost[0];
     double best_car_min = compute_time_min(best_km, CAR_KMH);
     double best_bike_min = compute_time_min(best_km, BIKE_KMH);
     double best_walk_min = compute_time_min(best_km, WALK_KMH);
@@ -503,69 +981,70 @@ static void display_results(Path *routes, int found){
     printf("  🚴 Bike : %.0f min (avg %.0f km/h)\n", best_bike_min, BIKE_KMH);
     printf("  🚶 Walk : %.0f min (avg %.0f km/h)\n", best_walk_min, WALK_KMH);
 
-    /* Optional: show alternative route headline */
-    if (found > 1){
-        printf("\nAlternative route (for reference): ");
-        for (int j=0; j<routes[1].len; j++){
+    /* Alternatives, cheapest first */
+    for (int r=1; r<routes->n; r++){
+        const int *nodes=pathset_nodes(routes,r);
+        printf("\nAlternative %d: ", r);
+        for (int j=0; j<routes->len[r]; j++){
             if (j) printf(" -> ");
-            printf("%s", names[routes[1].nodes[j]]);
+            printf("%s", g->names[nodes[j]]);
         }
-        printf("\nDistance: %.3f km\n", routes[1].cost);
-
-        double alt_km = routes[1].cost;
-        double alt_car_min = compute_time_min(alt_km, CAR_KMH);
-        double alt_bike_min = compute_time_min(alt_km, BIKE_KMH);
-        double alt_walk_min = compute_time_min(alt_km, WALK_KMH);
-
-        printf("Estimated times (alt):\n");
-        printf("  🚗 Car  : %.0f min\n", alt_car_min);
-        printf("  🚴 Bike : %.0f min\n", alt_bike_min);
-        printf("  🚶 Walk : %.0f min\n", alt_walk_min);
+        double alt_km = routes->cost[r];
+        printf("\nDistance: %.3f km (+%.3f km)\n", alt_km, alt_km-best_km);
+        printf("Estimated times: 🚗 %.0f min  🚴 %.0f min  🚶 %.0f min\n",
+               compute_time_min(alt_km, CAR_KMH), compute_time_min(alt_km, BIKE_KMH),
+               compute_time_min(alt_km, WALK_KMH));
     }
     printf("========================================================\n");
 }
 
 /* ================================ MAIN ================================== */
 void ecopath(){
-    /* (2) Graph builder: load + build */
-    load_places();
+    /* (2) Graph builder: load + build (reused while places.txt is unchanged) */
+    const RouteGraph *g = ensure_graph();
+    static RouteQuery q;          /* the app's one query context */
+    if (!q.cap) route_query_init(&q, g->V);
+    route_query_reserve(&q, g->V);
 
-    printf("Available places (%d):\n", V);
-    for (int i=0; i<V; i++) printf("  %s\n", names[i]);
-
-    int k = 8;
-    if (V-1 < k) k = V-1;
-    if (k < 2 && V >= 3) k = 2;
-    build_knn_fixed(k);
+    printf("Available places (%d):\n", g->V);
+    for (int i=0; i<g->V; i++) printf("  %s\n", g->names[i]);
 
     /* (1) Input UX for source & destination */
-    int s = ask_place_interactive("Enter SOURCE");
-    int t = ask_place_interactive("Enter DESTINATION");
+    int s = ask_place_interactive(g, "Enter SOURCE");
+    int t = ask_place_interactive(g, "Enter DESTINATION");
     if (s == t) die("Source and destination must differ.");
 
-    /* (3) Shortest paths */
-    Path routes[2];
-    int found = yen_k2_paths(s,t,routes);
+    /* (3) Shortest paths: best + alternatives (ECO_ROUTES=1..10 routes) */
+    pick_search_mode(&q);
+    int k = ROUTES_DEFAULT;
+    const char *kr = getenv("ECO_ROUTES");
+    if (kr && atoi(kr) > 0) k = atoi(kr) < ROUTES_MAX ? atoi(kr) : ROUTES_MAX;
+    static PathSet routes;
+    int found = ksp_paths(g, &q, s, t, k, &routes);
     if (found == 0){
         printf("No route found (graph may be too sparse). Try adding places or increasing k.\n");
         return;
     }
+    printf("\n[Shortest Paths] %s settled %d of %d places\n",
+           (q.use_ch&&g->ch_ready)?"Contraction hierarchy":
+           q.use_bidir?"Bidirectional Dijkstra":(q.use_astar?"A*":"Dijkstra"), q.best_settled, g->V);
 
     /* (5) Result Display: concise summary */
-    display_results(routes, found);
+    display_results(g, &routes);
 
     /* Optional detailed breakdown (segments) */
     for (int i=0; i<found; i++){
-        printf("\nRoute %d detail (%.3f km):\n", i+1, routes[i].cost);
-        for (int j=0; j<routes[i].len-1; j++){
-            int a=routes[i].nodes[j], b=routes[i].nodes[j+1];
-            printf("  %s -> %s : %.3f km\n", names[a], names[b], haversine_km_idx(a,b));
+        const int *nodes=pathset_nodes(&routes,i);
+        printf("\nRoute %d detail (%.3f km):\n", i+1, routes.cost[i]);
+        for (int j=0; j<routes.len[i]-1; j++){
+            int a=nodes[j], b=nodes[j+1];
+            printf("  %s -> %s : %.3f km\n", g->names[a], g->names[b], edge_len(g,a,b));
         }
     }
 
-    /* (4) UI Map: BEST route to HTML, auto-open */
+    /* (4) UI Map: all routes to HTML, auto-open */
     const char *html="route_map.html";
-    write_html(html, routes, found);
+    write_html(g, html, &routes);
     printf("\nMap written to %s\n", html);
     try_open(html);
 }
@@ -0,0 +1,702 @@
+/* batch.h -- parallel origin-destination routing on the CO2 router
+   Routes a file of "source,destination[,car[,HH:MM]]" lines (a departure
+   time routes on the time-of-day traffic profiles) on a pool of worker
+   threads that share one Graph (and its customized hierarchy), read-only
+   apart from the atomic route counts that steer the traffic refresh;
+   each route pins the traffic weights published when it starts, so the
+   background refresher can swap in new ones mid-batch. Each worker owns a
+   QueryWorkspace. Jobs are split into contiguous ranges,
+   one per worker; a worker takes BATCH_CHUNK jobs at a time from the front
+   of its own range and, once that is empty, steals the back half of the
+   fullest other range, so uneven routes do not leave threads idle.
+   Rows are streamed as CSV or JSONL when each chunk finishes, so their order
+   follows completion, not input; the id column is the input line order.
+   matrix_main() writes a source x target CO2 (or km) matrix from one
+   bucket many-to-many query on the hierarchy, or with --metric dist the
+   distance router's matrix on places.txt. traffic_main() converts the
+   binary traffic cache to and from the legacy text format.
+   Include after carbon.c; link with -lpthread. On Windows (no pthreads
+   assumed, as for the traffic refresher) the pool runs on the calling
+   thread.
+*/
+#ifndef BATCH_H
+#define BATCH_H
+
+#define BATCH_CHUNK 8            /* jobs taken from a range per lock */
+
+#ifndef _WIN32
+#include <pthread.h>
+#define BATCH_MAX_THREADS 256
+typedef pthread_mutex_t BatchLock;
+#define batch_lock_init(l) pthread_mutex_init(l, NULL)
+#define batch_lock_destroy(l) pthread_mutex_destroy(l)
+#define batch_lock(l) pthread_mutex_lock(l)
+#define batch_unlock(l) pthread_mutex_unlock(l)
+#else
+#define BATCH_MAX_THREADS 1      /* single worker, no locking needed */
+typedef int BatchLock;
+#define batch_lock_init(l) ((void)(l))
+#define batch_lock_destroy(l) ((void)(l))
+#define batch_lock(l) ((void)(l))
+#define batch_unlock(l) ((void)(l))
+#endif
+
+typedef struct {
+    int id;                      /* 0-based input order */
+    int src, dst;                /* city indices, -1 if not found */
+    int car;                     /* index into the car table, -1 for the default */
+    double co2_gkm;
+    int depart_s;                /* seconds after local midnight, -1 = now (live traffic) */
+    char from[128], to[128];     /* names as given, reported for unknown places */
+} BatchJob;
+
+typedef struct {
+    const char *status;          /* "ok", "no_route" or why the job was rejected */
+    double distance_km;
+    double traffic_km;
+    double co2_g;
+    double car_min;
+    int hops;
+    int settled;
+} BatchResult;
+
+/* Called with results [lo, hi) of one finished chunk, serialized by the pool */
+typedef void (*BatchEmitFn)(void *ctx, const BatchJob *jobs, const BatchResult *res, int lo, int hi);
+
+/* Remaining jobs [lo, hi) of one worker */
+typedef struct {
+    BatchLock lock;
+    int lo, hi;
+} BatchRange;
+
+typedef struct {
+    Graph *g;
+    const BatchJob *jobs;
+    BatchResult *res;
+    int nthreads;
+    BatchRange *ranges;
+    BatchLock emit_lock;
+    BatchEmitFn emit;
+    void *ctx;
+} BatchPool;
+
+typedef struct {
+    BatchPool *pool;
+    int self;
+} BatchWorker;
+
+/* Take up to BATCH_CHUNK jobs from the front of range r; 0 if it is empty */
+static int batch_take(BatchRange *r, int *lo, int *hi) {
+    batch_lock(&r->lock);
+    int ok = r->lo < r->hi;
+    if (ok) {
+        *lo = r->lo;
+        *hi = r->lo + BATCH_CHUNK < r->hi ? r->lo + BATCH_CHUNK : r->hi;
+        r->lo = *hi;
+    }
+    batch_unlock(&r->lock);
+    return ok;
+}
+
+static int batch_range_left(BatchRange *r) {
+    batch_lock(&r->lock);
+    int left = r->hi - r->lo;
+    batch_unlock(&r->lock);
+    return left;
+}
+
+/* Move the back half of the fullest other range into range self (which is
+   empty). Jobs are never added, so once a scan finds every range empty the
+   batch is finished for this worker; returns 0 then. */
+static int batch_steal(BatchPool *p, int self) {
+    for (;;) {
+        int victim = -1, best = 0;
+        for (int i = 0; i < p->nthreads; ++i) {
+            if (i == self) continue;
+            int left = batch_range_left(&p->ranges[i]);
+            if (left > best) { best = left; victim = i; }
+        }
+        if (victim < 0) return 0;
+        BatchRange *v = &p->ranges[victim];
+        int lo = 0, hi = 0;
+        batch_lock(&v->lock);
+        if (v->hi > v->lo) {
+            hi = v->hi;
+            lo = v->hi - (v->hi - v->lo + 1) / 2;
+            v->hi = lo;
+        }
+        batch_unlock(&v->lock);
+        if (lo >= hi) continue;       /* drained since the scan; look again */
+        BatchRange *r = &p->ranges[self];
+        batch_lock(&r->lock);
+        r->lo = lo; r->hi = hi;
+        batch_unlock(&r->lock);
+        return 1;
+    }
+}
+
+static void batch_run_job(Graph *g, QueryWorkspace *ws, int *path, const BatchJob *j, BatchResult *r) {
+    memset(r, 0, sizeof(*r));
+    if (j->src < 0 || j->dst < 0) { r->status = "unknown_place"; return; }
+    int len = 0;
+    double traffic_km = 0;
+    int found = j->depart_s >= 0 ? dijkstra_td(g, ws, j->src, j->dst, j->depart_s, path, &len, &traffic_km)
+                                 : dijkstra_ws(g, ws, j->src, j->dst, path, &len, &traffic_km);
+    if (!found) {
+        r->status = "no_route";
+        r->settled = ws->stats.settled;
+        return;
+    }
+    r->status = "ok";
+    r->traffic_km = traffic_km;
+    r->co2_g = co2_grams(traffic_km, j->co2_gkm);
+    if (j->depart_s >= 0) route_totals_td(g, path, len, j->depart_s, &r->distance_km, &r->car_min);
+    else route_totals(g, path, len, &r->distance_km, &r->car_min);
+    traffic_note_path(g, path, len);
+    r->hops = len - 1;
+    r->settled = ws->stats.settled;
+}
+
+static void *batch_worker(void *arg) {
+    BatchWorker *w = arg;
+    BatchPool *p = w->pool;
+    QueryWorkspace ws;
+    memset(&ws, 0, sizeof(ws));
+    int *path = malloc(sizeof(int) * MAX_PATH_NODES);
+    if (!path || !qws_reserve(&ws, p->g->n)) { perror("malloc"); exit(1); }
+    for (;;) {
+        int lo, hi;
+        if (!batch_take(&p->ranges[w->self], &lo, &hi)) {
+            if (!batch_steal(p, w->self)) break;
+            continue;
+        }
+        for (int i = lo; i < hi; ++i) {
+            /* one pin per route: a weight swap lands between jobs, never inside one */
+            Graph view;
+            TrafficSet *pin = graph_pin(p->g, &view);
+            batch_run_job(&view, &ws, path, &p->jobs[i], &p->res[i]);
+            graph_unpin(pin);
+        }
+        if (p->emit) {
+            batch_lock(&p->emit_lock);
+            p->emit(p->ctx, p->jobs, p->res, lo, hi);
+            batch_unlock(&p->emit_lock);
+        }
+    }
+    free(path);
+    qws_free(&ws);
+    return NULL;
+}
+
+/* Route jobs[0..n) on nthreads workers, filling res[0..n) and calling emit
+   per finished chunk. The graph must be fully prepared (weights applied,
+   hierarchy customized) and is not modified. Returns 0 if no thread could
+   be started. */
+int batch_route(Graph *g, const BatchJob *jobs, BatchResult *res, int n,
+                int nthreads, BatchEmitFn emit, void *ctx) {
+    if (nthreads < 1) nthreads = 1;
+    if (nthreads > BATCH_MAX_THREADS) nthreads = BATCH_MAX_THREADS;
+    if (nthreads > n) nthreads = n > 0 ? n : 1;
+    BatchPool p;
+    p.g = g; p.jobs = jobs; p.res = res; p.nthreads = nthreads;
+    p.emit = emit; p.ctx = ctx;
+    p.ranges = calloc(nthreads, sizeof(BatchRange));
+    BatchWorker *w = malloc(sizeof(BatchWorker) * nthreads);
+    if (!p.ranges || !w) { perror("malloc"); exit(1); }
+    batch_lock_init(&p.emit_lock);
+    for (int t = 0; t < nthreads; ++t) {
+        batch_lock_init(&p.ranges[t].lock);
+        p.ranges[t].lo = (int)((long long)n * t / nthreads);
+        p.ranges[t].hi = (int)((long long)n * (t + 1) / nthreads);
+        w[t].pool = &p; w[t].self = t;
+    }
+    int started = 0;
+#ifndef _WIN32
+    pthread_t *tid = malloc(sizeof(pthread_t) * nthreads);
+    if (!tid) { perror("malloc"); exit(1); }
+    for (int t = 0; t < nthreads; ++t) {
+        if (pthread_create(&tid[t], NULL, batch_worker, &w[t]) != 0) break;
+        started++;
+    }
+    /* Workers that did start steal the ranges of those that did not */
+    for (int t = 0; t < started; ++t) pthread_join(tid[t], NULL);
+    free(tid);
+#else
+    batch_worker(&w[0]);
+    started = 1;
+#endif
+    for (int t = 0; t < nthreads; ++t) batch_lock_destroy(&p.ranges[t].lock);
+    batch_lock_destroy(&p.emit_lock);
+    free(p.ranges); free(w);
+    return started > 0;
+}
+
+/* -------------------- Command-line batch mode -------------------- */
+
+typedef struct {
+    FILE *out;
+    int jsonl;
+    const City *cities;
+    const CarModel *cars;
+} BatchOutput;
+
+static void batch_put_csv_field(FILE *f, const char *s) {
+    if (!strpbrk(s, ",\"\r\n")) { fputs(s, f); return; }
+    fputc('"', f);
+    for (; *s; ++s) {
+        if (*s == '"') fputc('"', f);
+        fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+static void batch_put_json_string(FILE *f, const char *s) {
+    fputc('"', f);
+    for (; *s; ++s) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') { fputc('\\', f); fputc(c, f); }
+        else if (c < 0x20) fprintf(f, "\\u%04x", c);
+        else fputc(c, f);
+    }
+    fputc('"', f);
+}
+
+static void batch_emit_rows(void *ctx, const BatchJob *jobs, const BatchResult *res, int lo, int hi) {
+    BatchOutput *o = ctx;
+    for (int i = lo; i < hi; ++i) {
+        const BatchJob *j = &jobs[i];
+        const BatchResult *r = &res[i];
+        const char *src = j->src >= 0 ? o->cities[j->src].name : j->from;
+        const char *dst = j->dst >= 0 ? o->cities[j->dst].name : j->to;
+        const char *car = j->car >= 0 ? o->cars[j->car].name : "Default";
+        if (o->jsonl) {
+            fprintf(o->out, "{\"id\":%d,\"source\":", j->id);
+            batch_put_json_string(o->out, src);
+            fputs(",\"destination\":", o->out);
+            batch_put_json_string(o->out, dst);
+            fputs(",\"car\":", o->out);
+            batch_put_json_string(o->out, car);
+            fprintf(o->out, ",\"g_per_km\":%.2f,\"status\":\"%s\"", j->co2_gkm, r->status);
+            if (strcmp(r->status, "ok") == 0)
+                fprintf(o->out, ",\"distance_km\":%.3f,\"traffic_km\":%.3f,\"co2_g\":%.1f,"
+                        "\"car_min\":%.1f,\"hops\":%d", r->distance_km, r->traffic_km,
+                        r->co2_g, r->car_min, r->hops);
+            fputs("}\n", o->out);
+        } else {
+            fprintf(o->out, "%d,", j->id);
+            batch_put_csv_field(o->out, src); fputc(',', o->out);
+            batch_put_csv_field(o->out, dst); fputc(',', o->out);
+            batch_put_csv_field(o->out, car);
+            fprintf(o->out, ",%.2f,%s", j->co2_gkm, r->status);
+            if (strcmp(r->status, "ok") == 0)
+                fprintf(o->out, ",%.3f,%.3f,%.1f,%.1f,%d\n", r->distance_km, r->traffic_km,
+                        r->co2_g, r->car_min, r->hops);
+            else
+                fputs(",,,,,\n", o->out);
+        }
+    }
+}
+
+/* Online CPUs, at least 1 (1 on Windows, where the pool is single-threaded) */
+static int batch_default_threads(void) {
+#ifdef _WIN32
+    return 1;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#endif
+}
+
+/* Parse "source,destination[,car[,HH:MM]]" lines; '#' comments and blank
+   lines are skipped. Unknown places are kept as rejected jobs so every
+   input line gets an output row; an unknown car falls back to the default
+   g/km and a bad time to leaving now. Each of these is reported on stderr
+   with its line number. Returns the job count, -1 on error. */
+static int batch_read_jobs(const char *fn, const City *cities, int n, const CarModel *cars,
+                           int ncars, BatchJob **out) {
+    FILE *f = strcmp(fn, "-") == 0 ? stdin : fopen(fn, "r");
+    if (!f) { perror(fn); return -1; }
+    int cnt = 0, cap = 0, lineno = 0;
+    BatchJob *jobs = NULL;
+    char line[MAX_LINE];
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+        line[strcspn(line, "\r\n")] = 0;
+        char *s = line;
+        while (isspace((unsigned char)*s)) s++;
+        if (*s == 0 || *s == '#') continue;
+        char *c1 = strchr(s, ',');
+        if (!c1) { fprintf(stderr, "batch: line %d: skipping malformed line: %s\n", lineno, s); continue; }
+        *c1 = 0;
+        char *d = c1 + 1, *car = strchr(d, ','), *when = NULL;
+        if (car) *car++ = 0;
+        if (car && (when = strchr(car, ','))) *when++ = 0;
+        trim(s); trim(d);
+        if (car) trim(car);
+        if (when) trim(when);
+        if (cnt == cap) {
+            cap = cap ? cap * 2 : 256;
+            BatchJob *nj = realloc(jobs, sizeof(BatchJob) * cap);
+            if (!nj) { perror("realloc"); free(jobs); if (f != stdin) fclose(f); return -1; }
+            jobs = nj;
+        }
+        BatchJob *j = &jobs[cnt];
+        j->id = cnt;
+        snprintf(j->from, sizeof(j->from), "%.*s", (int)sizeof(j->from) - 1, s);
+        snprintf(j->to, sizeof(j->to), "%.*s", (int)sizeof(j->to) - 1, d);
+        j->src = find_city(cities, n, s);
+        j->dst = find_city(cities, n, d);
+        j->car = -1;
+        if (car && *car && strcasecmp(car, "Default") != 0) {
+            j->car = find_car_model(cars, ncars, car);
+            if (j->car < 0)
+                fprintf(stderr, "batch: line %d: unknown car '%s', using default %.1f g/km\n",
+                        lineno, car, DEFAULT_CO2_GKM);
+        }
+        j->co2_gkm = j->car >= 0 ? cars[j->car].co2_gkm : DEFAULT_CO2_GKM;
+        j->depart_s = when && *when ? parse_clock_time(when) : -1;
+        if (when && *when && j->depart_s < 0)
+            fprintf(stderr, "batch: line %d: bad departure '%s', leaving now\n", lineno, when);
+        if (j->src < 0) fprintf(stderr, "batch: line %d: unknown place '%s'\n", lineno, s);
+        if (j->dst < 0) fprintf(stderr, "batch: line %d: unknown place '%s'\n", lineno, d);
+        cnt++;
+    }
+    if (f != stdin) fclose(f);
+    *out = jobs;
+    return cnt;
+}
+
+/* Road graph over cities (takes ownership) with cached traffic applied and,
+   in the default CCH mode, the hierarchy customized. Stale samples are
+   refreshed by *tr in the background; stop it before freeing g. */
+static void batch_prepare_graph(Graph *g, City *cities, int n, TrafficRefresher *tr) {
+    clock_t t_prep = clock();
+    g->n = n;
+    g->cities = cities;
+    build_sparse_graph(g, GRAPH_KNN_K);
+    dijkstra_mode_from_env(DIJKSTRA_CCH);
+    if (dijkstra_mode == DIJKSTRA_CCH) graph_prepare_cch(g);
+    load_traffic_factors(g, CACHE_TTL_MINUTES_DEFAULT);
+    apply_traffic_weights(g);
+    fprintf(stderr, "Graph: %d places, %d roads, %s search, prepared in %.1f ms\n", g->n, g->m / 2,
+            dijkstra_mode_names[dijkstra_mode], (double)(clock() - t_prep) * 1000.0 / CLOCKS_PER_SEC);
+    if (traffic_refresher_start(tr, g, SAMPLE_EVERY_N, CACHE_TTL_MINUTES_DEFAULT, TRAFFIC_REFRESH_INTERVAL))
+        fprintf(stderr, "Traffic: refreshing stale samples in the background\n");
+}
+
+static void batch_usage(const char *prog) {
+    fprintf(stderr, "usage: %s --batch od.csv [--out file] [--format csv|jsonl] [--threads N]\n"
+                    "  od.csv lines: source,destination[,car[,HH:MM departure]]   ('-' reads stdin)\n", prog);
+}
+
+/* `--batch` entry point: loads cities.txt and cars.txt, prepares the graph
+   once, then routes every line of the OD file. No prompts, no browser. */
+int batch_main(int argc, char **argv) {
+    const char *od_fn = NULL, *out_fn = NULL;
+    int jsonl = 0, nthreads = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) od_fn = argv[++i];
+        else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) out_fn = argv[++i];
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) nthreads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            const char *fmt = argv[++i];
+            if (strcasecmp(fmt, "jsonl") == 0) jsonl = 1;
+            else if (strcasecmp(fmt, "csv") != 0) { batch_usage(argv[0]); return 1; }
+        } else { batch_usage(argv[0]); return 1; }
+    }
+    if (!od_fn) { batch_usage(argv[0]); return 1; }
+    if (nthreads <= 0) nthreads = batch_default_threads();
+
+    City *cities = NULL;
+    int n = 0;
+    if (!load_cities_comma("cities.txt", &cities, &n)) {
+        fprintf(stderr, "Failed to load cities.txt\n");
+        return 1;
+    }
+    CarModel *cars = NULL;
+    int ncars = 0;
+    if (!load_car_models("cars.txt", &cars, &ncars))
+        fprintf(stderr, "cars.txt not found; using default CO2 for every row\n");
+
+    BatchJob *jobs = NULL;
+    int njobs = batch_read_jobs(od_fn, cities, n, cars, ncars, &jobs);
+    if (njobs < 0) { free(cities); free(cars); return 1; }
+
+    Graph g;
+    TrafficRefresher tr;
+    batch_prepare_graph(&g, cities, n, &tr);
+
+    BatchOutput o;
+    o.out = stdout;
+    o.jsonl = jsonl;
+    o.cities = g.cities;
+    o.cars = cars;
+    if (out_fn && !(o.out = fopen(out_fn, "w"))) {
+        perror(out_fn);
+        traffic_refresher_stop(&tr);
+        free(jobs); free(cars); free_graph(&g);
+        return 1;
+    }
+    if (!jsonl)
+        fputs("id,source,destination,car,g_per_km,status,distance_km,traffic_km,co2_g,car_min,hops\n", o.out);
+
+    BatchResult *res = calloc(njobs > 0 ? njobs : 1, sizeof(BatchResult));
+    if (!res) { perror("calloc"); exit(1); }
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    int ok = batch_route(&g, jobs, res, njobs, nthreads, batch_emit_rows, &o);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+
+    int routed = 0;
+    for (int i = 0; i < njobs; ++i) if (res[i].status && strcmp(res[i].status, "ok") == 0) routed++;
+    if (nthreads > BATCH_MAX_THREADS) nthreads = BATCH_MAX_THREADS;
+    if (nthreads > njobs) nthreads = njobs > 0 ? njobs : 1;
+    fprintf(stderr, "Batch: %d of %d routes on %d threads in %.3f s (%.0f routes/s)\n",
+            routed, njobs, nthreads, secs, secs > 0 ? njobs / secs : 0.0);
+
+    if (o.out != stdout) fclose(o.out);
+    else fflush(stdout);
+    traffic_refresher_stop(&tr);
+    if (!save_traffic_cache(&g, TRAFFIC_CACHE_FILE))      /* keeps the route counts */
+        fprintf(stderr, "⚠️  Warning: failed to write traffic cache '%s'\n", TRAFFIC_CACHE_FILE);
+    free(res); free(jobs); free(cars);
+    free_graph(&g);
+    return ok ? 0 : 1;
+}
+
+/* -------------------- Many-to-many matrix -------------------- */
+
+#define MATRIX_FILE_MAGIC "ECOMTX1"
+
+/* Places named by the first comma-separated field of each line ('#' and
+   blank lines skipped), so cities.txt itself is a valid list; names[0..n)
+   are the graph's place names. Returns the count, -1 on error or an
+   unknown name. */
+static int matrix_read_places(const char *fn, const char *const *names, int n, int **out) {
+    FILE *f = fopen(fn, "r");
+    if (!f) { perror(fn); return -1; }
+    int cnt = 0, cap = 0, bad = 0;
+    int *ids = NULL;
+    char line[MAX_LINE];
+    while (fgets(line, sizeof(line), f)) {
+        line[strcspn(line, ",\r\n")] = 0;
+        trim(line);
+        if (line[0] == 0 || line[0] == '#') continue;
+        int id = -1;
+        for (int i = 0; i < n && id < 0; ++i) if (strcasecmp(names[i], line) == 0) id = i;
+        if (id < 0) { fprintf(stderr, "matrix: %s: unknown place '%s'\n", fn, line); bad = 1; continue; }
+        if (cnt == cap) {
+            cap = cap ? cap * 2 : 64;
+            int *ni = realloc(ids, sizeof(int) * cap);
+            if (!ni) { perror("realloc"); bad = 1; break; }
+            ids = ni;
+        }
+        ids[cnt++] = id;
+    }
+    fclose(f);
+    if (bad) { free(ids); return -1; }
+    *out = ids;
+    return cnt;
+}
+
+static void matrix_usage(const char *prog) {
+    fprintf(stderr, "usage: %s --matrix sources.txt targets.txt [--out file] [--format csv|bin]\n"
+                    "          [--metric co2|km|dist] [--car MODEL]\n"
+                    "  place lists: one name per line (first comma field)\n"
+                    "  co2, km: CO2 router on cities.txt (grams, traffic-weighted km)\n"
+                    "  dist: distance router on %s (km)\n"
+                    "  bin: \"%s\\0\", int32 rows, int32 cols, rows*cols float32 (inf = no route)\n",
+            prog, PLACES_FILE, MATRIX_FILE_MAGIC);
+}
+
+/* Write the ns x nt matrix m (INF = no route) as CSV with `decimals`
+   places, or in the binary layout of matrix_usage(). Returns 0 on error. */
+static int matrix_write(const char *out_fn, int binary, const char *const *names, const int *src, int ns,
+                        const int *dst, int nt, const double *m, int decimals) {
+    FILE *out = out_fn ? fopen(out_fn, binary ? "wb" : "w") : stdout;
+    if (!out) { perror(out_fn); return 0; }
+    if (binary) {
+        int32_t dims[2] = { ns, nt };
+        fwrite(MATRIX_FILE_MAGIC, 1, sizeof(MATRIX_FILE_MAGIC), out);
+        fwrite(dims, sizeof(int32_t), 2, out);
+        for (long long i = 0; i < (long long)ns * nt; ++i) {
+            float v = m[i] >= INF / 2 ? INFINITY : (float)m[i];
+            fwrite(&v, sizeof(float), 1, out);
+        }
+    } else {
+        fputs("source", out);
+        for (int j = 0; j < nt; ++j) { fputc(',', out); batch_put_csv_field(out, names[dst[j]]); }
+        fputc('\n', out);
+        for (int i = 0; i < ns; ++i) {
+            batch_put_csv_field(out, names[src[i]]);
+            for (int j = 0; j < nt; ++j) {
+                double v = m[(long long)i * nt + j];
+                if (v >= INF / 2) fputc(',', out);
+                else fprintf(out, ",%.*f", decimals, v);
+            }
+            fputc('\n', out);
+        }
+    }
+    if (out != stdout) {
+        if (fclose(out) != 0) { perror(out_fn); return 0; }
+    } else {
+        fflush(stdout);
+    }
+    return 1;
+}
+
+/* `--matrix --metric dist`: the distance router's matrix on places.txt */
+static int matrix_dist_main(const char *src_fn, const char *dst_fn, const char *out_fn, int binary) {
+    /* the graph builder reports on stdout; keep that out of a CSV there */
+    fflush(stdout);
+    int saved = dup(1);
+    if (saved >= 0) dup2(2, 1);
+    const RouteGraph *rg = ensure_graph();
+    fflush(stdout);
+    if (saved >= 0) { dup2(saved, 1); close(saved); }
+    const char **names = malloc(sizeof(char *) * rg->V);
+    if (!names) { perror("malloc"); exit(1); }
+    for (int i = 0; i < rg->V; ++i) names[i] = rg->names[i];
+    int *src = NULL, *dst = NULL;
+    int ns = matrix_read_places(src_fn, names, rg->V, &src);
+    int nt = ns < 0 ? -1 : matrix_read_places(dst_fn, names, rg->V, &dst);
+    if (ns < 0 || nt < 0) { free(src); free(names); return 1; }
+    double *m = malloc(sizeof(double) * ((long long)ns * nt > 0 ? (long long)ns * nt : 1));
+    if (!m) { perror("malloc"); exit(1); }
+    RouteQuery q;
+    memset(&q, 0, sizeof(q));
+    route_query_init(&q, rg->V);
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    int ok = route_matrix(rg, &q, src, ns, dst, nt, m);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+    if (!ok) { fprintf(stderr, "matrix: out of memory\n"); exit(1); }
+    fprintf(stderr, "Matrix: %d x %d km on %s in %.3f s (%d nodes settled)\n", ns, nt, PLACES_FILE, secs,
+            q.best_settled);
+    ok = matrix_write(out_fn, binary, names, src, ns, dst, nt, m, 3);
+    route_query_free(&q);
+    free(m); free(src); free(dst); free(names);
+    return ok ? 0 : 1;
+}
+
+/* `--matrix` entry point: every source to every target on the CO2 graph.
+   co2 entries are grams for the chosen car, km entries traffic-weighted km;
+   dist runs on the distance router instead. */
+int matrix_main(int argc, char **argv) {
+    const char *src_fn = NULL, *dst_fn = NULL, *out_fn = NULL, *car_name = NULL;
+    int binary = 0, metric_km = 0, metric_dist = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--matrix") == 0 && i + 2 < argc) { src_fn = argv[++i]; dst_fn = argv[++i]; }
+        else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) out_fn = argv[++i];
+        else if (strcmp(argv[i], "--car") == 0 && i + 1 < argc) car_name = argv[++i];
+        else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            const char *fmt = argv[++i];
+            if (strcasecmp(fmt, "bin") == 0) binary = 1;
+            else if (strcasecmp(fmt, "csv") != 0) { matrix_usage(argv[0]); return 1; }
+        } else if (strcmp(argv[i], "--metric") == 0 && i + 1 < argc) {
+            const char *m = argv[++i];
+            if (strcasecmp(m, "km") == 0) metric_km = 1;
+            else if (strcasecmp(m, "dist") == 0) metric_dist = 1;
+            else if (strcasecmp(m, "co2") != 0) { matrix_usage(argv[0]); return 1; }
+        } else { matrix_usage(argv[0]); return 1; }
+    }
+    if (!src_fn || !dst_fn) { matrix_usage(argv[0]); return 1; }
+    if (binary && !out_fn) { fprintf(stderr, "matrix: --format bin needs --out\n"); return 1; }
+    if (metric_dist) return matrix_dist_main(src_fn, dst_fn, out_fn, binary);
+
+    City *cities = NULL;
+    int n = 0;
+    if (!load_cities_comma("cities.txt", &cities, &n)) {
+        fprintf(stderr, "Failed to load cities.txt\n");
+        return 1;
+    }
+    double gkm = DEFAULT_CO2_GKM;
+    if (car_name && !metric_km) {
+        CarModel *cars = NULL;
+        int ncars = 0, k = -1;
+        if (load_car_models("cars.txt", &cars, &ncars)) k = find_car_model(cars, ncars, car_name);
+        if (k >= 0) gkm = cars[k].co2_gkm;
+        else fprintf(stderr, "matrix: unknown car '%s', using default %.1f g/km\n", car_name, gkm);
+        free(cars);
+    }
+    const char **names = malloc(sizeof(char *) * (n > 0 ? n : 1));
+    if (!names) { perror("malloc"); exit(1); }
+    for (int i = 0; i < n; ++i) names[i] = cities[i].name;
+    int *src = NULL, *dst = NULL;
+    int ns = matrix_read_places(src_fn, names, n, &src);
+    int nt = ns < 0 ? -1 : matrix_read_places(dst_fn, names, n, &dst);
+    if (ns < 0 || nt < 0) { free(src); free(names); free(cities); return 1; }
+
+    Graph g;
+    TrafficRefresher tr;
+    batch_prepare_graph(&g, cities, n, &tr);
+    double *m = malloc(sizeof(double) * ((long long)ns * nt > 0 ? (long long)ns * nt : 1));
+    if (!m) { perror("malloc"); exit(1); }
+    QueryWorkspace ws;
+    memset(&ws, 0, sizeof(ws));
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    Graph view;
+    TrafficSet *pin = graph_pin(&g, &view);
+    int ok = graph_matrix(&view, &ws, src, ns, dst, nt, m);
+    graph_unpin(pin);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+    if (!ok) { fprintf(stderr, "matrix: out of memory\n"); exit(1); }
+    fprintf(stderr, "Matrix: %d x %d in %.3f s (%d nodes settled)\n", ns, nt, secs, ws.stats.settled);
+
+    if (!metric_km)
+        for (long long i = 0; i < (long long)ns * nt; ++i) if (m[i] < INF / 2) m[i] = co2_grams(m[i], gkm);
+    ok = matrix_write(out_fn, binary, names, src, ns, dst, nt, m, metric_km ? 3 : 1);
+    free(names);
+    free(m); free(src); free(dst);
+    qws_free(&ws);
+    traffic_refresher_stop(&tr);
+    free_graph(&g);
+    return ok ? 0 : 1;
+}
+
+/* -------------------- Traffic cache import/export -------------------- */
+
+static void traffic_usage(const char *prog) {
+    fprintf(stderr, "usage: %s --traffic export|import file.txt\n"
+                    "  export: write %s as text (timestamp line, then \"u v factor\" per road)\n"
+                    "  import: replace %s with a text file in that format\n",
+            prog, TRAFFIC_CACHE_FILE, TRAFFIC_CACHE_FILE);
+}
+
+/* `--traffic` entry point, on the graph built from cities.txt */
+int traffic_main(int argc, char **argv) {
+    if (argc != 4 || (strcmp(argv[2], "export") != 0 && strcmp(argv[2], "import") != 0)) {
+        traffic_usage(argv[0]);
+        return 1;
+    }
+    int export = strcmp(argv[2], "export") == 0;
+    City *cities = NULL;
+    int n = 0;
+    if (!load_cities_comma("cities.txt", &cities, &n)) {
+        fprintf(stderr, "Failed to load cities.txt\n");
+        return 1;
+    }
+    Graph g;
+    g.n = n;
+    g.cities = cities;
+    build_sparse_graph(&g, GRAPH_KNN_K);
+    int ok;
+    long long oldest = 0;
+    if (export) {
+        ok = load_traffic_cache(&g, TRAFFIC_CACHE_FILE, &oldest) && export_traffic_text(&g, argv[3]);
+        if (!ok) fprintf(stderr, "traffic: no cache for this graph in '%s', or cannot write '%s'\n",
+                         TRAFFIC_CACHE_FILE, argv[3]);
+    } else {
+        ok = import_traffic_text(&g, argv[3]) && save_traffic_cache(&g, TRAFFIC_CACHE_FILE);
+        if (!ok) fprintf(stderr, "traffic: cannot read '%s' or write '%s'\n", argv[3], TRAFFIC_CACHE_FILE);
+    }
+    if (ok) fprintf(stderr, "%s %d roads\n", export ? "Exported" : "Imported", g.m / 2);
+    free_graph(&g);
+    return ok ? 0 : 1;
+}
+
+#endif /* BATCH_H */
@@ -0,0 +1,1308 @@
+/* =========================================================================
+   bench.c -- micro-benchmarks for the routing modules on synthetic inputs
+   Compile:
+     gcc -O2 bench.c -o bench -lm -lpthread
+   Usage:
+     ./bench knn [V ...]      k-d tree vs brute-force KNN graph builder
+     ./bench search [V] [Q]   settled nodes, Dijkstra vs A* vs bidirectional, both routers
+     ./bench ch [V] [Q]       contraction hierarchy build time and queries vs Dijkstra
+     ./bench cch [V] [Q]      CO2 router: customizable CH contraction, customization, queries
+     ./bench batch [V] [Q] [T] batch OD routing throughput on 1..T threads (default: online CPUs)
+     ./bench matrix [V] [S] [T] S x T many-to-many (buckets) vs S*T point queries, both routers
+     ./bench ksp [V] [Q] [K]  Yen K-shortest loopless routes (distance router), time per query
+     ./bench alt [V] [Q]      CO2 router plateau alternatives vs one heap Dijkstra query
+     ./bench flow [N] [C] [L] N traffic samples from a local mock provider with L ms
+                              latency: curl per point vs keep-alive vs a pool of C connections
+     ./bench mockflow [PORT] [L] serve the mock provider (for ECO_FLOW_URL) until killed
+     ./bench cells [V ...]    traffic provider calls per refresh vs sample grid cell size
+     ./bench tcache [V]       traffic cache save/load: sparse binary (mmap) by share of
+                              congested roads vs legacy text
+     ./bench refresh [V] [R] [B] R simulated minutes of routing: budgeted incremental traffic
+                              refresh (B requests/min) vs full resample on TTL expiry
+     ./bench idw [V] [N ...]  traffic accuracy vs provider calls, sampling every Nth grid cell
+                              of a synthetic congestion field: free flow vs IDW for the rest
+     ./bench td [V] [Q]       time-of-day profiles (rush hours over congestion_field): size,
+                              quantization error, time-dependent vs static routes and query time
+     ./bench profile [V] [Q] [W] best departure in a W-minute window: one profile search vs
+                              a time-dependent query per minute
+     ./bench pareto [V] [Q] [L] CO2 / car time / distance Pareto fronts: exact vs bag size L
+                              and epsilon-dominance, time, labels and worst gap to the exact front
+     ./bench rcu [V] [Q] [L]  Q CCH queries while traffic refreshes (mock, L ms latency):
+                              inline refresh vs background refresher, latency and consistency
+   ========================================================================= */
+
+#define _GNU_SOURCE             /* memmem for the mock flow provider */
+#define MAXV 200000
+#include "adb[1].h"
+#include "carbon.c"
+#include "batch.h"
+
+/* brute force is O(V^2 k); skip it above this size */
+#define BENCH_BRUTE_MAX 20000
+
+static double now_sec(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Distance-router graph and query context shared by the benchmarks */
+static RouteGraph rg;
+static RouteQuery rq;
+
+/* n places around Dehradun; half uniform, half in tight campus-like clusters */
+static void synth_places(int n, unsigned seed){
+    srand(seed);
+    route_graph_alloc(&rg, n);
+    for(int i=0;i<n;i++){
+        snprintf(rg.names[i], NAMELEN, "p%d", i);
+        if(i%2==0){
+            rg.lat[i] = 29.5 + (rand()%100000)/100000.0 * 1.5;
+            rg.lon[i] = 77.5 + (rand()%100000)/100000.0 * 1.5;
+        } else {
+            int c = rand()%50;
+            rg.lat[i] = 29.5 + (c%7)*0.2 + (rand()%1000)/1e6;
+            rg.lon[i] = 77.5 + (c/7)*0.2 + (rand()%1000)/1e6;
+        }
+    }
+    route_query_free(&rq);
+    route_query_init(&rq, n);
+}
+
+static double edge_weight_sum(void){
+    double s=0;
+    for(int e=0;e<rg.E;e++) s+=rg.w[e];
+    return s;
+}
+
+/* Reference O(V^2 k) KNN builder for bench_knn: full distance scan + partial selection sort */
+static void build_knn_bruteforce(RouteGraph *g, int k){
+    int V=g->V;
+    reset_graph(g);
+    if (k<1) k=1;
+    if (V-1<k) k=V-1;
+
+    double *dists=(double*)malloc(sizeof(double)*V);
+    int *idx=(int*)malloc(sizeof(int)*V);
+    if(!dists||!idx) die("Memory error in KNN.");
+
+    for(int u=0;u<V;u++){
+        for(int v=0;v<V;v++){ dists[v]=(u==v)?INF:haversine_km_idx(g,u,v); idx[v]=v; }
+        for(int i=0;i<k && i<V;i++){
+            int mi=i;
+            for(int j=i+1;j<V;j++) if(dists[j]<dists[mi]) mi=j;
+            double td=dists[i]; dists[i]=dists[mi]; dists[mi]=td;
+            int ti=idx[i]; idx[i]=idx[mi]; idx[mi]=ti;
+        }
+        int kk=(k<V)?k:V;
+        for(int i=0;i<kk;i++){ int v=idx[i]; if(v!=u) add_edge(g,u,v,haversine_km_idx(g,u,v)); }
+    }
+    free(dists); free(idx);
+    printf("\n[Graph Builder] Built %d-NN undirected graph with %d edges (V=%d)\n", k, g->E/2, V);
+}
+
+static void bench_knn(int argc, char **argv){
+    int sizes_default[] = {1000, 5000, 20000, 100000, 200000};
+    int nsizes = argc > 0 ? argc : (int)(sizeof(sizes_default)/sizeof(sizes_default[0]));
+    int k = 8;
+    printf("%-8s %12s %12s %8s\n", "V", "kd-tree (s)", "brute (s)", "match");
+    for(int i=0;i<nsizes;i++){
+        int n = argc > 0 ? atoi(argv[i]) : sizes_default[i];
+        if(n<2 || n>MAXV){ printf("%-8d skipped (2..%d)\n", n, MAXV); continue; }
+        synth_places(n, 42u);
+
+        double t0=now_sec();
+        build_knn_fixed(&rg, k);
+        double tg=now_sec()-t0;
+        double sg=edge_weight_sum(); int eg=rg.E;
+
+        if(n<=BENCH_BRUTE_MAX){
+            t0=now_sec();
+            build_knn_bruteforce(&rg, k);
+            double tb=now_sec()-t0;
+            int same = (eg==rg.E) && fabs(sg-edge_weight_sum()) <= 1e-6*sg;
+            printf("%-8d %12.4f %12.4f %8s\n", n, tg, tb, same?"yes":"NO");
+        } else {
+            printf("%-8d %12.4f %12s %8s\n", n, tg, "-", "-");
+        }
+    }
+}
+
+/* Q random point-to-point queries on a V-place synthetic graph; costs must
+   agree, settled counts show how much of the graph each search touches */
+static void bench_search(int argc, char **argv){
+    int n = argc > 0 ? atoi(argv[0]) : 20000;
+    int nq = argc > 1 ? atoi(argv[1]) : 200;
+    if(n<2 || n>MAXV){ fprintf(stderr, "V must be in 2..%d\n", MAXV); return; }
+    synth_places(n, 7u);
+    build_knn_fixed(&rg, 8);
+
+    Graph g;
+    g.n = n;
+    g.cities = calloc(n, sizeof(City));
+    if(!g.cities) die("Memory error.");
+    for(int i=0;i<n;i++){ g.cities[i].lat=rg.lat[i]; g.cities[i].lon=rg.lon[i]; }
+    build_sparse_graph(&g, GRAPH_KNN_K);
+    for(int a=0;a<g.m;a++) g.traffic_factor[a] = 1.0 + (g.neighbour[a] % 5) * 0.25;
+    apply_traffic_weights(&g);
+
+    static int path[MAX_PATH_NODES];
+    const char *label[3] = {"Dijkstra", "A*", "bidirectional"};
+    long settled[2][3] = {{0}};
+    double secs[2][3] = {{0}};
+    int mismatch=0;
+    srand(99);
+    for(int q=0;q<nq;q++){
+        int s=rand()%n, t=rand()%n;
+        double ref_dist=0, ref_co2=0;
+        for(int m=0;m<3;m++){
+            rq.use_astar = (m==1); rq.use_bidir = (m==2);
+            double t0=now_sec();
+            double c=ecodijkstra(&rg,&rq,s,t);
+            secs[0][m]+=now_sec()-t0; settled[0][m]+=rq.settled_cnt;
+            if(m==0) ref_dist=c; else if(fabs(c-ref_dist) > 1e-9*(ref_dist+1)) mismatch++;
+
+            DijkstraMode modes[3] = {DIJKSTRA_HEAP, DIJKSTRA_ASTAR, DIJKSTRA_BIDIR};
+            int len; double cc=0;
+            set_dijkstra_mode(modes[m]);
+            t0=now_sec();
+            dijkstra(&g,s,t,path,&len,&cc);
+            secs[1][m]+=now_sec()-t0; settled[1][m]+=dijkstra_stats.settled;
+            if(m==0) ref_co2=cc; else if(fabs(cc-ref_co2) > 1e-9*(ref_co2+1)) mismatch++;
+        }
+    }
+    rq.use_astar=1; rq.use_bidir=0;
+    printf("%d queries, V=%d\n", nq, n);
+    printf("%-26s %14s %14s\n", "", "avg settled", "avg ms");
+    for(int r=0;r<2;r++)
+        for(int m=0;m<3;m++){
+            char name[64];
+            snprintf(name, sizeof(name), "%s %s", r==0?"distance":"CO2", label[m]);
+            printf("%-26s %14.1f %14.3f\n", name, (double)settled[r][m]/nq, secs[r][m]*1e3/nq);
+        }
+    printf("cost mismatches: %d\n", mismatch);
+    free_graph(&g);
+}
+
+static void bench_ch(int argc, char **argv){
+    int n = argc > 0 ? atoi(argv[0]) : 20000;
+    int nq = argc > 1 ? atoi(argv[1]) : 1000;
+    if(n<2 || n>MAXV){ fprintf(stderr, "V must be in 2..%d\n", MAXV); return; }
+    synth_places(n, 11u);
+    build_knn_fixed(&rg, 8);
+
+    int ne=rg.E/2;
+    int *eu=malloc(sizeof(int)*ne), *ev=malloc(sizeof(int)*ne);
+    double *ew=malloc(sizeof(double)*ne);
+    if(!eu||!ev||!ew) die("Memory error.");
+    for(int i=0;i<ne;i++){ eu[i]=rg.to[2*i+1]; ev[i]=rg.to[2*i]; ew[i]=rg.w[2*i]; }
+    double t0=now_sec();
+    ContractionHierarchy h;
+    ch_build(&h, n, ne, eu, ev, ew);
+    double tb=now_sec()-t0;
+    free(eu); free(ev); free(ew);
+    ChWorkspace ws;
+    if(!ch_workspace_init(&ws, n)) die("Memory error.");
+
+    static int path[MAXV];
+    int len=0, cost_mismatch=0, path_mismatch=0;
+    long ch_settled=0, dj_settled=0;
+    double t_ch=0, t_dj=0;
+    rq.use_astar=0; rq.use_bidir=0;
+    srand(5);
+    for(int q=0;q<nq;q++){
+        int s=rand()%n, t=rand()%n;
+        t0=now_sec(); double a=ch_query(&h,&ws,s,t,path,&len,MAXV); t_ch+=now_sec()-t0; ch_settled+=ws.settled;
+        t0=now_sec(); double b=ecodijkstra(&rg,&rq,s,t); t_dj+=now_sec()-t0; dj_settled+=rq.settled_cnt;
+        if(fabs(a-b) > 1e-9*(b+1)){ cost_mismatch++; continue; }
+        int ref[MAXV > 4096 ? 4096 : MAXV];
+        if(b < INF/2 && len <= (int)(sizeof(ref)/sizeof(ref[0]))){
+            int rl=0;
+            for(int v=t; v!=-1 && rl<len+1; v=rq.parent[v]) rl++;
+            int same = (rl==len);
+            for(int i=len-1, v=t; same && i>=0; i--, v=rq.parent[v]) same = (path[i]==v);
+            if(!same) path_mismatch++;
+        }
+    }
+    rq.use_astar=1;
+    printf("V=%d, %d upward arcs, built in %.2fs\n", n, h.m, tb);
+    printf("%-12s %14s %14s\n", "", "avg settled", "avg us");
+    printf("%-12s %14.1f %14.1f\n", "Dijkstra", (double)dj_settled/nq, t_dj*1e6/nq);
+    printf("%-12s %14.1f %14.1f\n", "CH", (double)ch_settled/nq, t_ch*1e6/nq);
+    printf("cost mismatches: %d, path mismatches (ties): %d\n", cost_mismatch, path_mismatch);
+    ch_workspace_free(&ws);
+    ch_free(&h);
+}
+
+/* CO2 graph with a fresh traffic pattern per round; each round re-customizes
+   the hierarchy and checks it against the heap Dijkstra */
+static void bench_cch(int argc, char **argv){
+    int n = argc > 0 ? atoi(argv[0]) : 20000;
+    int nq = argc > 1 ? atoi(argv[1]) : 200;
+    if(n<2 || n>MAXV){ fprintf(stderr, "V must be in 2..%d\n", MAXV); return; }
+    synth_places(n, 13u);
+    Graph g;
+    g.n = n;
+    g.cities = calloc(n, sizeof(City));
+    if(!g.cities) die("Memory error.");
+    for(int i=0;i<n;i++){ g.cities[i].lat=rg.lat[i]; g.cities[i].lon=rg.lon[i]; }
+    build_sparse_graph(&g, GRAPH_KNN_K);
+
+    double t0=now_sec();
+    graph_prepare_cch(&g);
+    double tc=now_sec()-t0;
+    printf("V=%d, %d roads, %d hierarchy arcs, contracted in %.3fs\n", n, g.m/2, g.cch->h.m, tc);
+
+    static int path[MAX_PATH_NODES];
+    int rounds=3, mismatch=0;
+    long s_cch=0, s_dj=0;
+    double t_cus=0, t_cch=0, t_dj=0;
+    srand(17);
+    for(int r=0;r<rounds;r++){
+        for(int u=0;u<n;u++)
+            for(int a=g.offsets[u];a<g.offsets[u+1];a++)
+                if(g.neighbour[a]>u) set_road_sample(&g, a, 1.0 + (rand()%100)/50.0, 0);
+        t0=now_sec();
+        apply_traffic_weights(&g);
+        t_cus+=now_sec()-t0;
+        for(int q=0;q<nq;q++){
+            int s=rand()%n, t=rand()%n, len=0;
+            double a=0, b=0;
+            set_dijkstra_mode(DIJKSTRA_CCH);
+            t0=now_sec(); dijkstra(&g,s,t,path,&len,&a); t_cch+=now_sec()-t0; s_cch+=dijkstra_stats.settled;
+            double walk=0;
+            for(int i=0;i+1<len;i++) walk+=g.traffic_km[graph_find_arc(&g,path[i],path[i+1])];
+            set_dijkstra_mode(DIJKSTRA_HEAP);
+            t0=now_sec(); dijkstra(&g,s,t,path,&len,&b); t_dj+=now_sec()-t0; s_dj+=dijkstra_stats.settled;
+            if(fabs(a-b) > 1e-9*(b+1) || fabs(walk-b) > 1e-9*(b+1)) mismatch++;
+        }
+    }
+    int tq=rounds*nq;
+    printf("customization: %.2f ms per metric (%d metrics)\n", t_cus*1e3/rounds, rounds);
+    printf("%-12s %14s %14s\n", "", "avg settled", "avg us");
+    printf("%-12s %14.1f %14.1f\n", "Dijkstra", (double)s_dj/tq, t_dj*1e6/tq);
+    printf("%-12s %14.1f %14.1f\n", "CCH", (double)s_cch/tq, t_cch*1e6/tq);
+    printf("cost/path mismatches: %d of %d\n", mismatch, tq);
+    free_graph(&g);
+}
+
+static void bench_batch(int argc, char **argv){
+    int n = argc > 0 ? atoi(argv[0]) : 20000;
+    int nq = argc > 1 ? atoi(argv[1]) : 20000;
+    int tmax = argc > 2 ? atoi(argv[2]) : batch_default_threads();
+    if(n<2 || n>MAXV || nq<1){ fprintf(stderr, "V must be in 2..%d, Q >= 1\n", MAXV); return; }
+    if(tmax<1) tmax=1;
+    synth_places(n, 19u);
+    Graph g;
+    g.n = n;
+    g.cities = calloc(n, sizeof(City));
+    if(!g.cities) die("Memory error.");
+    for(int i=0;i<n;i++){ g.cities[i].lat=rg.lat[i]; g.cities[i].lon=rg.lon[i]; }
+    build_sparse_graph(&g, GRAPH_KNN_K);
+    graph_prepare_cch(&g);
+    srand(23);
+    for(int u=0;u<n;u++)
+        for(int a=g.offsets[u];a<g.offsets[u+1];a++)
+            if(g.neighbour[a]>u) set_road_sample(&g, a, 1.0 + (rand()%100)/50.0, 0);
+    apply_traffic_weights(&g);
+    set_dijkstra_mode(DIJKSTRA_CCH);
+
+    BatchJob *jobs = calloc(nq, sizeof(BatchJob));
+    BatchResult *res = calloc(nq, sizeof(BatchResult)), *ref = calloc(nq, sizeof(BatchResult));
+    if(!jobs || !res || !ref) die("Memory error.");
+    for(int i=0;i<nq;i++){
+        jobs[i].id=i; jobs[i].src=rand()%n; jobs[i].dst=rand()%n;
+        jobs[i].car=-1; jobs[i].co2_gkm=DEFAULT_CO2_GKM;
+    }
+    printf("V=%d, %d roads, %d routes (CCH)\n", n, g.m/2, nq);
+    printf("%-8s %12s %12s %10s %10s\n", "threads", "seconds", "routes/s", "speedup", "mismatch");
+    double t1=0;
+    for(int t=1;t<=tmax;t*=2){
+        double t0=now_sec();
+        batch_route(&g, jobs, t==1 ? ref : res, nq, t, NULL, NULL);
+        double dt=now_sec()-t0;
+        if(t==1) t1=dt;
+        int bad=0;
+        if(t>1)
+            for(int i=0;i<nq;i++)
+                if(strcmp(res[i].status, ref[i].status)!=0 || fabs(res[i].traffic_km-ref[i].traffic_km)>1e-9) bad++;
+        printf("%-8d %12.3f %12.0f %10.2f %10d\n", t, dt, nq/dt, t1/dt, bad);
+        if(t<tmax && t*2>tmax) t=tmax/2;
+    }
+    free(jobs); free(res); free(ref);
+    free_graph(&g);
+}
+
+static void bench_matrix(int argc, char **argv){
+    int n = argc > 0 ? atoi(argv[0]) : 20000;
+    int ns = argc > 1 ? atoi(argv[1]) : 100;
+    int nt = argc > 2 ? atoi(argv[2]) : 100;
+    if(n<2 || n>MAXV || ns<1 || nt<1){ fprintf(stderr, "V must be in 2..%d, S,T >= 1\n", MAXV); return; }
+    synth_places(n, 29u);
+    int *S=malloc(sizeof(int)*ns), *T=malloc(sizeof(int)*nt);
+    double *m=malloc(sizeof(double)*ns*nt);
+    if(!S||!T||!m) die("Memory error.");
+    srand(31);
+    for(int i=0;i<ns;i++) S[i]=rand()%n;
+    for(int j=0;j<nt;j++) T[j]=rand()%n;
+
+    /* distance router: CH buckets vs one CH query per entry */
+    build_knn_fixed(&rg, 8);
+    int ne=rg.E/2;
+    int *eu=malloc(sizeof(int)*ne), *ev=malloc(sizeof(int)*ne);
+    double *ew=malloc(sizeof(double)*ne);
+    if(!eu||!ev||!ew) die("Memory error.");
+    for(int i=0;i<ne;i++){ eu[i]=rg.to[2*i+1]; ev[i]=rg.to[2*i]; ew[i]=rg.w[2*i]; }
+    ch_build(&rg.ch, n, ne, eu, ev, ew);
+    rg.ch_ready=1;
+    free(eu); free(ev); free(ew);
+    route_query_reserve(&rq, n);
+    printf("V=%d, %d x %d matrix\n", n, ns, nt);
+    printf("%-22s %12s %14s %10s\n", "", "seconds", "settled", "mismatch");
+    double t0=now_sec();
+    route_matrix(&rg, &rq, S, ns, T, nt, m);
+    double tm=now_sec()-t0;
+    long sm=rq.best_settled, sp=0;
+    int bad=0;
+    t0=now_sec();
+    for(int i=0;i<ns;i++)
+        for(int j=0;j<nt;j++){
+            double c=ch_query(&rg.ch, &rq.ch_ws, S[i], T[j], NULL, NULL, 0);
+            sp+=rq.ch_ws.settled;
+            if(c>=CH_INF/2) c=INF;
+            if(fabs(c-m[i*nt+j]) > 1e-9*(c+1)) bad++;
+        }
+    double tp=now_sec()-t0;
+    printf("%-22s %12.3f %14ld %10s\n", "distance: buckets", tm, sm, "");
+    printf("%-22s %12.3f %14ld %10d\n", "distance: CH queries", tp, sp, bad);
+
+    /* CO2 router: CCH buckets vs one CCH query per entry */
+    Graph g;
+    g.n = n;
+    g.cities = calloc(n, sizeof(City));
+    if(!g.cities) die("Memory error.");
+    for(int i=0;i<n;i++){ g.cities[i].lat=rg.lat[i]; g.cities[i].lon=rg.lon[i]; }
+    build_sparse_graph(&g, GRAPH_KNN_K);
+    graph_prepare_cch(&g);
+    for(int u=0;u<n;u++)
+        for(int a=g.offsets[u];a<g.offsets[u+1];a++)
+            if(g.neighbour[a]>u) set_road_sample(&g, a, 1.0 + (rand()%100)/50.0, 0);
+    apply_traffic_weights(&g);
+    QueryWorkspace ws;
+    memset(&ws, 0, sizeof(ws));
+    t0=now_sec();
+    graph_matrix(&g, &ws, S, ns, T, nt, m);
+    tm=now_sec()-t0;
+    sm=ws.stats.settled; sp=0; bad=0;
+    static int path[MAX_PATH_NODES];
+    set_dijkstra_mode(DIJKSTRA_CCH);
+    t0=now_sec();
+    for(int i=0;i<ns;i++)
+        for(int j=0;j<nt;j++){
+            int len=0;
+            double c=INF;
+            if(!dijkstra_ws(&g, &ws, S[i], T[j], path, &len, &c)) c=INF;
+            sp+=ws.stats.settled;
+            if(fabs(c-m[i*nt+j]) > 1e-9*(c+1)) bad++;
+        }
+    tp=now_sec()-t0;
+    printf("%-22s %12.3f %14ld %10s\n", "CO2: buckets", tm, sm, "");
+    printf("%-22s %12.3f %14ld %10d\n", "CO2: CCH queries", tp, sp, bad);
+    qws_free(&ws);
+    free_graph(&g);
+    free(S); free(T); free(m);
+}
+
+static void bench_ksp(int argc, char **argv){
+    int n = argc > 0 ? atoi(argv[0]) : 20000;
+    int nq = argc > 1 ? atoi(argv[1]) : 100;
+    int K = argc > 2 ? atoi(argv[2]) : 10;
+    if(n<2 || n>MAXV || K<1){ fprintf(stderr, "V must be in 2..%d, K >= 1\n", MAXV); return; }
+    synth_places(n, 37u);
+    build_knn_fixed(&rg, 8);
+    route_query_reserve(&rq, n);
+    rq.use_ch=0;
+    PathSet ps;
+    memset(&ps, 0, sizeof(ps));
+    long found=0, settled=0;
+    int bad=0;
+    double t_all=0;
+    srand(41);
+    for(int i=0;i<nq;i++){
+        int s=rand()%n, t=rand()%n;
+        double t0=now_sec();
+        int f=ksp_paths(&rg, &rq, s, t, K, &ps);
+        t_all+=now_sec()-t0;
+        found+=f; settled+=rq.settled_cnt;
+        for(int r=1;r<f;r++) if(ps.cost[r] < ps.cost[r-1]-1e-9) bad++;
+    }
+    printf("V=%d, K=%d: %.2f ms per query, %.1f routes found, %.0f settled (tree + spurs)\n",
+           n, K, t_all*1e3/nq, (double)found/nq, (double)settled/nq);
+    printf("out-of-order routes: %d\n", bad);
+    pathset_free(&ps);
+}
+
+static void bench_alt(int argc, char **argv){
+    int n = argc > 0 ? atoi(argv[0]) : 20000;
+    int nq = argc > 1 ? atoi(argv[1]) : 200;
+    if(n<2 || n>MAXV){ fprintf(stderr, "V must be in 2..%d\n", MAXV); return; }
+    synth_places(n, 43u);
+    Graph g;
+    g.n = n;
+    g.cities = calloc(n, sizeof(City));
+    if(!g.cities) die("Memory error.");
+    for(int i=0;i<n;i++){ g.cities[i].lat=rg.lat[i]; g.cities[i].lon=rg.lon[i]; }
+    build_sparse_graph(&g, GRAPH_KNN_K);
+    srand(47);
+    for(int u=0;u<n;u++)
+        for(int a=g.offsets[u];a<g.offsets[u+1];a++)
+            if(g.neighbour[a]>u) set_road_sample(&g, a, 1.0 + (rand()%100)/50.0, 0);
+    apply_traffic_weights(&g);
+    set_dijkstra_mode(DIJKSTRA_HEAP);
+
+    static int path[MAX_PATH_NODES];
+    AltRoute alts[ALT_MAX_ROUTES];
+    QueryWorkspace ws;
+    memset(&ws, 0, sizeof(ws));
+    double t_dj=0, t_alt=0;
+    long s_dj=0, s_alt=0, n_alt=0;
+    int bad=0;
+    char *seen=calloc(n, 1);
+    if(!seen) die("Memory error.");
+    for(int q=0;q<nq;q++){
+        int s=rand()%n, t=rand()%n, len=0;
+        double c=0;
+        double t0=now_sec();
+        int ok=dijkstra_ws(&g, &ws, s, t, path, &len, &c);
+        t_dj+=now_sec()-t0; s_dj+=ws.stats.settled;
+        t0=now_sec();
+        int k=alternative_routes(&g, &ws, s, t, ALT_MAX_ROUTES, alts);
+        t_alt+=now_sec()-t0; s_alt+=ws.stats.settled;
+        if(!ok){ if(k) bad++; continue; }
+        if(k<1 || fabs(alts[0].traffic_km-c) > 1e-9*(c+1)) bad++;
+        n_alt+=k-1;
+        for(int r=0;r<k;r++){
+            double walk=0;
+            int simple=alts[r].nodes[0]==s && alts[r].nodes[alts[r].len-1]==t;
+            for(int i=0;i<alts[r].len;i++){ if(seen[alts[r].nodes[i]]++) simple=0; }
+            for(int i=0;i<alts[r].len;i++) seen[alts[r].nodes[i]]=0;
+            for(int i=0;i+1<alts[r].len;i++) walk+=g.traffic_km[graph_find_arc(&g,alts[r].nodes[i],alts[r].nodes[i+1])];
+            if(!simple || fabs(walk-alts[r].traffic_km) > 1e-9*(walk+1) ||
+               alts[r].traffic_km > c*(1+ALT_STRETCH)+1e-9 || alts[r].shared > ALT_MAX_SHARE) bad++;
+        }
+        alt_routes_free(alts, k);
+    }
+    printf("V=%d, %d queries\n", n, nq);
+    printf("%-22s %14s %14s\n", "", "avg settled", "avg us");
+    printf("%-22s %14.1f %14.1f\n", "Dijkstra (one route)", (double)s_dj/nq, t_dj*1e6/nq);
+    printf("%-22s %14.1f %14.1f\n", "plateau alternatives", (double)s_alt/nq, t_alt*1e6/nq);
+    printf("alternatives per query: %.2f, time ratio %.2fx, invalid routes: %d\n",
+           (double)n_alt/nq, t_alt/t_dj, bad);
+    free(seen);
+    qws_free(&ws);
+    free_graph(&g);
+}
+
+/* Pareto front quality: for each route of the exact front, the least
+   factor by which some route of r exceeds it on its worst criterion;
+   returns the largest such factor minus 1 */
+static double pareto_gap(const ParetoRoute *exact, int ne, const ParetoRoute *r, int nr){
+    double worst = 0;
+    for(int i=0;i<ne;i++){
+        double best = INF;
+        for(int j=0;j<nr;j++){
+            double f = fmax(r[j].traffic_km/exact[i].traffic_km, fmax(r[j].car_min/exact[i].car_min, r[j].km/exact[i].km));
+            if(f < best) best = f;
+        }
+        if(best - 1 > worst) worst = best - 1;
+    }
+    return worst;
+}
+
+/* Random factors (as in bench_alt) make long fronts: the exact front
+   grows quickly with V, hence the small default graph */
+static void bench_pareto(int argc, char **argv){
+    int n = argc > 0 ? atoi(argv[0]) : 3000;
+    int nq = argc > 1 ? atoi(argv[1]) : 10;
+    int cap = argc > 2 ? atoi(argv[2]) : PARETO_MAX_LABELS;
+    if(n<2 || n>MAXV || nq<1 || cap<1){ fprintf(stderr, "V must be in 2..%d, Q and L >= 1\n", MAXV); return; }
+    synth_places(n, 43u);
+    Graph g;
+    g.n = n;
+    g.cities = calloc(n, sizeof(City));
+    if(!g.cities) die("Memory error.");
+    for(int i=0;i<n;i++){ g.cities[i].lat=rg.lat[i]; g.cities[i].lon=rg.lon[i]; }
+    build_sparse_graph(&g, GRAPH_KNN_K);
+    srand(47);
+    for(int u=0;u<n;u++)
+        for(int a=g.offsets[u];a<g.offsets[u+1];a++)
+            if(g.neighbour[a]>u) set_road_sample(&g, a, 1.0 + (rand()%100)/50.0, 0);
+    apply_traffic_weights(&g);
+    set_dijkstra_mode(DIJKSTRA_HEAP);
+
+    enum { NCFG = 4, MAXR = 4096 };
+    static const double eps[NCFG] = { 0.0, 0.0, 0.01, 0.05 };
+    int lim[NCFG] = { 1<<30, cap, cap, cap };
+    static ParetoRoute exact[MAXR], r[MAXR];
+    static int path[MAX_PATH_NODES];
+    QueryWorkspace ws;
+    memset(&ws, 0, sizeof(ws));
+    double t[NCFG] = {0}, gap[NCFG] = {0}, t_dj = 0;
+    long settled[NCFG] = {0}, front[NCFG] = {0};
+    int bad = 0, done = 0;
+    for(int q=0;q<nq;q++){
+        int s=rand()%n, d=rand()%n, len=0, ne=0;
+        if(s==d) continue;
+        double c=0, t0=now_sec();
+        if(!dijkstra_ws(&g, &ws, s, d, path, &len, &c)) continue;
+        t_dj+=now_sec()-t0;
+        done++;
+        for(int k=0;k<NCFG;k++){
+            int nf=0;
+            t0=now_sec();
+            int nr=pareto_routes(&g, &ws, s, d, eps[k], lim[k], MAXR, k ? r : exact, &nf);
+            t[k]+=now_sec()-t0;
+            settled[k]+=ws.stats.settled;
+            front[k]+=nf;
+            ParetoRoute *p = k ? r : exact;
+            if(nr<1 || nf>MAXR) bad++;
+            else if(fabs(p[0].traffic_km-c) > 1e-9*(c+1) && eps[k]==0 && lim[k]>=(1<<30)) bad++;
+            for(int i=0;i<nr;i++){   /* costs must match the roads walked */
+                double tk=0, km=0, cm=0;
+                for(int j=0;j+1<p[i].len;j++){
+                    int a=graph_find_arc(&g, p[i].nodes[j], p[i].nodes[j+1]);
+                    tk+=g.traffic_km[a]; km+=g.distance_km[a]; cm+=segment_car_min(g.distance_km[a], g.traffic_factor[a]);
+                }
+                if(p[i].nodes[0]!=s || p[i].nodes[p[i].len-1]!=d || fabs(tk-p[i].traffic_km)>1e-9*(tk+1) ||
+                   fabs(km-p[i].km)>1e-9*(km+1) || fabs(cm-p[i].car_min)>1e-9*(cm+1)) bad++;
+            }
+            if(k){ double e=pareto_gap(exact, ne, r, nr); if(e>gap[k]) gap[k]=e; pareto_routes_free(r, nr); }
+            else ne=nr;
+        }
+        pareto_routes_free(exact, ne);
+    }
+    if(!done){ fprintf(stderr, "no reachable pairs\n"); free_graph(&g); return; }
+    printf("V=%d, %d roads, %d OD pairs, CO2 single route %.1f ms\n", n, g.m/2, done, t_dj*1e3/done);
+    printf("%-22s %10s %12s %10s %12s\n", "", "ms/query", "labels", "front", "worst gap");
+    for(int k=0;k<NCFG;k++){
+        char name[32];
+        if(lim[k]>=(1<<30)) snprintf(name, sizeof(name), "exact");
+        else snprintf(name, sizeof(name), "eps %.2f, L=%d", eps[k], lim[k]);
+        printf("%-22s %10.1f %12.1f %10.1f %11.2f%%\n", name, t[k]*1e3/done, (double)settled[k]/done,
+               (double)front[k]/done, gap[k]*100);
+    }
+    printf("invalid routes: %d\n", bad);
+    qws_free(&ws);
+    free_graph(&g);
+}
+
+/* Mock flowSegmentData provider: HTTP/1.1 keep-alive, one thread per
+   connection, every response delayed by mock_latency_us to stand in for
+   the network round trip. The factor is a fixed function of the point. */
+static int mock_latency_us;
+static int mock_drift;          /* factors change with the wall clock */
+static int mock_smooth;         /* serve congestion_field() instead */
+
+/* Synthetic congestion: free flow plus Gaussian hot spots a few km wide,
+   a third of them on the campus clusters of synth_places() */
+static double congestion_field(double lat, double lon){
+    double f = 1.0;
+    unsigned x = 2654435761u;
+    for(int i=0;i<24;i++){
+        x = x*1664525u + 1013904223u;
+        double hl, ho;
+        if(i%3==0){ int c = (x>>8)%50; hl = 29.5 + (c%7)*0.2; ho = 77.5 + (c/7)*0.2; }
+        else { hl = 29.5 + ((x>>8)%1000)/1000.0*1.5; ho = 77.5 + ((x>>18)%1000)/1000.0*1.5; }
+        x = x*1664525u + 1013904223u;
+        double sigma_km = 1.0 + (x>>8)%4000/1000.0, amp = 0.5 + (x>>20)%150/100.0;
+        double d = geo_haversine_km(lat, lon, hl, ho);
+        f += amp*exp(-d*d/(2*sigma_km*sigma_km));
+    }
+    return f < 4.0 ? f : 4.0;
+}
+
+static double mock_factor(double lat, double lon){
+    if(mock_smooth) return congestion_field(lat, lon);
+    double t = mock_drift ? now_sec() : 0.0;
+    return 1.0 + fmod(fabs(lat*7919.0 + lon*104729.0) + t, 3.0);
+}
+
+static void *mock_conn(void *arg){
+    int fd = (int)(intptr_t)arg, len = 0, open = 1;
+    char buf[4096];
+    while(open){
+        char *end = NULL;
+        while(open && !(end = memmem(buf, len, "\r\n\r\n", 4))){
+            int r = len < (int)sizeof(buf) ? (int)recv(fd, buf+len, sizeof(buf)-len, 0) : 0;
+            if(r <= 0) open = 0; else len += r;
+        }
+        if(!open) break;
+        int hlen = (int)(end - buf) + 4;
+        double lat = 0, lon = 0;
+        char *pt = memmem(buf, hlen, "point=", 6);
+        if(pt) sscanf(pt+6, "%lf,%lf", &lat, &lon);
+        int close_after = memmem(buf, hlen, "Connection: close", 17) != NULL;
+        memmove(buf, buf+hlen, len-hlen);
+        len -= hlen;
+        if(mock_latency_us) usleep(mock_latency_us);
+        double f = mock_factor(lat, lon);
+        char body[256], resp[512];
+        int bl = snprintf(body, sizeof(body),
+            "{\"flowSegmentData\":{\"frc\":\"FRC2\",\"currentSpeed\":%.6f,\"freeFlowSpeed\":60,\"confidence\":1}}",
+            60.0/f);
+        int rl = snprintf(resp, sizeof(resp),
+            "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: %d\r\n%s\r\n%s",
+            bl, close_after ? "Connection: close\r\n" : "", body);
+        if(send(fd, resp, rl, MSG_NOSIGNAL) != rl || close_after) open = 0;
+    }
+    close(fd);
+    return NULL;
+}
+
+static void *mock_accept(void *arg){
+    int lfd = (int)(intptr_t)arg;
+    for(;;){
+        int c = accept(lfd, NULL, NULL);
+        if(c < 0){ if(errno == EINTR) continue; break; }
+        int one = 1;
+        setsockopt(c, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        pthread_t t;
+        if(pthread_create(&t, NULL, mock_conn, (void*)(intptr_t)c) == 0) pthread_detach(t);
+        else close(c);
+    }
+    return NULL;
+}
+
+/* Listen on 127.0.0.1:port (0 = any free port); returns the listening
+   socket and the bound port, or -1 */
+static int mock_listen(int port, int *bound){
+    int lfd = socket(AF_INET, SOCK_STREAM, 0), one = 1;
+    if(lfd < 0) return -1;
+    setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in a;
+    memset(&a, 0, sizeof(a));
+    a.sin_family = AF_INET;
+    a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    a.sin_port = htons(port);
+    socklen_t al = sizeof(a);
+    if(bind(lfd, (struct sockaddr*)&a, sizeof(a)) != 0 || listen(lfd, 256) != 0 ||
+       getsockname(lfd, (struct sockaddr*)&a, &al) != 0){ close(lfd); return -1; }
+    *bound = ntohs(a.sin_port);
+    return lfd;
+}
+
+static void bench_mockflow(int argc, char **argv){
+    int port = argc > 0 ? atoi(argv[0]) : 8080, bound;
+    mock_latency_us = (argc > 1 ? atoi(argv[1]) : 0) * 1000;
+    int lfd = mock_listen(port, &bound);
+    if(lfd < 0){ perror("mockflow"); return; }
+    printf("mock flow provider on ECO_FLOW_URL=http://127.0.0.1:%d/flow (latency %d ms)\n",
+           bound, mock_latency_us/1000);
+    fflush(stdout);
+    mock_accept((void*)(intptr_t)lfd);
+}
+
+/* Serve the mock provider from a background thread; fc is set up for it */
+static int mock_start(int lat_ms, FlowConfig *fc, char *url, int url_len){
+    mock_latency_us = lat_ms * 1000;
+    int port, lfd = mock_listen(0, &port);
+    pthread_t acc;
+    if(lfd < 0 || pthread_create(&acc, NULL, mock_accept, (void*)(intptr_t)lfd) != 0){
+        perror("mock provider"); return 0;
+    }
+    pthread_detach(acc);
+    snprintf(url, url_len, "http://127.0.0.1:%d/traffic/services/4/flowSegmentData/absolute/10/json", port);
+    memset(fc, 0, sizeof(*fc));
+    flow_parse_url(fc, url);
+    strcpy(fc->key, "bench");
+    fc->conns = FLOW_DEFAULT_CONNS;
+    fc->timeout_ms = FLOW_TIMEOUT_MS;
+    return 1;
+}
+
+static void bench_flow(int argc, char **argv){
+    int n = argc > 0 ? atoi(argv[0]) : 2000;
+    int conns = argc > 1 ? atoi(argv[1]) : 32;
+    int lat_ms = argc > 2 ? atoi(argv[2]) : 10;
+    if(n < 1) n = 1;
+    if(conns < 1) conns = 1;
+    if(conns > FLOW_MAX_CONNS) conns = FLOW_MAX_CONNS;
+    char url[128];
+    FlowConfig fc;
+    if(!mock_start(lat_ms, &fc, url, sizeof(url))) return;
+
+    double *lat = malloc(sizeof(double)*n), *lon = malloc(sizeof(double)*n), *fac = malloc(sizeof(double)*n);
+    if(!lat || !lon || !fac) die("Memory error.");
+    srand(53);
+    for(int i=0;i<n;i++){
+        lat[i] = 29.5 + (rand()%100000)/100000.0 * 1.5;
+        lon[i] = 77.5 + (rand()%100000)/100000.0 * 1.5;
+    }
+    /* the serial baselines run on a prefix and are projected to n */
+    int nb = n < 100 ? n : 100;
+    printf("%d samples, mock latency %d ms; serial baselines on the first %d\n", n, lat_ms, nb);
+    printf("%-26s %10s %12s %14s %10s\n", "", "samples", "ms/sample", "projected s", "speedup");
+
+    double t0 = now_sec();
+    int curl_ok = 0;
+    for(int i=0;i<nb;i++){
+        char cmd[512], buf[1024];
+        snprintf(cmd, sizeof(cmd), "curl -s \"%s?point=%f,%f&key=bench\"", url, lat[i], lon[i]);
+        FILE *fp = popen(cmd, "r");
+        if(!fp) continue;
+        size_t r = fread(buf, 1, sizeof(buf)-1, fp);
+        buf[r] = 0;
+        if(pclose(fp) == 0 && r > 0) curl_ok++;
+        flow_factor_from_json(buf);
+    }
+    double t_curl = (now_sec()-t0) / nb;
+    if(curl_ok) printf("%-26s %10d %12.2f %14.2f %10s\n", "popen(curl) per point", nb, t_curl*1e3, t_curl*n, "1.0x");
+    else printf("%-26s %10d %12s %14s %10s\n", "popen(curl) per point", nb, "-", "-", "(no curl)");
+
+    FlowStats st;
+    fc.conns = 1;
+    flow_sample_points(&fc, lat, lon, nb, fac, &st);
+    double t_ka = st.seconds / nb;
+    char sp[32] = "-";
+    if(curl_ok) snprintf(sp, sizeof(sp), "%.1fx", t_curl/t_ka);
+    printf("%-26s %10d %12.2f %14.2f %10s\n", "keep-alive, 1 connection", nb, t_ka*1e3, t_ka*n, sp);
+
+    fc.conns = conns;
+    flow_sample_points(&fc, lat, lon, n, fac, &st);
+    double t_pool = st.seconds / n;
+    char label[40];
+    snprintf(label, sizeof(label), "keep-alive, %d connections", conns);
+    if(curl_ok) snprintf(sp, sizeof(sp), "%.1fx", t_curl/t_pool);
+    printf("%-26s %10d %12.3f %14.2f %10s\n", label, n, t_pool*1e3, st.seconds, sp);
+
+    int bad = 0;
+    for(int i=0;i<n;i++){
+        char q[64];
+        double la, lo;
+        snprintf(q, sizeof(q), "%f,%f", lat[i], lon[i]);
+        sscanf(q, "%lf,%lf", &la, &lo);
+        double want = mock_factor(la, lo);
+        if(want > 4.0) want = 4.0;
+        if(fabs(fac[i]-want) > 1e-4) bad++;
+    }
+    printf("connections opened: %d, failed requests: %d, wrong factors: %d\n", st.connects, st.failures, bad);
+    free(lat); free(lon); free(fac);
+}
+
+/* Provider calls for one full refresh (every group sampled) on the CO2
+   graph, per grid resolution; "max offset" is the farthest a road midpoint
+   lies from the point sampled for it */
+static void bench_cells(int argc, char **argv){
+    int sizes_default[] = {1000, 5000, 20000};
+    double cells[] = {0, 100, 250, 500, 1000};
+    int nsz = argc > 0 ? argc : 3;
+    for(int k=0;k<nsz;k++){
+        int n = argc > 0 ? atoi(argv[k]) : sizes_default[k];
+        if(n<2 || n>MAXV){ fprintf(stderr, "V must be in 2..%d\n", MAXV); continue; }
+        synth_places(n, 59u);
+        Graph g;
+        memset(&g, 0, sizeof(g));
+        g.n = n;
+        g.cities = calloc(n, sizeof(City));
+        if(!g.cities) die("Memory error.");
+        for(int i=0;i<n;i++){ g.cities[i].lat=rg.lat[i]; g.cities[i].lon=rg.lon[i]; }
+        build_sparse_graph(&g, GRAPH_KNN_K);
+        printf("V=%d, %d roads\n", n, g.m/2);
+        printf("%10s %12s %12s %14s %10s\n", "cell (m)", "calls", "roads/call", "max offset m", "group ms");
+        for(int c=0;c<(int)(sizeof(cells)/sizeof(cells[0]));c++){
+            SampleRoad *roads = NULL;
+            double t0 = now_sec();
+            int nr = sample_roads_by_cell(&g, cells[c], &roads);
+            double t = now_sec()-t0;
+            if(nr < 0) die("Memory error.");
+            int calls = 0;
+            double worst = 0;
+            for(int r=0;r<nr;r++){
+                if(r==0 || roads[r].key != roads[r-1].key) calls++;
+                int a = roads[r].arc, u = g.neighbour[g.reverse_arc[a]], v = g.neighbour[a];
+                double mlat = (g.cities[u].lat + g.cities[v].lat) / 2.0;
+                double mlon = (g.cities[u].lon + g.cities[v].lon) / 2.0;
+                double d = haversine_km(mlat, mlon, roads[r].lat, roads[r].lon) * 1000.0;
+                if(d > worst) worst = d;
+            }
+            char label[16];
+            snprintf(label, sizeof(label), cells[c] > 0 ? "%.0f" : "off", cells[c]);
+            printf("%10s %12d %12.2f %14.1f %10.2f\n", label, calls, (double)nr/calls, worst, t*1e3);
+            free(roads);
+        }
+        free_graph(&g);
+    }
+}
+
+/* After a full sample at one time, a share P of the roads is congested and
+   resampled later; the sparse binary cache lists only those. Text lists
+   every road whatever the congestion. */
+static void bench_tcache(int argc, char **argv){
+    int n = argc > 0 ? atoi(argv[0]) : 172000;
+    if(n<2 || n>MAXV){ fprintf(stderr, "V must be in 2..%d\n", MAXV); return; }
+    synth_places(n, 61u);
+    Graph g;
+    memset(&g, 0, sizeof(g));
+    g.n = n;
+    g.cities = calloc(n, sizeof(City));
+    if(!g.cities) die("Memory error.");
+    for(int i=0;i<n;i++){ g.cities[i].lat=rg.lat[i]; g.cities[i].lon=rg.lon[i]; }
+    build_sparse_graph(&g, GRAPH_KNN_K);
+    double *want = malloc(sizeof(double)*g.m);
+    unsigned *want_t = malloc(sizeof(unsigned)*g.m);
+    if(!want || !want_t) die("Memory error.");
+    const char *bin = "bench_traffic.bin", *txt = "bench_traffic.txt";
+    static const int pct[] = { 0, 1, 10, 100 };
+    long long oldest = 0;
+    struct stat sb;
+    unsigned t_now = (unsigned)time(NULL);
+    int ok = 1, bad = 0;
+    printf("V=%d, %d roads\n", n, g.m/2);
+    printf("%-16s %10s %10s %12s\n", "", "save ms", "load ms", "file MB");
+    for(int p=0;p<(int)(sizeof(pct)/sizeof(pct[0]));p++){
+        srand(67);
+        for(int u=0;u<n;u++)
+            for(int a=g.offsets[u];a<g.offsets[u+1];a++){
+                if(g.neighbour[a]<u) continue;
+                if(rand()%100 < pct[p]) set_road_sample(&g, a, 1.0 + (1+rand()%300)/100.0, t_now - rand()%600);
+                else set_road_sample(&g, a, 1.0, t_now - 900);
+            }
+        memcpy(want, g.traffic_factor, sizeof(double)*g.m);
+        memcpy(want_t, g.sampled_at, sizeof(unsigned)*g.m);
+        double t0=now_sec();
+        ok = ok && save_traffic_cache(&g, bin);
+        double ts=now_sec()-t0;
+        clear_traffic(&g);
+        t0=now_sec();
+        ok = ok && load_traffic_cache(&g, bin, &oldest);
+        double tl=now_sec()-t0;
+        for(int a=0;a<g.m;a++)
+            if(fabs(g.traffic_factor[a]-want[a]) > 1e-6 || g.sampled_at[a]!=want_t[a]) bad++;
+        stat(bin, &sb);
+        char name[32];
+        snprintf(name, sizeof(name), "binary, %d%% busy", pct[p]);
+        printf("%-16s %10.1f %10.1f %12.2f\n", name, ts*1e3, tl*1e3, sb.st_size/1048576.0);
+    }
+
+    double t0=now_sec();
+    ok = ok && export_traffic_text(&g, txt);
+    double ts=now_sec()-t0;
+    clear_traffic(&g);
+    t0=now_sec();
+    ok = ok && is_cache_fresh(txt, 15) && import_traffic_text(&g, txt);
+    double tl=now_sec()-t0;
+    stat(txt, &sb);
+    printf("%-16s %10.1f %10.1f %12.2f\n", "text", ts*1e3, tl*1e3, sb.st_size/1048576.0);
+    printf("binary round trip mismatches: %d%s\n", bad, ok ? "" : " (I/O failed)");
+    remove(bin); remove(txt);
+    free(want); free(want_t);
+    free_graph(&g);
+}
+
+/* One simulated minute per round: refresh, then route Q queries (80% of
+   endpoints from a hot 5% of places) and note their paths. "fresh" is the
+   share of routed road-km sampled within the TTL. Every grid cell is a
+   sample point, and routes use free-flow weights, so demand does not shift
+   with the (mock) factors a policy happens to fetch. */
+static void bench_refresh(int argc, char **argv){
+    int n = argc > 0 ? atoi(argv[0]) : 10000;
+    int rounds = argc > 1 ? atoi(argv[1]) : 45;
+    int budget = argc > 2 ? atoi(argv[2]) : TRAFFIC_REFRESH_BUDGET;
+    int nq = 50, ttl = CACHE_TTL_MINUTES_DEFAULT * 60;
+    if(n<2 || n>MAXV){ fprintf(stderr, "V must be in 2..%d\n", MAXV); return; }
+    char url[128];
+    FlowConfig fc;
+    if(!mock_start(0, &fc, url, sizeof(url))) return;
+    synth_places(n, 71u);
+    Graph g;
+    memset(&g, 0, sizeof(g));
+    g.n = n;
+    g.cities = calloc(n, sizeof(City));
+    if(!g.cities) die("Memory error.");
+    for(int i=0;i<n;i++){ g.cities[i].lat=rg.lat[i]; g.cities[i].lon=rg.lon[i]; }
+    build_sparse_graph(&g, GRAPH_KNN_K);
+    set_dijkstra_mode(DIJKSTRA_ASTAR);
+    static int path[MAX_PATH_NODES];
+    int hot = n/20 > 0 ? n/20 : 1;
+    printf("V=%d, %d roads, %d rounds of %d queries, TTL %d min, budget %d/min\n",
+           n, g.m/2, rounds, nq, ttl/60, budget);
+    printf("%-22s %12s %12s %12s %10s\n", "", "requests", "max/round", "fresh km %", "points");
+    clear_traffic(&g);
+    apply_traffic_weights(&g);
+    for(int policy=0; policy<2; policy++){
+        clear_traffic(&g);
+        memset(g.road_hits, 0, sizeof(unsigned)*g.m);
+        srand(73);
+        long long t = 1700000000LL, last_full = -1;
+        long requests = 0;
+        int worst = 0, points = 0;
+        double km_all = 0, km_fresh = 0;
+        for(int r=0;r<rounds;r++, t+=60){
+            TrafficRefreshStats rs;
+            memset(&rs, 0, sizeof(rs));
+            if(policy == 0) traffic_refresh(&g, &fc, 1, t, ttl, budget, &rs);
+            else if(last_full < 0 || t - last_full >= ttl){
+                traffic_refresh(&g, &fc, 1, t, -1, 0, &rs);
+                last_full = t;
+            }
+            requests += rs.fetched;
+            if(rs.fetched > worst) worst = rs.fetched;
+            if(rs.points) points = rs.points;
+            for(int q=0;q<nq;q++){
+                int s = rand()%5 ? rand()%hot : rand()%n, d = rand()%5 ? rand()%hot : rand()%n, len = 0;
+                double c = 0;
+                if(!dijkstra(&g, s, d, path, &len, &c)) continue;
+                traffic_note_path(&g, path, len);
+                for(int i=0;i+1<len;i++){
+                    int a = graph_find_arc(&g, path[i], path[i+1]);
+                    km_all += g.distance_km[a];
+                    if(g.sampled_at[a] && t - (long long)g.sampled_at[a] <= ttl) km_fresh += g.distance_km[a];
+                }
+            }
+        }
+        printf("%-22s %12ld %12d %12.1f %10d\n", policy == 0 ? "incremental, budgeted" : "full resample on TTL",
+               requests, worst, km_all > 0 ? 100.0*km_fresh/km_all : 0.0, points);
+    }
+    free_graph(&g);
+}
+
+/* Full sample of every Nth cell from a mock serving congestion_field(),
+   which refresh fills in by interpolation. Error is the km-weighted mean
+   |factor - field at the road midpoint| over all roads, and over the
+   congested ones ("busy"), with unmeasured roads left at free flow
+   ("none") or estimated ("IDW"). "local ms" is the refresh time outside
+   the provider calls. */
+static void bench_idw(int argc, char **argv){
+    int n = argc > 0 ? atoi(argv[0]) : 20000;
+    if(n<2 || n>MAXV){ fprintf(stderr, "V must be in 2..%d\n", MAXV); return; }
+    static const int def_every[] = { 1, 2, 3, 5, 10, 20 };
+    int ne = argc > 1 ? argc - 1 : (int)(sizeof(def_every)/sizeof(def_every[0]));
+    char url[128];
+    FlowConfig fc;
+    mock_smooth = 1;
+    if(!mock_start(0, &fc, url, sizeof(url))) return;
+    synth_places(n, 89u);
+    Graph g;
+    memset(&g, 0, sizeof(g));
+    g.n = n;
+    g.cities = calloc(n, sizeof(City));
+    if(!g.cities) die("Memory error.");
+    for(int i=0;i<n;i++){ g.cities[i].lat=rg.lat[i]; g.cities[i].lon=rg.lon[i]; }
+    build_sparse_graph(&g, GRAPH_KNN_K);
+    double *truth = malloc(sizeof(double)*g.m);
+    if(!truth) die("Memory error.");
+    double km = 0, km_busy = 0;
+    for(int u=0;u<n;u++)
+        for(int a=g.offsets[u];a<g.offsets[u+1];a++){
+            int v = g.neighbour[a];
+            truth[a] = congestion_field((g.cities[u].lat+g.cities[v].lat)/2, (g.cities[u].lon+g.cities[v].lon)/2);
+            km += g.distance_km[a];
+            if(truth[a] > 1.1) km_busy += g.distance_km[a];
+        }
+    printf("V=%d, %d roads, %.0f%% of road-km congested (>1.1), cells %.0f m\n",
+           n, g.m/2, 100.0*km_busy/km, sample_cell_m());
+    printf("%-6s %10s %10s %10s %10s %10s %10s\n", "every", "calls", "err none", "err IDW",
+           "busy none", "busy IDW", "local ms");
+    for(int e=0;e<ne;e++){
+        int every = argc > 1 ? atoi(argv[1+e]) : def_every[e];
+        if(every < 1) continue;
+        clear_traffic(&g);
+        TrafficRefreshStats rs;
+        double t0 = now_sec();
+        traffic_refresh(&g, &fc, every, (long long)time(NULL), -1, 0, &rs);
+        double secs = now_sec() - t0 - rs.seconds;
+        double err_none = 0, err_idw = 0, busy_none = 0, busy_idw = 0;
+        for(int a=0;a<g.m;a++){
+            double f = g.sampled_at[a] ? g.traffic_factor[a] : 1.0;
+            double en = fabs(f - truth[a]) * g.distance_km[a], ei = fabs(g.traffic_factor[a] - truth[a]) * g.distance_km[a];
+            err_none += en; err_idw += ei;
+            if(truth[a] > 1.1){ busy_none += en; busy_idw += ei; }
+        }
+        if(km_busy <= 0) km_busy = 1;
+        printf("%-6d %10d %10.4f %10.4f %10.4f %10.4f %10.1f\n", every, rs.fetched, err_none/km, err_idw/km,
+               busy_none/km_busy, busy_idw/km_busy, secs*1e3);
+    }
+    mock_smooth = 0;
+    free(truth);
+    free_graph(&g);
+}
+
+/* Rush-hour shape of the synthetic day: peaks at 08:30 and 18:00 */
+static double rush_shape(double t_day){
+    double m = (t_day - 8.5*3600)/3600, e = (t_day - 18.0*3600)/3600;
+    return 0.1 + 0.9*exp(-m*m/2) + exp(-e*e/2);
+}
+
+/* Graph over n synthetic places with profiles learned from a simulated
+   week of refreshes every 15 minutes, each road's true factor at time t
+   being 1 + (field - 1) * rush_shape(t) with field = congestion_field() at
+   its midpoint (returned in *field, m entries). Returns the learning time. */
+static double td_graph(Graph *g, int n, unsigned seed, double **field){
+    synth_places(n, seed);
+    memset(g, 0, sizeof(*g));
+    g->n = n;
+    g->cities = calloc(n, sizeof(City));
+    if(!g->cities) die("Memory error.");
+    for(int i=0;i<n;i++){ g->cities[i].lat=rg.lat[i]; g->cities[i].lon=rg.lon[i]; }
+    build_sparse_graph(g, GRAPH_KNN_K);
+    double t0 = now_sec();
+    if(!(g->profile = traffic_profile_new(g))) die("Memory error.");
+    double *f = malloc(sizeof(double)*g->m);
+    if(!f) die("Memory error.");
+    for(int u=0;u<n;u++)
+        for(int a=g->offsets[u];a<g->offsets[u+1];a++){
+            int v = g->neighbour[a];
+            f[a] = congestion_field((g->cities[u].lat+g->cities[v].lat)/2, (g->cities[u].lon+g->cities[v].lon)/2);
+        }
+    srand(101);
+    for(int day=0;day<7;day++)
+        for(int b=0;b<PROFILE_BUCKETS;b++){
+            double shape = rush_shape((b + 0.5)*PROFILE_BUCKET_S);
+            for(int u=0;u<n;u++)
+                for(int a=g->offsets[u];a<g->offsets[u+1];a++)
+                    if(g->neighbour[a]>u)
+                        profile_observe(g->profile, a, 1.0 + (f[a]-1.0)*shape*(0.9 + (rand()%21)/100.0), b);
+        }
+    for(int a=0;a<g->m;a++) g->traffic_factor[a] = 1.0 + (f[a]-1.0)*rush_shape(3*3600);
+    apply_traffic_weights(g);
+    *field = f;
+    return now_sec() - t0;
+}
+
+/* Profiles as in td_graph().
+   Static routes use the live factors of a 03:00 refresh; time-dependent
+   routes read the profiles at each arrival time. Costs are compared on
+   the profiles, the metric a driver leaving then would meet. */
+static void bench_td(int argc, char **argv){
+    int n = argc > 0 ? atoi(argv[0]) : 20000;
+    int nq = argc > 1 ? atoi(argv[1]) : 200;
+    if(n<2 || n>MAXV || nq<1){ fprintf(stderr, "V must be in 2..%d, Q >= 1\n", MAXV); return; }
+    Graph g;
+    double *field;
+    double t_learn = td_graph(&g, n, 97u, &field);
+    double qerr = 0;
+    for(int a=0;a<g.m;a++)
+        for(int b=0;b<PROFILE_BUCKETS;b++){
+            double want = 1.0 + (field[a]-1.0)*rush_shape((b + 0.5)*PROFILE_BUCKET_S);
+            double got = profile_dequantize(g.profile->q[(size_t)g.profile->road[a]*PROFILE_BUCKETS + b]);
+            if(fabs(got-want) > qerr) qerr = fabs(got-want);
+        }
+    size_t bytes = (size_t)g.profile->roads*PROFILE_BUCKETS + sizeof(int)*(size_t)g.m;
+    printf("V=%d, %d roads, %d buckets: %.1f MB, %.2f bytes per road per bucket, learned 7 days in %.1f s\n",
+           n, g.m/2, PROFILE_BUCKETS, bytes/1048576.0, (double)bytes/((double)g.profile->roads*PROFILE_BUCKETS), t_learn);
+    printf("max |profile - true factor| at bucket centres: %.3f (noise +/-10%%)\n", qerr);
+    set_dijkstra_mode(DIJKSTRA_ASTAR);
+    static int path[MAX_PATH_NODES];
+    QueryWorkspace ws;
+    memset(&ws, 0, sizeof(ws));
+    static const int departs[] = { 3*3600, 8*3600, 17*3600 + 30*60 };
+    printf("%-8s %12s %12s %10s %12s %12s %10s\n", "depart", "static km*f", "td km*f", "saved %",
+           "static us", "td us", "mismatch");
+    for(int d=0;d<3;d++){
+        srand(103);
+        double c_static = 0, c_td = 0, us_static = 0, us_td = 0, worst = 0;
+        for(int q=0;q<nq;q++){
+            int s = rand()%n, e = rand()%n, len = 0;
+            double c = 0, km, car_min;
+            double q0 = now_sec();
+            if(!dijkstra_ws(&g, &ws, s, e, path, &len, &c)) continue;
+            us_static += (now_sec() - q0)*1e6;
+            route_totals_td(&g, path, len, departs[d], &km, &car_min);
+            c_static += car_min * CAR_FREEFLOW_KMPH / 60.0;
+            q0 = now_sec();
+            if(!dijkstra_td(&g, &ws, s, e, departs[d], path, &len, &c)) continue;
+            us_td += (now_sec() - q0)*1e6;
+            c_td += c;
+            route_totals_td(&g, path, len, departs[d], &km, &car_min);
+            if(fabs(car_min * CAR_FREEFLOW_KMPH / 60.0 - c) > worst) worst = fabs(car_min * CAR_FREEFLOW_KMPH / 60.0 - c);
+        }
+        printf("%02d:%02d    %12.1f %12.1f %10.2f %12.0f %12.0f %10.1e\n", departs[d]/3600, departs[d]/60%60,
+               c_static, c_td, c_static > 0 ? 100.0*(c_static - c_td)/c_static : 0.0, us_static/nq, us_td/nq, worst);
+    }
+    qws_free(&ws);
+    free(field);
+    free_graph(&g);
+}
+
+/* Best departure in a W-minute window from 07:00 (rush peak at 08:30):
+   one profile search vs dijkstra_td() once per minute. "gap" is the
+   largest |curve - per-minute cost| over the minutes, "best" compares the
+   profile optimum with the best of the minutes. */
+static void bench_profile(int argc, char **argv){
+    int n = argc > 0 ? atoi(argv[0]) : 20000;
+    int nq = argc > 1 ? atoi(argv[1]) : 50;
+    int win = argc > 2 ? atoi(argv[2]) : 180;
+    if(n<2 || n>MAXV || nq<1 || win<1){ fprintf(stderr, "V must be in 2..%d, Q >= 1, W >= 1\n", MAXV); return; }
+    Graph g;
+    double *field;
+    td_graph(&g, n, 107u, &field);
+    static int path[MAX_PATH_NODES];
+    QueryWorkspace ws;
+    memset(&ws, 0, sizeof(ws));
+    double t0 = 7*3600, t1 = t0 + win*60.0;
+    double ms_prof = 0, ms_min = 0, gap = 0, best_diff = 0, saved = 0;
+    long points = 0, settled = 0;
+    int done = 0;
+    srand(109);
+    for(int q=0;q<nq;q++){
+        int s = rand()%n, e = rand()%n, len = 0;
+        PwlFn curve;
+        double bt, bc, c, q0 = now_sec();
+        if(!profile_search(&g, &ws, s, e, t0, t1, &curve, &bt, &bc)) continue;
+        ms_prof += (now_sec() - q0)*1e3;
+        settled += ws.stats.settled;
+        points += curve.n;
+        double best_min = INF;
+        q0 = now_sec();
+        for(int m=0;m<=win;m++){
+            if(!dijkstra_td(&g, &ws, s, e, t0 + m*60.0, path, &len, &c)) continue;
+            double d = fabs(pwl_eval(&curve, t0 + m*60.0) - c);
+            if(d > gap) gap = d;
+            if(c < best_min) best_min = c;
+        }
+        ms_min += (now_sec() - q0)*1e3;
+        if(fabs(best_min - bc) > best_diff) best_diff = fabs(best_min - bc);
+        saved += pwl_eval(&curve, t0) > 0 ? 1.0 - bc/pwl_eval(&curve, t0) : 0.0;
+        done++;
+        pwl_free(&curve);
+    }
+    if(!done){ printf("no routable pairs\n"); return; }
+    printf("V=%d, %d roads, %d OD pairs, window 07:00 + %d min\n", n, g.m/2, done, win);
+    printf("profile search: %.1f ms/query, %ld labels settled, %.0f breakpoints per curve\n",
+           ms_prof/done, settled/done, (double)points/done);
+    printf("per-minute td:  %.1f ms/query (%d searches)\n", ms_min/done, win+1);
+    printf("max |curve - td| %.2e km, max |best - best minute| %.2e km, best departure saves %.1f%% vs 07:00\n",
+           gap, best_diff, 100.0*saved/done);
+    qws_free(&ws);
+    free(field);
+    free_graph(&g);
+}
+
+static int cmp_double(const void *a, const void *b){
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+/* Query latency percentiles, sorting lat[] */
+static void rcu_report(const char *name, double *lat, int n, int refreshes, int bad){
+    qsort(lat, n, sizeof(double), cmp_double);
+    printf("%-22s %10.3f %10.3f %10.3f %10d %10d\n", name, lat[n/2]*1e3, lat[(int)(n*0.99)]*1e3,
+           lat[n-1]*1e3, refreshes, bad);
+}
+
+/* Route Q random queries on the main thread while traffic is refreshed
+   from a drifting mock provider: first inline (the query that falls due
+   waits for the refresh and customization), then with the background
+   refresher swapping weight sets underneath the queries. "bad" counts
+   routes whose cost differs from their path summed on the pinned set's
+   weights, i.e. a query that saw a half-published metric. */
+static void bench_rcu(int argc, char **argv){
+    int n = argc > 0 ? atoi(argv[0]) : 20000;
+    int nq = argc > 1 ? atoi(argv[1]) : 10000;
+    int lat_ms = argc > 2 ? atoi(argv[2]) : 20;
+    if(n<2 || n>MAXV || nq<1){ fprintf(stderr, "V must be in 2..%d, Q >= 1\n", MAXV); return; }
+    char url[128], dir[] = "/tmp/bench_rcuXXXXXX";
+    FlowConfig fc;
+    mock_drift = 1;
+    if(!mock_start(lat_ms, &fc, url, sizeof(url))) return;
+    if(!mkdtemp(dir) || chdir(dir) != 0){ perror("bench rcu"); return; }   /* refresher writes its cache here */
+    setenv("ECO_FLOW_URL", url, 1);
+    setenv("ECO_FLOW_KEY", "bench", 1);
+    synth_places(n, 79u);
+    Graph g;
+    memset(&g, 0, sizeof(g));
+    g.n = n;
+    g.cities = calloc(n, sizeof(City));
+    if(!g.cities) die("Memory error.");
+    for(int i=0;i<n;i++){ g.cities[i].lat=rg.lat[i]; g.cities[i].lon=rg.lon[i]; }
+    build_sparse_graph(&g, GRAPH_KNN_K);
+    set_dijkstra_mode(DIJKSTRA_CCH);
+    graph_prepare_cch(&g);
+    clear_traffic(&g);
+    apply_traffic_weights(&g);
+    static int path[MAX_PATH_NODES];
+    double *lat = malloc(sizeof(double)*nq);
+    int *qs = malloc(sizeof(int)*nq), *qd = malloc(sizeof(int)*nq);
+    if(!lat || !qs || !qd) die("Memory error.");
+    srand(83);
+    for(int q=0;q<nq;q++){ qs[q]=rand()%n; qd[q]=rand()%n; }
+    printf("V=%d, %d roads, %d queries, provider latency %d ms, budget %d/refresh\n",
+           n, g.m/2, nq, lat_ms, traffic_refresh_budget());
+    printf("%-22s %10s %10s %10s %10s %10s\n", "", "p50 ms", "p99 ms", "max ms", "refreshes", "bad");
+
+    /* background first, to learn how many refreshes fit in the run */
+    TrafficRefresher tr;
+    if(!traffic_refresher_start(&tr, &g, SAMPLE_EVERY_N, 0, 0)){ fprintf(stderr, "refresher did not start\n"); return; }
+    int bad = 0;
+    for(int q=0;q<nq;q++){
+        double t0 = now_sec(), c = 0;
+        int len = 0;
+        Graph view;
+        TrafficSet *pin = graph_pin(&g, &view);
+        int ok = dijkstra(&view, qs[q], qd[q], path, &len, &c);
+        lat[q] = now_sec() - t0;
+        double sum = 0;
+        for(int i=0;ok && i+1<len;i++) sum += view.traffic_km[graph_find_arc(&view, path[i], path[i+1])];
+        if(ok && fabs(sum - c) > 1e-6*(1.0 + c)) bad++;
+        graph_unpin(pin);
+    }
+    int published = __atomic_load_n(&tr.published, __ATOMIC_SEQ_CST);
+    traffic_refresher_stop(&tr);
+    double *lat_bg = malloc(sizeof(double)*nq);
+    if(!lat_bg) die("Memory error.");
+    memcpy(lat_bg, lat, sizeof(double)*nq);
+
+    /* inline: the same number of refreshes, spread evenly over the queries */
+    clear_traffic(&g);
+    apply_traffic_weights(&g);
+    int every = published > 0 ? nq / published : nq + 1, inline_bad = 0, done = 0;
+    if(every < 1) every = 1;
+    for(int q=0;q<nq;q++){
+        double t0 = now_sec(), c = 0;
+        int len = 0;
+        if(q % every == 0 && done < published){
+            TrafficRefreshStats rs;
+            traffic_refresh(&g, &fc, SAMPLE_EVERY_N, (long long)time(NULL), 0, traffic_refresh_budget(), &rs);
+            apply_traffic_weights(&g);
+            done++;
+        }
+        int ok = dijkstra(&g, qs[q], qd[q], path, &len, &c);
+        lat[q] = now_sec() - t0;
+        double sum = 0;
+        for(int i=0;ok && i+1<len;i++) sum += g.traffic_km[graph_find_arc(&g, path[i], path[i+1])];
+        if(ok && fabs(sum - c) > 1e-6*(1.0 + c)) inline_bad++;
+    }
+    rcu_report("inline refresh", lat, nq, done, inline_bad);
+    rcu_report("background refresher", lat_bg, nq, published, bad);
+    remove(TRAFFIC_CACHE_FILE);
+    if(chdir("/tmp") == 0) rmdir(dir);
+    free(lat); free(lat_bg); free(qs); free(qd);
+    free_graph(&g);
+}
+
+int main(int argc, char **argv){
+    if(argc<2){
+        fprintf(stderr, "usage: %s knn [V ...] | search [V] [Q] | ch [V] [Q] | cch [V] [Q] | batch [V] [Q] [T] | matrix [V] [S] [T] | ksp [V] [Q] [K] | alt [V] [Q] | flow [N] [C] [L] | mockflow [PORT] [L] | cells [V ...] | tcache [V] | refresh [V] [R] [B] | idw [V] [N ...] | td [V] [Q] | profile [V] [Q] [W] | pareto [V] [Q] [L] | rcu [V] [Q] [L]\n", argv[0]);
+        return 1;
+    }
+    if(strcmp(argv[1],"knn")==0) bench_knn(argc-2, argv+2);
+    else if(strcmp(argv[1],"search")==0) bench_search(argc-2, argv+2);
+    else if(strcmp(argv[1],"ch")==0) bench_ch(argc-2, argv+2);
+    else if(strcmp(argv[1],"cch")==0) bench_cch(argc-2, argv+2);
+    else if(strcmp(argv[1],"batch")==0) bench_batch(argc-2, argv+2);
+    else if(strcmp(argv[1],"matrix")==0) bench_matrix(argc-2, argv+2);
+    else if(strcmp(argv[1],"ksp")==0) bench_ksp(argc-2, argv+2);
+    else if(strcmp(argv[1],"alt")==0) bench_alt(argc-2, argv+2);
+    else if(strcmp(argv[1],"flow")==0) bench_flow(argc-2, argv+2);
+    else if(strcmp(argv[1],"mockflow")==0) bench_mockflow(argc-2, argv+2);
+    else if(strcmp(argv[1],"cells")==0) bench_cells(argc-2, argv+2);
+    else if(strcmp(argv[1],"tcache")==0) bench_tcache(argc-2, argv+2);
+    else if(strcmp(argv[1],"refresh")==0) bench_refresh(argc-2, argv+2);
+    else if(strcmp(argv[1],"idw")==0) bench_idw(argc-2, argv+2);
+    else if(strcmp(argv[1],"td")==0) bench_td(argc-2, argv+2);
+    else if(strcmp(argv[1],"profile")==0) bench_profile(argc-2, argv+2);
+    else if(strcmp(argv[1],"pareto")==0) bench_pareto(argc-2, argv+2);
+    else if(strcmp(argv[1],"rcu")==0) bench_rcu(argc-2, argv+2);
+    else { fprintf(stderr, "unknown benchmark '%s'\n", argv[1]); return 1; }
+    return 0;
+}
@@ -2,7 +2,12 @@
    Updated: interactive map UI; JS now receives car_co2 from C.
    Input: cities.txt (CityName,Longitude,Latitude) or --places places.txt (Name LAT LON)
    Compile:
-     gcc carbon.c -o carbon -lm -DUSE_TOMTOM
+     gcc carbon.c -o carbon -lm -lpthread -DUSE_TOMTOM -lssl -lcrypto
+   -lssl -lcrypto (OpenSSL) are for the https TomTom endpoint; without
+   USE_TOMTOM, traffic is sampled only from an http:// ECO_FLOW_URL and
+   they can be dropped (see flowclient.h). On Windows (MinGW):
+     gcc carbon.c -o carbon.exe -lm -DUSE_TOMTOM
+   samples through curl.exe instead, with no OpenSSL or pthreads.
 */
 
 #define _GNU_SOURCE
@@ -20,20 +25,40 @@
   #define F_OK 0
 #else
   #include <unistd.h>
+  #include <fcntl.h>
+  #include <sys/mman.h>
 #endif
+#include <sys/stat.h>
+
+#include "geoindex.h"
+#include "ch.h"
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
 #endif
 
 /* -------------------- Config -------------------- */
-#define MAX_CITIES 300
 #define MAX_LINE 512
+#define MAX_PATH_NODES 4096
+#define GRAPH_KNN_K 10             /* neighbours kept per place in the pruned graph */
 #define INF 1e18
 #define DEFAULT_CO2_GKM 120.0
-#define SAMPLE_EVERY_N 3           /* sample every Nth undirected edge */
-#define TRAFFIC_CACHE_FILE "traffic_cache.txt"
+#define SAMPLE_EVERY_N 3           /* sample every Nth undirected edge (grid cell when gridded) */
+#define SAMPLE_CELL_M_DEFAULT 250.0  /* sample grid cell edge in metres; ECO_FLOW_CELL_M, 0 = per road */
+#define TRAFFIC_CACHE_FILE "traffic_cache.bin"
+#define TRAFFIC_CACHE_TEXT "traffic_cache.txt"   /* legacy text format, import/export */
+#define TRAFFIC_FILE_MAGIC "ECOTRF"
+#define TRAFFIC_FILE_VERSION 3
 #define CACHE_TTL_MINUTES_DEFAULT 15  /* default cache TTL (minutes) */
+#define TRAFFIC_REFRESH_BUDGET 500 /* provider requests per refresh; ECO_FLOW_BUDGET, 0 = no limit */
+#define TRAFFIC_REFRESH_INTERVAL 60 /* seconds between background refreshes */
+#define TRAFFIC_IDW_K 6            /* sample points behind an estimated factor; 0 = no interpolation */
+#define TRAFFIC_IDW_RANGE_M 1500.0 /* a sample this far off weighs as much as free flow */
+#define TRAFFIC_PROFILE_FILE "traffic_profile.bin"
+#define TRAFFIC_PROFILE_MAGIC "ECOPRF"
+#define TRAFFIC_PROFILE_VERSION 1
+#define PROFILE_BUCKETS 96         /* time-of-day buckets per road (15 minutes) */
+#define PROFILE_SHIFT 2            /* a sample moves its bucket 1/2^SHIFT of the way */
 
 /* Mode speeds (km/h) */
 #define CAR_FREEFLOW_KMPH 50.0   /* expected free-flow car speed */
@@ -43,6 +68,8 @@
 /* -------------------- TomTom API key (embedded) -------------------- */
 #define TOMTOM_API_KEY "c4f1baac-5522-4e4d-bb86-3c6b3370f9ec"
 
+#include "flowclient.h"
+
 /* -------------------- Data structures -------------------- */
 
 typedef struct {
@@ -52,22 +79,49 @@ typedef struct {
 } City;
 
 typedef struct {
-    int v;
-    double distance_km;
-    double traffic_factor;
-    double co2_cost; /* grams */
-} Edge;
+    char name[128];
+    double co2_gkm;          /* grams CO2 per km at free flow */
+} CarModel;
+
+typedef struct TrafficRefresher TrafficRefresher;
+
+/* Typical traffic factor of each road by time of day, learned from the
+   samples of successive refreshes. One byte per road and bucket: 0 = no
+   sample yet, 1..255 = factor 1..4 in steps of 3/254. */
+typedef struct {
+    int roads;
+    int *road;               /* m: road index of each arc (both directions share it) */
+    unsigned char *q;        /* roads * PROFILE_BUCKETS */
+} TrafficProfile;
 
+/* Compressed-sparse-row graph over a pruned (k-nearest, symmetric) neighbour
+   set. Arcs of u are [offsets[u], offsets[u+1]), sorted by neighbour id. */
 typedef struct {
     int n;
-    City cities[MAX_CITIES];
-    Edge *edges; /* adjacency matrix flattened: edges[i * n + j] */
+    City *cities;            /* n entries, owned */
+    int m;                   /* directed arc count (each road appears twice) */
+    int *offsets;            /* n+1 */
+    int *neighbour;          /* m */
+    double *distance_km;     /* m */
+    double *traffic_factor;  /* m */
+    unsigned *sampled_at;    /* m: unix time the factor was sampled, 0 = never (1.0) */
+    unsigned *road_hits;     /* m: recent routes over the road, kept on its u < v arc */
+    double *traffic_km;      /* m: distance_km * traffic_factor, the search metric */
+    int *reverse_arc;        /* m: index of v->u for arc u->v */
+    double traffic_lb;       /* lower bound of traffic_km/distance_km (A* potential scale) */
+    CustomizableCH *cch;     /* optional, owned; re-customized by apply_traffic_weights */
+    TrafficRefresher *refresher; /* set while a background refresher owns the weights */
+    TrafficProfile *profile; /* optional, owned: time-of-day factors for dijkstra_td() */
 } Graph;
 
+/* Per-search node state. An entry is only valid while stamp equals the
+   owning workspace's epoch; otherwise it reads as unreached. */
 typedef struct {
     double dist;
+    double pot;              /* A* potential, -1 until computed */
     int prev;
     int visited;
+    unsigned stamp;
 } DijkNode;
 
 /* -------------------- Utilities -------------------- */
@@ -111,13 +165,26 @@ static void open_in_browser(const char *url) {
 
 /* -------------------- Loaders -------------------- */
 
-/* Load comma-format cities.txt: CityName,Longitude,Latitude */
-int load_cities_comma(const char *fn, City *cities, int *n) {
+/* Grow *cities so that index cnt is writable; returns 0 on allocation failure */
+static int reserve_city(City **cities, int *cap, int cnt) {
+    if (cnt < *cap) return 1;
+    int ncap = *cap ? *cap * 2 : 64;
+    City *p = realloc(*cities, sizeof(City) * ncap);
+    if (!p) return 0;
+    *cities = p;
+    *cap = ncap;
+    return 1;
+}
+
+/* Load comma-format cities.txt: CityName,Longitude,Latitude
+   *cities is allocated here and owned by the caller. */
+int load_cities_comma(const char *fn, City **out, int *n) {
     FILE *f = fopen(fn, "r");
     if (!f) return 0;
     char line[MAX_LINE];
-    int cnt = 0;
-    while (fgets(line, sizeof(line), f) && cnt < MAX_CITIES) {
+    int cnt = 0, cap = 0;
+    City *cities = NULL;
+    while (fgets(line, sizeof(line), f)) {
         line[strcspn(line, "\n")] = 0;
         char *comment = strchr(line, '#');
         if (comment) *comment = 0;
@@ -133,6 +200,8 @@ int load_cities_comma(const char *fn, City *cities, int *n) {
         if (!c2) continue;
         lon = atof(c1+1);
         lat = atof(c2+1);
+        if (!reserve_city(&cities, &cap, cnt)) break;
+        memset(&cities[cnt], 0, sizeof(City));
         strncpy(cities[cnt].name, name, sizeof(cities[cnt].name)-1);
         cities[cnt].lon = lon;
         cities[cnt].lat = lat;
@@ -140,16 +209,19 @@ int load_cities_comma(const char *fn, City *cities, int *n) {
     }
     fclose(f);
     *n = cnt;
+    *out = cities;
+    if (cnt == 0) { free(cities); *out = NULL; }
     return cnt > 0;
 }
 
 /* Load space-separated places file: Name LAT LON  (example uploaded file) */
-int load_places_space(const char *fn, City *cities, int *n) {
+int load_places_space(const char *fn, City **out, int *n) {
     FILE *f = fopen(fn, "r");
     if (!f) return 0;
     char line[MAX_LINE];
-    int cnt = 0;
-    while (fgets(line, sizeof(line), f) && cnt < MAX_CITIES) {
+    int cnt = 0, cap = 0;
+    City *cities = NULL;
+    while (fgets(line, sizeof(line), f)) {
         line[strcspn(line, "\n")] = 0;
         char *comment = strchr(line, '#');
         if (comment) *comment = 0;
@@ -173,6 +245,8 @@ int load_places_space(const char *fn, City *cities, int *n) {
         if (scanned == 2) {
             lat = atof(tok1);
             lon = atof(tok2);
+            if (!reserve_city(&cities, &cap, cnt)) break;
+            memset(&cities[cnt], 0, sizeof(City));
             strncpy(cities[cnt].name, name, sizeof(cities[cnt].name)-1);
             cities[cnt].lat = lat;
             cities[cnt].lon = lon;
@@ -183,11 +257,44 @@ int load_places_space(const char *fn, City *cities, int *n) {
     }
     fclose(f);
     *n = cnt;
+    *out = cities;
+    if (cnt == 0) { free(cities); *out = NULL; }
+    return cnt > 0;
+}
+
+/* Load cars.txt: Model,g_per_km. *cars is allocated here and owned by the caller. */
+int load_car_models(const char *fn, CarModel **out, int *n) {
+    FILE *f = fopen(fn, "r");
+    if (!f) return 0;
+    char line[MAX_LINE];
+    int cnt = 0, cap = 0;
+    CarModel *cars = NULL;
+    while (fgets(line, sizeof(line), f)) {
+        char model[128];
+        double val;
+        if (sscanf(line, "%127[^,],%lf", model, &val) != 2) continue;
+        trim(model);
+        if (cnt == cap) {
+            int ncap = cap ? cap * 2 : 16;
+            CarModel *p = realloc(cars, sizeof(CarModel) * ncap);
+            if (!p) break;
+            cars = p;
+            cap = ncap;
+        }
+        memset(&cars[cnt], 0, sizeof(CarModel));
+        snprintf(cars[cnt].name, sizeof cars[cnt].name, "%s", model);
+        cars[cnt].co2_gkm = val;
+        cnt++;
+    }
+    fclose(f);
+    *n = cnt;
+    *out = cars;
+    if (cnt == 0) { free(cars); *out = NULL; }
     return cnt > 0;
 }
 
 /* Convenience: try places file first (space), then fallback to comma cities.txt */
-int load_cities_auto(const char *places_fn, const char *cities_fn, City *cities, int *n) {
+int load_cities_auto(const char *places_fn, const char *cities_fn, City **cities, int *n) {
     if (places_fn && strlen(places_fn) > 0) {
         if (load_places_space(places_fn, cities, n)) {
             printf("✓ Loaded %d places from %s (space-separated format)\n", *n, places_fn);
@@ -204,62 +311,352 @@ int load_cities_auto(const char *places_fn, const char *cities_fn, City *cities,
 }
 
 /* -------------------- TomTom sampling (uses embedded key) -------------------- */
+/* Single point on a one-off connection; bulk sampling goes through
+   flow_sample_points() so requests share keep-alive connections */
 double sample_tomtom_factor(double lat, double lon) {
-#ifdef USE_TOMTOM
-    char cmd[1024];
-    char buf[8192];
-    snprintf(cmd, sizeof(cmd),
-      "curl -s \"https://api.tomtom.com/traffic/services/4/flowSegmentData/absolute/10/json?point=%f,%f&key=%s\"",
-      lat, lon, TOMTOM_API_KEY);
-    FILE *fp = popen(cmd, "r");
-    if (!fp) return 1.0;
-    size_t r = fread(buf,1,sizeof(buf)-1,fp);
-    buf[r] = 0;
-    pclose(fp);
-    double cur=-1, freef=-1;
-    char *p = strstr(buf, "\"currentSpeed\"");
-    if (p) sscanf(p, "\"currentSpeed\"%*[^:]:%lf", &cur);
-    p = strstr(buf, "\"freeFlowSpeed\"");
-    if (p) sscanf(p, "\"freeFlowSpeed\"%*[^:]:%lf", &freef);
-    if (cur > 0 && freef > 0) {
-        double fac = freef / cur;
-        if (fac < 1.0) fac = 1.0;
-        if (fac > 4.0) fac = 4.0;
-        return fac;
-    }
-    return 1.0;
-#else
-    (void)lat; (void)lon;
-    return 1.0;
-#endif
+    FlowConfig fc;
+    double fac = 1.0;
+    if (!flow_config_from_env(&fc)) return 1.0;
+    fc.conns = 1;
+    flow_sample_points(&fc, &lat, &lon, 1, &fac, NULL);
+    return fac > 0 ? fac : 1.0;
 }
 
 /* -------------------- Graph builder -------------------- */
 
-Edge *build_complete_graph(City *cities, int n) {
-    Edge *edges = calloc(n * n, sizeof(Edge));
-    if (!edges) { perror("calloc"); exit(1); }
-    for (int i = 0; i < n; ++i) {
-        for (int j = 0; j < n; ++j) {
-            Edge *e = &edges[i*n + j];
-            e->v = (i==j)? -1 : j;
-            if (i != j) {
-                double d = haversine_km(cities[i].lat, cities[i].lon, cities[j].lat, cities[j].lon);
-                e->distance_km = d;
-                e->traffic_factor = 1.0;
-                e->co2_cost = 0.0;
-            } else {
-                e->distance_km = 0.0;
-                e->traffic_factor = 1.0;
-                e->co2_cost = 0.0;
+static int cmp_int(const void *a, const void *b) {
+    int x = *(const int*)a, y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+int graph_find_arc(const Graph *g, int u, int v);
+
+static int uf_find(int *parent_of, int x) {
+    while (parent_of[x] != x) { parent_of[x] = parent_of[parent_of[x]]; x = parent_of[x]; }
+    return x;
+}
+
+/* Build the CSR graph over g->cities: each place is linked to its k nearest
+   places (both directions), then any left-over components are bridged to
+   their nearest outside place so every query stays answerable.
+   Memory is O(n*k) instead of the old O(n^2) matrix. */
+int build_sparse_graph(Graph *g, int k) {
+    int n = g->n;
+    g->m = 0;
+    g->offsets = NULL; g->neighbour = NULL;
+    g->distance_km = g->traffic_factor = g->traffic_km = NULL;
+    g->sampled_at = g->road_hits = NULL;
+    g->cch = NULL;
+    g->refresher = NULL;
+    g->profile = NULL;
+    if (n <= 0) return 0;
+    if (k > n - 1) k = n - 1;
+    if (k < 1) k = 1;
+
+    double *la = malloc(sizeof(double) * n), *lo = malloc(sizeof(double) * n);
+    int *knn = malloc(sizeof(int) * (size_t)n * k);
+    int *cnt = calloc(n + 1, sizeof(int));
+    int *comp = malloc(sizeof(int) * n);
+    int *tmp_idx = malloc(sizeof(int) * (n > 0 ? n : 1));
+    double *tmp_d = malloc(sizeof(double) * (n > 0 ? n : 1));
+    GeoIndex gi;
+    if (!la || !lo || !knn || !cnt || !comp || !tmp_idx || !tmp_d) { perror("malloc"); exit(1); }
+    for (int i = 0; i < n; ++i) { la[i] = g->cities[i].lat; lo[i] = g->cities[i].lon; }
+    if (!geoindex_build(&gi, n, la, lo)) { perror("malloc"); exit(1); }
+
+    int *knn_len = malloc(sizeof(int) * n);
+    if (!knn_len) { perror("malloc"); exit(1); }
+    for (int u = 0; u < n; ++u) knn_len[u] = geoindex_knn(&gi, la, lo, u, k, &knn[(size_t)u*k], tmp_d);
+
+    /* union-find over the KNN edges to find disconnected clusters */
+    int sets = n;
+    for (int i = 0; i < n; ++i) comp[i] = i;
+    for (int u = 0; u < n; ++u)
+        for (int j = 0; j < knn_len[u]; ++j) {
+            int ra = uf_find(comp, u), rb = uf_find(comp, knn[(size_t)u*k + j]);
+            if (ra != rb) { comp[ra] = rb; sets--; }
+        }
+
+    /* bridge each cluster to its nearest place outside it until one remains */
+    int *bridge_u = NULL, *bridge_v = NULL, nbridge = 0, bcap = 0;
+    while (sets > 1) {
+        for (int u = 0; u < n && sets > 1; ++u) {
+            int ru = uf_find(comp, u);
+            if (ru != u) continue;
+            int want = k * 2, best = -1;
+            for (;;) {
+                if (want > n - 1) want = n - 1;
+                int got = geoindex_knn(&gi, la, lo, u, want, tmp_idx, tmp_d);
+                for (int j = 0; j < got; ++j) if (uf_find(comp, tmp_idx[j]) != ru) { best = tmp_idx[j]; break; }
+                if (best >= 0 || want == n - 1) break;
+                want *= 2;
             }
+            if (best < 0) continue;
+            if (nbridge == bcap) {
+                bcap = bcap ? bcap * 2 : 16;
+                bridge_u = realloc(bridge_u, sizeof(int) * bcap);
+                bridge_v = realloc(bridge_v, sizeof(int) * bcap);
+                if (!bridge_u || !bridge_v) { perror("realloc"); exit(1); }
+            }
+            bridge_u[nbridge] = u; bridge_v[nbridge] = best; nbridge++;
+            comp[ru] = uf_find(comp, best);
+            sets--;
         }
     }
-    return edges;
+
+    /* degree count, fill, then sort + dedupe each row */
+    for (int u = 0; u < n; ++u)
+        for (int j = 0; j < knn_len[u]; ++j) { cnt[u]++; cnt[knn[(size_t)u*k + j]]++; }
+    for (int b = 0; b < nbridge; ++b) { cnt[bridge_u[b]]++; cnt[bridge_v[b]]++; }
+    int *off = malloc(sizeof(int) * (n + 1));
+    if (!off) { perror("malloc"); exit(1); }
+    off[0] = 0;
+    for (int u = 0; u < n; ++u) off[u+1] = off[u] + cnt[u];
+    int *adj = malloc(sizeof(int) * (off[n] > 0 ? off[n] : 1));
+    if (!adj) { perror("malloc"); exit(1); }
+    for (int u = 0; u < n; ++u) cnt[u] = off[u];
+    for (int u = 0; u < n; ++u)
+        for (int j = 0; j < knn_len[u]; ++j) {
+            int v = knn[(size_t)u*k + j];
+            adj[cnt[u]++] = v; adj[cnt[v]++] = u;
+        }
+    for (int b = 0; b < nbridge; ++b) {
+        adj[cnt[bridge_u[b]]++] = bridge_v[b];
+        adj[cnt[bridge_v[b]]++] = bridge_u[b];
+    }
+    int m = 0;
+    g->offsets = malloc(sizeof(int) * (n + 1));
+    if (!g->offsets) { perror("malloc"); exit(1); }
+    for (int u = 0; u < n; ++u) {
+        qsort(&adj[off[u]], off[u+1] - off[u], sizeof(int), cmp_int);
+        g->offsets[u] = m;
+        for (int a = off[u]; a < off[u+1]; ++a)
+            if (a == off[u] || adj[a] != adj[a-1]) adj[m++] = adj[a];
+    }
+    g->offsets[n] = m;
+    g->m = m;
+    g->neighbour = realloc(adj, sizeof(int) * (m > 0 ? m : 1));
+    g->distance_km = malloc(sizeof(double) * (m > 0 ? m : 1));
+    g->traffic_factor = malloc(sizeof(double) * (m > 0 ? m : 1));
+    g->traffic_km = calloc(m > 0 ? m : 1, sizeof(double));
+    g->sampled_at = calloc(m > 0 ? m : 1, sizeof(unsigned));
+    g->road_hits = calloc(m > 0 ? m : 1, sizeof(unsigned));
+    g->reverse_arc = malloc(sizeof(int) * (m > 0 ? m : 1));
+    if (!g->neighbour || !g->distance_km || !g->traffic_factor || !g->traffic_km ||
+        !g->sampled_at || !g->road_hits || !g->reverse_arc) {
+        perror("malloc"); exit(1);
+    }
+    for (int u = 0; u < n; ++u)
+        for (int a = g->offsets[u]; a < g->offsets[u+1]; ++a) {
+            int v = g->neighbour[a];
+            g->distance_km[a] = haversine_km(g->cities[u].lat, g->cities[u].lon,
+                                             g->cities[v].lat, g->cities[v].lon);
+            g->traffic_factor[a] = 1.0;
+        }
+    for (int u = 0; u < n; ++u)
+        for (int a = g->offsets[u]; a < g->offsets[u+1]; ++a)
+            g->reverse_arc[a] = graph_find_arc(g, g->neighbour[a], u);
+
+    geoindex_free(&gi);
+    free(la); free(lo); free(knn); free(knn_len); free(cnt); free(comp);
+    free(tmp_idx); free(tmp_d); free(off); free(bridge_u); free(bridge_v);
+    return 1;
+}
+
+/* Arc index of u->v, or -1 if the pruned graph has no such road */
+int graph_find_arc(const Graph *g, int u, int v) {
+    int lo_a = g->offsets[u], hi_a = g->offsets[u+1] - 1;
+    while (lo_a <= hi_a) {
+        int mid = (lo_a + hi_a) / 2;
+        if (g->neighbour[mid] == v) return mid;
+        if (g->neighbour[mid] < v) lo_a = mid + 1; else hi_a = mid - 1;
+    }
+    return -1;
+}
+
+/* Factor and sample time of the road with arc a, both directions */
+static void set_road_sample(Graph *g, int a, double fac, unsigned when) {
+    int r = g->reverse_arc[a];
+    g->traffic_factor[a] = g->traffic_factor[r] = fac;
+    g->sampled_at[a] = g->sampled_at[r] = when;
+}
+
+/* Reset every road to free flow, never sampled */
+static void clear_traffic(Graph *g) {
+    for (int a = 0; a < g->m; ++a) { g->traffic_factor[a] = 1.0; g->sampled_at[a] = 0; }
+}
+
+void free_graph(Graph *g) {
+    free(g->cities); free(g->offsets); free(g->neighbour);
+    free(g->distance_km); free(g->traffic_factor); free(g->traffic_km); free(g->reverse_arc);
+    free(g->sampled_at); free(g->road_hits);
+    if (g->cch) { cch_free(g->cch); free(g->cch); }
+    if (g->profile) { free(g->profile->road); free(g->profile->q); free(g->profile); }
+    memset(g, 0, sizeof(*g));
 }
 
 /* -------------------- Traffic cache helpers -------------------- */
 
+/* Binary cache (TRAFFIC_CACHE_FILE): a TrafficFileHeader, then a
+   TrafficFileEntry, in CSR order, for each road (u < v) that differs from
+   the header's defaults: a factor other than free flow, a sample time other
+   than the common one, or a nonzero recent-use count (the refresh
+   priority). Roads without an entry are free flowing and were sampled at
+   default_sampled_at, typically the last full sample, so the file grows
+   with congestion rather than with the road count. The fingerprint covers
+   the road topology and lengths, so a cache written for another places
+   file or k is ignored. The file is memory-mapped on load and replaced
+   atomically (write to .tmp, then rename) on save. */
+typedef struct {
+    char magic[6];               /* TRAFFIC_FILE_MAGIC, no terminator */
+    uint16_t version;            /* TRAFFIC_FILE_VERSION */
+    uint32_t roads;
+    uint32_t entries;            /* roads listed after the header */
+    uint64_t fingerprint;
+    int64_t written;             /* unix time of the save */
+    float default_factor;        /* of roads not listed */
+    uint32_t default_sampled_at; /* unix time, 0 = never sampled */
+} TrafficFileHeader;
+
+typedef struct {
+    uint32_t arc;                /* arc u->v of the road, u < v */
+    float factor;
+    uint32_t sampled_at;         /* unix time, 0 = never sampled */
+    uint32_t hits;               /* road_hits of the road */
+} TrafficFileEntry;
+
+/* FNV-1a style, one 64-bit word per step (byte-wise FNV over 10^6 roads
+   would dominate the load) */
+static uint64_t traffic_fnv_words(uint64_t h, const void *data, size_t len) {
+    const unsigned char *p = data;
+    uint64_t w;
+    for (; len >= 8; len -= 8, p += 8) {
+        memcpy(&w, p, 8);
+        h = (h ^ w) * 1099511628211ULL;
+    }
+    return ch_fnv1a(h, p, len);
+}
+
+static uint64_t traffic_graph_fingerprint(const Graph *g) {
+    uint64_t h = 1469598103934665603ULL;
+    h = traffic_fnv_words(h, &g->n, sizeof(g->n));
+    h = traffic_fnv_words(h, &g->m, sizeof(g->m));
+    h = traffic_fnv_words(h, g->offsets, sizeof(int) * (g->n + 1));
+    h = traffic_fnv_words(h, g->neighbour, sizeof(int) * g->m);
+    h = traffic_fnv_words(h, g->distance_km, sizeof(double) * g->m);
+    return h;
+}
+
+/* Apply the binary cache fn to g. Returns 1 if it exists and matches g;
+   *oldest then holds the oldest sample time among sampled roads, or the
+   save time when none was sampled. g is untouched on failure. Beyond the
+   reset of g's arrays the work is per listed (non-default) road. */
+int load_traffic_cache(Graph *g, const char *fn, long long *oldest) {
+    size_t size = 0;
+    const unsigned char *base = NULL;
+#ifdef _WIN32
+    FILE *f = fopen(fn, "rb");
+    if (!f) return 0;
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    unsigned char *buf = len > 0 ? malloc(len) : NULL;
+    if (buf && fread(buf, 1, len, f) == (size_t)len) { base = buf; size = (size_t)len; }
+    fclose(f);
+#else
+    int fd = open(fn, O_RDONLY);
+    if (fd < 0) return 0;
+    struct stat sb;
+    if (fstat(fd, &sb) == 0 && sb.st_size >= (off_t)sizeof(TrafficFileHeader)) {
+        void *p = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) { base = p; size = sb.st_size; }
+    }
+    close(fd);
+#endif
+    int ok = 0;
+    if (base && size >= sizeof(TrafficFileHeader)) {
+        TrafficFileHeader h;
+        memcpy(&h, base, sizeof(h));
+        ok = memcmp(h.magic, TRAFFIC_FILE_MAGIC, 6) == 0 && h.version == TRAFFIC_FILE_VERSION &&
+             h.roads == (uint32_t)(g->m / 2) && h.entries <= h.roads &&
+             size == sizeof(h) + (size_t)h.entries * sizeof(TrafficFileEntry) &&
+             h.fingerprint == traffic_graph_fingerprint(g);
+        const TrafficFileEntry *e = (const TrafficFileEntry *)(base + sizeof(h));
+        for (uint32_t i = 0; ok && i < h.entries; ++i) ok = e[i].arc < (uint32_t)g->m;
+        if (ok) {
+            uint32_t first = h.default_sampled_at && h.entries < h.roads ? h.default_sampled_at : UINT32_MAX;
+            for (int a = 0; a < g->m; ++a) {
+                g->traffic_factor[a] = h.default_factor;
+                g->sampled_at[a] = h.default_sampled_at;
+            }
+            memset(g->road_hits, 0, sizeof(unsigned) * g->m);
+            for (uint32_t i = 0; i < h.entries; ++i) {
+                set_road_sample(g, (int)e[i].arc, e[i].factor, e[i].sampled_at);
+                g->road_hits[e[i].arc] = e[i].hits;
+                uint32_t t = e[i].sampled_at ? e[i].sampled_at : UINT32_MAX;
+                first = t < first ? t : first;
+            }
+            *oldest = first != UINT32_MAX ? (long long)first : (long long)h.written;
+        }
+    }
+#ifdef _WIN32
+    free(buf);
+#else
+    if (base) munmap((void *)base, size);
+#endif
+    return ok;
+}
+
+int save_traffic_cache(const Graph *g, const char *fn) {
+    char tmp[512];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", fn);
+    FILE *f = fopen(tmp, "wb");
+    if (!f) return 0;
+    TrafficFileHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, TRAFFIC_FILE_MAGIC, 6);
+    h.version = TRAFFIC_FILE_VERSION;
+    h.roads = (uint32_t)(g->m / 2);
+    h.fingerprint = traffic_graph_fingerprint(g);
+    h.written = (int64_t)time(NULL);
+    h.default_factor = 1.0f;
+    /* the sample time most free-flowing roads share: majority vote, which
+       finds it whenever one full sample covers more than half of them */
+    unsigned votes = 0;
+    for (int u = 0; u < g->n; ++u)
+        for (int a = g->offsets[u]; a < g->offsets[u+1]; ++a) {
+            if (g->neighbour[a] <= u || (float)g->traffic_factor[a] != h.default_factor) continue;
+            if (votes == 0) h.default_sampled_at = g->sampled_at[a];
+            votes += g->sampled_at[a] == h.default_sampled_at ? 1 : -1;
+        }
+    int ok = fwrite(&h, sizeof(h), 1, f) == 1;
+    TrafficFileEntry buf[1024];
+    int nb = 0;
+    for (int u = 0; u < g->n && ok; ++u) {
+        for (int a = g->offsets[u]; a < g->offsets[u+1]; ++a) {
+            if (g->neighbour[a] <= u) continue;
+            float fac = (float)g->traffic_factor[a];
+            unsigned hits = __atomic_load_n(&g->road_hits[a], __ATOMIC_RELAXED);
+            if (fac == h.default_factor && g->sampled_at[a] == h.default_sampled_at && hits == 0) continue;
+            buf[nb].arc = (uint32_t)a;
+            buf[nb].factor = fac;
+            buf[nb].sampled_at = g->sampled_at[a];
+            buf[nb].hits = hits;
+            h.entries++;
+            if (++nb == 1024) { ok = ok && fwrite(buf, sizeof(buf[0]), nb, f) == (size_t)nb; nb = 0; }
+        }
+    }
+    ok = ok && fwrite(buf, sizeof(buf[0]), nb, f) == (size_t)nb;
+    ok = ok && fseek(f, 0, SEEK_SET) == 0 && fwrite(&h, sizeof(h), 1, f) == 1;     /* now with the entry count */
+    ok = (fclose(f) == 0) && ok;
+#ifdef _WIN32
+    if (ok) remove(fn);
+#endif
+    if (!ok || rename(tmp, fn) != 0) { remove(tmp); return 0; }
+    return 1;
+}
+
+/* Legacy text format: a unix timestamp line, then "u v factor" per road */
 int is_cache_fresh(const char *fn, int ttl_minutes) {
     FILE *f = fopen(fn, "r");
     if (!f) return 0;
@@ -273,136 +670,1874 @@ int is_cache_fresh(const char *fn, int ttl_minutes) {
     return 0;
 }
 
-int load_traffic_cache(Graph *g) {
-    FILE *f = fopen(TRAFFIC_CACHE_FILE, "r");
+/* Every listed road gets the file's timestamp as its sample time */
+int import_traffic_text(Graph *g, const char *fn) {
+    FILE *f = fopen(fn, "r");
     if (!f) return 0;
     long long ts = 0;
     if (fscanf(f, "%lld\n", &ts) != 1) { fclose(f); return 0; }
     int n = g->n;
-    for (int i = 0; i < n*n; ++i) g->edges[i].traffic_factor = 1.0;
+    clear_traffic(g);
     int u,v; double fac;
     while (fscanf(f, "%d %d %lf\n", &u, &v, &fac) == 3) {
-        if (u >=0 && u < n && v >=0 && v < n) {
-            g->edges[u*n + v].traffic_factor = fac;
-            g->edges[v*n + u].traffic_factor = fac;
-        }
+        if (u < 0 || u >= n || v < 0 || v >= n) continue;
+        int a = graph_find_arc(g, u, v);
+        if (a >= 0) set_road_sample(g, a, fac, (unsigned)ts);
     }
     fclose(f);
     return 1;
 }
 
-int save_traffic_cache(Graph *g) {
-    FILE *f = fopen(TRAFFIC_CACHE_FILE, "w");
+/* One line per road (u < v) of the pruned graph, stamped with the newest sample time */
+int export_traffic_text(const Graph *g, const char *fn) {
+    FILE *f = fopen(fn, "w");
     if (!f) return 0;
-    time_t now = time(NULL);
-    fprintf(f, "%lld\n", (long long)now);
+    unsigned newest = 0;
+    for (int a = 0; a < g->m; ++a) if (g->sampled_at[a] > newest) newest = g->sampled_at[a];
+    fprintf(f, "%lld\n", newest ? (long long)newest : (long long)time(NULL));
     int n = g->n;
     for (int i = 0; i < n; ++i) {
-        for (int j = i+1; j < n; ++j) {
-            double fac = g->edges[i*n + j].traffic_factor;
-            fprintf(f, "%d %d %.6f\n", i, j, fac);
+        for (int a = g->offsets[i]; a < g->offsets[i+1]; ++a) {
+            int j = g->neighbour[a];
+            if (j <= i) continue;
+            fprintf(f, "%d %d %.6f\n", i, j, g->traffic_factor[a]);
         }
     }
-    fclose(f);
-    return 1;
+    return fclose(f) == 0;
 }
 
-/* Build edge traffic factors with caching and optional forced refresh */
-void build_edge_midpoint_traffic_factors_cached(Graph *g, int sample_every_n, int force_refresh, int ttl_minutes) {
-    if (sample_every_n < 1) sample_every_n = SAMPLE_EVERY_N;
-    if (!force_refresh && is_cache_fresh(TRAFFIC_CACHE_FILE, ttl_minutes)) {
-        if (load_traffic_cache(g)) {
-            printf("✓ Loaded traffic factors from cache '%s' (TTL %d min)\n", TRAFFIC_CACHE_FILE, ttl_minutes);
-            return;
+/* -------------------- Sample-point grid -------------------- */
+
+/* Clustered places (campus nodes) put many road midpoints on the same
+   stretch of street, so the sampler snaps midpoints to square cells and
+   asks the provider once per cell, at its centre. Cells are rows of equal
+   latitude with columns narrowed by cos(latitude), so they stay roughly
+   cell_m wide at any latitude. Calls then grow with the covered area, not
+   with the number of roads. */
+
+typedef struct {
+    long long key;           /* cell id; road order when the grid is off */
+    int arc;                 /* arc u->v of the road, u < v */
+    double lat, lon;         /* point sampled for the road's group */
+} SampleRoad;
+
+/* ECO_FLOW_CELL_M, default SAMPLE_CELL_M_DEFAULT; 0 samples every road midpoint */
+static double sample_cell_m(void) {
+    const char *c = getenv("ECO_FLOW_CELL_M");
+    double m = c ? atof(c) : SAMPLE_CELL_M_DEFAULT;
+    return m > 0 ? m : 0;
+}
+
+/* Cell of (lat, lon) on a cell_m grid; clat, clon receive its centre */
+static long long sample_cell(double lat, double lon, double cell_m, double *clat, double *clon) {
+    const double m_per_deg = GEO_EARTH_R_KM * 1000.0 * M_PI / 180.0;
+    double dlat = cell_m / m_per_deg;
+    long long row = (long long)floor((lat + 90.0) / dlat);
+    *clat = -90.0 + (row + 0.5) * dlat;
+    double c = cos(deg2rad(*clat));
+    double dlon = cell_m / (m_per_deg * (c > 1e-6 ? c : 1e-6));
+    long long col = (long long)floor((lon + 180.0) / dlon);
+    *clon = -180.0 + (col + 0.5) * dlon;
+    return (row << 32) | col;
+}
+
+static int cmp_sample_road(const void *a, const void *b) {
+    const SampleRoad *x = a, *y = b;
+    if (x->key != y->key) return (x->key > y->key) - (x->key < y->key);
+    return (x->arc > y->arc) - (x->arc < y->arc);
+}
+
+/* Every road of g (m/2 entries) sorted into groups of equal key: one cell
+   each with cell_m > 0, one road each otherwise. Returns the road count,
+   -1 on allocation failure. */
+static int sample_roads_by_cell(const Graph *g, double cell_m, SampleRoad **out) {
+    int nr = 0;
+    SampleRoad *r = malloc(sizeof(SampleRoad) * (g->m / 2 + 1));
+    if (!r) return -1;
+    for (int i = 0; i < g->n; ++i) {
+        for (int a = g->offsets[i]; a < g->offsets[i+1]; ++a) {
+            int j = g->neighbour[a];
+            if (j <= i) continue;
+            double mlat = (g->cities[i].lat + g->cities[j].lat) / 2.0;
+            double mlon = (g->cities[i].lon + g->cities[j].lon) / 2.0;
+            r[nr].arc = a;
+            if (cell_m > 0) {
+                r[nr].key = sample_cell(mlat, mlon, cell_m, &r[nr].lat, &r[nr].lon);
+            } else {
+                r[nr].key = nr;
+                r[nr].lat = mlat;
+                r[nr].lon = mlon;
+            }
+            nr++;
         }
     }
-    /* Sample now (no valid cache or force_refresh) */
-    int n = g->n;
-    int sample_count = 0;
-    for (int i = 0; i < n; ++i) {
-        for (int j = i+1; j < n; ++j) {
-            int idx_ij = i*n + j;
-            if ((sample_count % sample_every_n) == 0) {
-#ifdef USE_TOMTOM
-                double mlat = (g->cities[i].lat + g->cities[j].lat) / 2.0;
-                double mlon = (g->cities[i].lon + g->cities[j].lon) / 2.0;
-                double fac = sample_tomtom_factor(mlat, mlon);
-                g->edges[idx_ij].traffic_factor = fac;
-                g->edges[j*n + i].traffic_factor = fac;
-                printf("Sampled traffic %d-%d : %.2fx\n", i, j, fac);
+    if (cell_m > 0) qsort(r, nr, sizeof(SampleRoad), cmp_sample_road);
+    *out = r;
+    return nr;
+}
+
+/* -------------------- Interpolation -------------------- */
+
+/* Only every Nth sample point is fetched, and a refresh within budget may
+   not reach all of those, so many roads have no measurement. Each group
+   of roads without one gets an inverse-distance-weighted (power 2) mean of
+   the TRAFFIC_IDW_K nearest measured points, with free flow as a prior
+   that weighs as much as a point TRAFFIC_IDW_RANGE_M away: congestion
+   spreads into unsampled cells nearby and fades out far from any sample.
+   Estimated roads keep sampled_at 0, so they never count as fresh. */
+
+/* Groups as in traffic_refresh (group k is roads[first[k], first[k+1])).
+   Returns 0 on allocation failure, leaving g unchanged. */
+static int traffic_interpolate_groups(Graph *g, const SampleRoad *roads, const int *first, int ngroups) {
+    if (TRAFFIC_IDW_K <= 0) return 1;
+    int np = 0;
+    int *pg = malloc(sizeof(int) * (ngroups + 1));
+    double *plat = malloc(sizeof(double) * (ngroups + 1));
+    double *plon = malloc(sizeof(double) * (ngroups + 1));
+    if (!pg || !plat || !plon) { free(pg); free(plat); free(plon); return 0; }
+    for (int k = 0; k < ngroups; ++k) {
+        int measured = -1;
+        for (int r = first[k]; r < first[k+1] && measured < 0; ++r)
+            if (g->sampled_at[roads[r].arc]) measured = roads[r].arc;
+        if (measured < 0) continue;
+        pg[np] = measured;
+        plat[np] = roads[first[k]].lat;
+        plon[np] = roads[first[k]].lon;
+        np++;
+    }
+    GeoIndex gi;
+    memset(&gi, 0, sizeof(gi));
+    int ok = np == 0 || geoindex_build(&gi, np, plat, plon);
+    if (ok && np > 0) {
+        const double range_km = TRAFFIC_IDW_RANGE_M / 1000.0, near_km = 0.001;
+        int idx[TRAFFIC_IDW_K > 0 ? TRAFFIC_IDW_K : 1];
+        double dist[TRAFFIC_IDW_K > 0 ? TRAFFIC_IDW_K : 1];
+        for (int k = 0; k < ngroups; ++k) {
+            int r0 = first[k], measured = 0;
+            for (int r = r0; r < first[k+1] && !measured; ++r) measured = g->sampled_at[roads[r].arc] != 0;
+            if (measured) continue;
+            int got = geoindex_knn_point(&gi, roads[r0].lat, roads[r0].lon, -1, TRAFFIC_IDW_K, idx, dist);
+            double wsum = 1.0 / (range_km * range_km), fsum = wsum;     /* free-flow prior */
+            for (int i = 0; i < got; ++i) {
+                double d = dist[i] > near_km ? dist[i] : near_km;
+                double w = 1.0 / (d * d);
+                wsum += w;
+                fsum += w * g->traffic_factor[pg[idx[i]]];
+            }
+            for (int r = r0; r < first[k+1]; ++r) set_road_sample(g, roads[r].arc, fsum / wsum, 0);
+        }
+    }
+    geoindex_free(&gi);
+    free(pg); free(plat); free(plon);
+    return ok;
+}
+
+/* -------------------- Time-of-day profiles -------------------- */
+
+/* Each measured sample also nudges its road's profile bucket for the local
+   time of day (an exponential average, so the profile follows seasonal
+   drift), and the profile is saved next to the cache. A query for a later
+   departure then reads the factor at the time it reaches each road,
+   interpolated linearly between bucket centres; buckets never sampled fall
+   back to the live factor. */
+
+#define PROFILE_BUCKET_S (86400 / PROFILE_BUCKETS)
+
+typedef struct {
+    char magic[6];               /* TRAFFIC_PROFILE_MAGIC, no terminator */
+    uint16_t version;            /* TRAFFIC_PROFILE_VERSION */
+    uint32_t roads;
+    uint32_t buckets;            /* PROFILE_BUCKETS */
+    uint64_t fingerprint;        /* traffic_graph_fingerprint() */
+} TrafficProfileHeader;
+
+static unsigned char profile_quantize(double f) {
+    if (f < 1.0) f = 1.0;
+    if (f > 4.0) f = 4.0;
+    return (unsigned char)(1 + lround((f - 1.0) * 254.0 / 3.0));
+}
+
+static double profile_dequantize(unsigned q) { return 1.0 + (q - 1) * 3.0 / 254.0; }
+
+/* Bucket of a unix time in local time of day */
+static int profile_bucket_of(long long when) {
+    time_t t = (time_t)when;
+    struct tm lt;
+#ifdef _WIN32
+    localtime_s(&lt, &t);
 #else
-                g->edges[idx_ij].traffic_factor = 1.0;
-                g->edges[j*n + i].traffic_factor = 1.0;
+    localtime_r(&t, &lt);
 #endif
-            } else {
-                g->edges[idx_ij].traffic_factor = 1.0;
-                g->edges[j*n + i].traffic_factor = 1.0;
+    return (lt.tm_hour * 3600 + lt.tm_min * 60 + lt.tm_sec) / PROFILE_BUCKET_S;
+}
+
+/* Empty profile (no samples) for the roads of g; NULL on allocation failure */
+static TrafficProfile *traffic_profile_new(const Graph *g) {
+    TrafficProfile *p = calloc(1, sizeof(TrafficProfile));
+    if (!p) return NULL;
+    p->road = malloc(sizeof(int) * (g->m > 0 ? g->m : 1));
+    p->q = calloc((size_t)(g->m / 2 > 0 ? g->m / 2 : 1) * PROFILE_BUCKETS, 1);
+    if (!p->road || !p->q) { free(p->road); free(p->q); free(p); return NULL; }
+    for (int u = 0; u < g->n; ++u)
+        for (int a = g->offsets[u]; a < g->offsets[u+1]; ++a)
+            if (g->neighbour[a] > u) p->road[a] = p->road[g->reverse_arc[a]] = p->roads++;
+    return p;
+}
+
+/* Fold a measured factor for arc a into its bucket. Only the refresh
+   writes profiles; queries may read them meanwhile, hence the atomics. */
+static void profile_observe(TrafficProfile *p, int a, double fac, int bucket) {
+    unsigned char *cell = &p->q[(size_t)p->road[a] * PROFILE_BUCKETS + bucket];
+    int old = __atomic_load_n(cell, __ATOMIC_RELAXED), q = profile_quantize(fac);
+    if (old) {
+        int step = (q - old) / (1 << PROFILE_SHIFT);
+        if (step == 0 && q != old) step = q > old ? 1 : -1;
+        q = old + step;
+    }
+    __atomic_store_n(cell, (unsigned char)q, __ATOMIC_RELAXED);
+}
+
+/* Factor of arc a at t_day seconds after local midnight */
+static double profile_factor(const Graph *g, int a, double t_day) {
+    const TrafficProfile *p = g->profile;
+    if (!p) return g->traffic_factor[a];
+    double x = fmod(t_day, 86400.0) / PROFILE_BUCKET_S - 0.5;
+    if (x < 0) x += PROFILE_BUCKETS;
+    int b0 = (int)x % PROFILE_BUCKETS, b1 = (b0 + 1) % PROFILE_BUCKETS;
+    double w = x - floor(x);
+    const unsigned char *row = &p->q[(size_t)p->road[a] * PROFILE_BUCKETS];
+    unsigned q0 = __atomic_load_n(&row[b0], __ATOMIC_RELAXED), q1 = __atomic_load_n(&row[b1], __ATOMIC_RELAXED);
+    if (!q0 && !q1) return g->traffic_factor[a];
+    if (!q0) return profile_dequantize(q1);
+    if (!q1) return profile_dequantize(q0);
+    return profile_dequantize(q0) * (1.0 - w) + profile_dequantize(q1) * w;
+}
+
+/* Factor to charge for arc a entered at t_day, kept FIFO: leaving later
+   never arrives earlier. Crossing the whole road at the entry time's
+   factor breaks that on long roads while congestion eases (a factor may
+   fall by 3 over one bucket, overtaking itself beyond about 4 km), so the
+   car is charged as if it waited for the best later entry: arrival(t) =
+   min over t' >= t of t' + T(t'). Arrival is linear between bucket
+   centres, so only the centres before the earliest arrival found need
+   checking. */
+static double profile_arc_factor(const Graph *g, int a, double t_day) {
+    double f = profile_factor(g, a, t_day), d = g->distance_km[a];
+    if (!g->profile || d <= 0) return f;
+    const double s = d * 3600.0 / CAR_FREEFLOW_KMPH, bs = PROFILE_BUCKET_S;   /* seconds per unit factor */
+    double best = t_day + f * s;
+    for (double x = (floor(t_day / bs - 0.5) + 1.5) * bs; x < best; x += bs) {
+        double arr = x + profile_factor(g, a, x) * s;
+        if (arr < best) best = arr;
+    }
+    return (best - t_day) / s;
+}
+
+/* Give g a profile, read from fn when it was written for the same roads.
+   Returns 1 if fn was loaded, 0 if g starts with an empty profile (or
+   none, on allocation failure). */
+int load_traffic_profile(Graph *g, const char *fn) {
+    if (!g->profile && !(g->profile = traffic_profile_new(g))) return 0;
+    FILE *f = fopen(fn, "rb");
+    if (!f) return 0;
+    TrafficProfileHeader h;
+    size_t body = (size_t)g->profile->roads * PROFILE_BUCKETS;
+    int ok = fread(&h, sizeof(h), 1, f) == 1 && memcmp(h.magic, TRAFFIC_PROFILE_MAGIC, 6) == 0 &&
+             h.version == TRAFFIC_PROFILE_VERSION && h.roads == (uint32_t)g->profile->roads &&
+             h.buckets == PROFILE_BUCKETS && h.fingerprint == traffic_graph_fingerprint(g);
+    unsigned char *q = ok ? malloc(body > 0 ? body : 1) : NULL;
+    ok = ok && q && fread(q, 1, body, f) == body;
+    fclose(f);
+    if (ok) { free(g->profile->q); g->profile->q = q; }
+    else free(q);
+    return ok;
+}
+
+int save_traffic_profile(const Graph *g, const char *fn) {
+    if (!g->profile) return 0;
+    char tmp[512];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", fn);
+    FILE *f = fopen(tmp, "wb");
+    if (!f) return 0;
+    TrafficProfileHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, TRAFFIC_PROFILE_MAGIC, 6);
+    h.version = TRAFFIC_PROFILE_VERSION;
+    h.roads = (uint32_t)g->profile->roads;
+    h.buckets = PROFILE_BUCKETS;
+    h.fingerprint = traffic_graph_fingerprint(g);
+    size_t body = (size_t)g->profile->roads * PROFILE_BUCKETS;
+    int ok = fwrite(&h, sizeof(h), 1, f) == 1 && fwrite(g->profile->q, 1, body, f) == body;
+    ok = (fclose(f) == 0) && ok;
+#ifdef _WIN32
+    if (ok) remove(fn);
+#endif
+    if (!ok || rename(tmp, fn) != 0) { remove(tmp); return 0; }
+    return 1;
+}
+
+/* -------------------- Incremental refresh -------------------- */
+
+/* Freshness is tracked per sample point (grid cell): a point is stale when
+   one of its roads was last sampled more than the TTL ago, or never. Each
+   refresh fetches at most a budget of stale points, those on the most
+   recently routed roads first (road_hits, halved after every refresh that
+   made requests), then the longest-stale. Refreshes become a steady trickle
+   instead of a full resample whenever the TTL runs out. */
+
+typedef struct {
+    int points;              /* sample points in use (every Nth cell) */
+    int stale;               /* of those, stale before this refresh */
+    int fetched;             /* requests made */
+    int failed;              /* requests that failed (points stay stale) */
+    double seconds;
+} TrafficRefreshStats;
+
+typedef struct {
+    int group;
+    unsigned hits;
+    unsigned when;           /* oldest sample time of its roads, 0 = never */
+} StalePoint;
+
+static int cmp_stale_point(const void *a, const void *b) {
+    const StalePoint *x = a, *y = b;
+    if (x->hits != y->hits) return x->hits < y->hits ? 1 : -1;
+    if (x->when != y->when) return x->when > y->when ? 1 : -1;
+    return (x->group > y->group) - (x->group < y->group);
+}
+
+/* ECO_FLOW_BUDGET, default TRAFFIC_REFRESH_BUDGET; 0 means no limit */
+static int traffic_refresh_budget(void) {
+    const char *b = getenv("ECO_FLOW_BUDGET");
+    int n = b ? atoi(b) : TRAFFIC_REFRESH_BUDGET;
+    return n > 0 ? n : 0;
+}
+
+/* Count a routed path towards the refresh priority of its roads. Safe to
+   call from concurrent batch workers. */
+void traffic_note_path(Graph *g, const int *path, int len) {
+    for (int i = 0; i + 1 < len; ++i) {
+        int u = path[i], v = path[i+1];
+        int a = graph_find_arc(g, u < v ? u : v, u < v ? v : u);
+        if (a >= 0) __atomic_fetch_add(&g->road_hits[a], 1u, __ATOMIC_RELAXED);
+    }
+}
+
+/* Re-fetch up to budget stale sample points (budget 0: all of them); with
+   max_age < 0 every point counts as stale. Every Nth grid cell is a sample
+   point, as for a full sample; once anything was fetched, roads still
+   without a measurement are re-estimated from those that have one.
+   Returns 0 on allocation failure. */
+int traffic_refresh(Graph *g, const FlowConfig *fc, int sample_every_n, long long now,
+                    long long max_age, int budget, TrafficRefreshStats *rs) {
+    memset(rs, 0, sizeof(*rs));
+    if (sample_every_n < 1) sample_every_n = SAMPLE_EVERY_N;
+    SampleRoad *roads = NULL;
+    int nr = sample_roads_by_cell(g, sample_cell_m(), &roads);
+    int *first = malloc(sizeof(int) * (nr + 2));
+    StalePoint *sp = malloc(sizeof(StalePoint) * (nr + 1));
+    double *lat = malloc(sizeof(double) * (nr + 1));
+    double *lon = malloc(sizeof(double) * (nr + 1));
+    double *fac = malloc(sizeof(double) * (nr + 1));
+    int ok = nr >= 0 && first && sp && lat && lon && fac;
+    if (ok) {
+        /* group k is roads[first[k], first[k+1]) */
+        int ngroups = 0;
+        for (int r = 0; r < nr; ++r)
+            if (r == 0 || roads[r].key != roads[r-1].key) first[ngroups++] = r;
+        first[ngroups] = nr;
+        for (int k = 0; k < ngroups; k += sample_every_n) {
+            unsigned when = UINT32_MAX, hits = 0;
+            for (int r = first[k]; r < first[k+1]; ++r) {
+                int a = roads[r].arc;
+                if (g->sampled_at[a] < when) when = g->sampled_at[a];
+                hits += __atomic_load_n(&g->road_hits[a], __ATOMIC_RELAXED);
             }
-            sample_count++;
+            rs->points++;
+            if (max_age >= 0 && when && now - (long long)when <= max_age) continue;
+            sp[rs->stale].group = k;
+            sp[rs->stale].hits = hits;
+            sp[rs->stale].when = when;
+            rs->stale++;
+        }
+        qsort(sp, rs->stale, sizeof(StalePoint), cmp_stale_point);
+        int ns = budget > 0 && budget < rs->stale ? budget : rs->stale;
+        for (int s = 0; s < ns; ++s) {
+            lat[s] = roads[first[sp[s].group]].lat;
+            lon[s] = roads[first[sp[s].group]].lon;
+        }
+        FlowStats st;
+        memset(&st, 0, sizeof(st));
+        if (ns > 0) flow_sample_points(fc, lat, lon, ns, fac, &st);
+        int bucket = profile_bucket_of(now);
+        for (int s = 0; s < ns; ++s) {
+            if (fac[s] <= 0) continue;
+            int k = sp[s].group;
+            for (int r = first[k]; r < first[k+1]; ++r) {
+                set_road_sample(g, roads[r].arc, fac[s], (unsigned)now);
+                if (g->profile) profile_observe(g->profile, roads[r].arc, fac[s], bucket);
+            }
+        }
+        if (ns > 0)         /* a count bumped concurrently may be lost; it is only a priority */
+            for (int a = 0; a < g->m; ++a)
+                __atomic_store_n(&g->road_hits[a], __atomic_load_n(&g->road_hits[a], __ATOMIC_RELAXED) >> 1,
+                                 __ATOMIC_RELAXED);
+        if (ns > st.failures) ok = traffic_interpolate_groups(g, roads, first, ngroups);
+        rs->fetched = ns;
+        rs->failed = st.failures;
+        rs->seconds = st.seconds;
+    }
+    free(roads); free(first); free(sp); free(lat); free(lon); free(fac);
+    return ok;
+}
+
+/* Traffic factors from the cache, or a fresh legacy text cache, or free
+   flow, and the time-of-day profiles; no network. Returns 1 if a cache
+   was used. */
+int load_traffic_factors(Graph *g, int ttl_minutes) {
+    long long oldest = 0;
+    load_traffic_profile(g, TRAFFIC_PROFILE_FILE);
+    if (load_traffic_cache(g, TRAFFIC_CACHE_FILE, &oldest)) {
+        fprintf(stderr, "✓ Loaded traffic factors from cache '%s' (TTL %d min)\n", TRAFFIC_CACHE_FILE, ttl_minutes);
+        return 1;
+    }
+    clear_traffic(g);
+    /* one-time migration from the text cache */
+    if (is_cache_fresh(TRAFFIC_CACHE_TEXT, ttl_minutes) && import_traffic_text(g, TRAFFIC_CACHE_TEXT)) {
+        fprintf(stderr, "✓ Imported '%s'\n", TRAFFIC_CACHE_TEXT);
+        return 1;
+    }
+    return 0;
+}
+
+/* Load the traffic factors, refresh the stale part within the request
+   budget in the calling thread, and save them if anything changed.
+   force_refresh ignores the cache and fetches every sample point. Queries
+   that must not wait for the provider use a TrafficRefresher instead. */
+/* Progress goes to stderr so batch output on stdout stays clean */
+void build_edge_midpoint_traffic_factors_cached(Graph *g, int sample_every_n, int force_refresh, int ttl_minutes) {
+    int loaded = 0;
+    if (force_refresh) { clear_traffic(g); load_traffic_profile(g, TRAFFIC_PROFILE_FILE); }
+    else loaded = load_traffic_factors(g, ttl_minutes);
+    FlowConfig fc;
+    TrafficRefreshStats rs;
+    memset(&rs, 0, sizeof(rs));
+    if (flow_config_from_env(&fc)) {
+        int budget = force_refresh ? 0 : traffic_refresh_budget();
+        if (!traffic_refresh(g, &fc, sample_every_n, (long long)time(NULL),
+                             force_refresh ? -1 : (long long)ttl_minutes * 60LL, budget, &rs)) {
+            fprintf(stderr, "⚠️  Warning: out of memory, traffic not sampled\n");
+        } else if (rs.stale > 0) {
+            fprintf(stderr, "Refreshed %d of %d stale traffic sample points (of %d; budget %s) in %.2f s, "
+                    "%d failed\n", rs.fetched, rs.stale, rs.points, budget ? "limited" : "none",
+                    rs.seconds, rs.failed);
         }
     }
-    if (save_traffic_cache(g)) {
-        printf("✓ Traffic cache saved to '%s'\n", TRAFFIC_CACHE_FILE);
+    if (loaded && rs.fetched == 0) return;
+    if (rs.fetched > rs.failed) save_traffic_profile(g, TRAFFIC_PROFILE_FILE);
+    if (save_traffic_cache(g, TRAFFIC_CACHE_FILE)) {
+        fprintf(stderr, "✓ Traffic cache saved to '%s'\n", TRAFFIC_CACHE_FILE);
     } else {
-        printf("⚠️  Warning: failed to write traffic cache '%s'\n", TRAFFIC_CACHE_FILE);
+        fprintf(stderr, "⚠️  Warning: failed to write traffic cache '%s'\n", TRAFFIC_CACHE_FILE);
+    }
+}
+
+/* -------------------- Customizable CH (traffic-independent) -------------------- */
+
+/* Traffic is per road (set_road_sample keeps both directions equal), so
+   the hierarchy is undirected. Its input edges are the roads u<v in CSR
+   order, so customization can hand over traffic_km without a lookup. */
+
+/* Contract the road topology once per graph; no weights are involved, so
+   traffic refreshes only need graph_customize_cch(). */
+int graph_prepare_cch(Graph *g) {
+    if (g->cch) return 1;
+    int n = g->n, ne = g->m / 2, e = 0;
+    int *eu = malloc(sizeof(int) * (ne > 0 ? ne : 1)), *ev = malloc(sizeof(int) * (ne > 0 ? ne : 1));
+    double *la = malloc(sizeof(double) * (n > 0 ? n : 1)), *lo = malloc(sizeof(double) * (n > 0 ? n : 1));
+    g->cch = malloc(sizeof(CustomizableCH));
+    if (!eu || !ev || !la || !lo || !g->cch) { perror("malloc"); exit(1); }
+    for (int u = 0; u < n; ++u) {
+        la[u] = g->cities[u].lat; lo[u] = g->cities[u].lon;
+        for (int a = g->offsets[u]; a < g->offsets[u+1]; ++a)
+            if (g->neighbour[a] > u) { eu[e] = u; ev[e] = g->neighbour[a]; e++; }
+    }
+    cch_build(g->cch, n, e, eu, ev, la, lo);
+    free(eu); free(ev); free(la); free(lo);
+    return 1;
+}
+
+/* Load the current traffic_km into the hierarchy (milliseconds, no contraction) */
+void graph_customize_cch(Graph *g) {
+    if (!g->cch) return;
+    double *w = malloc(sizeof(double) * (g->cch->ne > 0 ? g->cch->ne : 1));
+    if (!w) { perror("malloc"); exit(1); }
+    int e = 0;
+    for (int u = 0; u < g->n; ++u)
+        for (int a = g->offsets[u]; a < g->offsets[u+1]; ++a)
+            if (g->neighbour[a] > u) w[e++] = g->traffic_km[a];
+    cch_customize(g->cch, w);
+    free(w);
+}
+
+/* -------------------- Traffic weights -------------------- */
+
+/* CO2 of an arc is distance_km * traffic_factor * car g/km, so the car is a
+   constant factor on every path: the route minimizing traffic_km also
+   minimizes CO2 for every vehicle. Searches run on traffic_km and the
+   result is scaled by co2_grams() afterwards.
+   Call after traffic_factor changes; re-customizes the hierarchy if the
+   graph has one. */
+void apply_traffic_weights(Graph *g) {
+    double min_factor = 1.0;
+    for (int a = 0; a < g->m; ++a) {
+        g->traffic_km[a] = g->distance_km[a] * g->traffic_factor[a];
+        if (g->traffic_factor[a] < min_factor) min_factor = g->traffic_factor[a];
+    }
+    /* distance_km is the great-circle distance, so every arc costs at least
+       this much per km of straight-line progress towards the target */
+    g->traffic_lb = min_factor > 0 ? min_factor : 0.0;
+    graph_customize_cch(g);
+}
+
+/* -------------------- Background refresher -------------------- */
+
+/* Queries never wait for the provider. A refresher thread samples into a
+   spare TrafficSet (factors, weights, sample times and the customized CCH
+   metric) and publishes it by swapping the live pointer, RCU-style. A query
+   pins the live set for its whole search (graph_pin), so it sees one
+   consistent metric however many swaps happen meanwhile; the refresher
+   reuses a set only once its last reader has unpinned, and is the only
+   writer of weights while it runs. */
+
+typedef struct {
+    double *traffic_factor, *traffic_km;
+    unsigned *sampled_at;
+    double traffic_lb;
+    CustomizableCH cch;          /* shallow copy of g->cch carrying this set's metric */
+    int readers;                 /* queries pinned to this set */
+} TrafficSet;
+
+struct TrafficRefresher {
+    Graph *g;
+    TrafficSet set[2];           /* set[0] adopts g's own arrays */
+    TrafficSet *live;            /* published set, swapped atomically */
+    FlowConfig fc;
+    int sample_every_n, budget, interval_s;
+    long long max_age;
+    int published;               /* swaps so far */
+    int running, stop;
+#ifndef _WIN32
+    pthread_t tid;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+#endif
+};
+
+static void traffic_set_view(TrafficSet *s, Graph *view) {
+    view->traffic_factor = s->traffic_factor;
+    view->traffic_km = s->traffic_km;
+    view->sampled_at = s->sampled_at;
+    view->traffic_lb = s->traffic_lb;
+    if (view->cch) view->cch = &s->cch;
+}
+
+/* View of g for one query. With a refresher running, the published set is
+   pinned and its weights replace g's in *view until graph_unpin(). */
+TrafficSet *graph_pin(Graph *g, Graph *view) {
+    *view = *g;
+    if (!g->refresher) return NULL;
+    TrafficRefresher *tr = g->refresher;
+    TrafficSet *s = __atomic_load_n(&tr->live, __ATOMIC_SEQ_CST);
+    for (;;) {
+        __atomic_add_fetch(&s->readers, 1, __ATOMIC_SEQ_CST);
+        TrafficSet *again = __atomic_load_n(&tr->live, __ATOMIC_SEQ_CST);
+        if (again == s) break;
+        __atomic_sub_fetch(&s->readers, 1, __ATOMIC_SEQ_CST);
+        s = again;
+    }
+    traffic_set_view(s, view);
+    return s;
+}
+
+void graph_unpin(TrafficSet *s) {
+    if (s) __atomic_sub_fetch(&s->readers, 1, __ATOMIC_SEQ_CST);
+}
+
+#ifndef _WIN32
+
+static void *traffic_refresher_main(void *arg) {
+    TrafficRefresher *tr = arg;
+    Graph *g = tr->g;
+    pthread_mutex_lock(&tr->lock);
+    while (!tr->stop) {
+        pthread_mutex_unlock(&tr->lock);
+        TrafficSet *cur = __atomic_load_n(&tr->live, __ATOMIC_SEQ_CST);
+        TrafficSet *next = cur == &tr->set[0] ? &tr->set[1] : &tr->set[0];
+        /* queries still on the previous swap finish first; they never wait on us */
+        while (__atomic_load_n(&next->readers, __ATOMIC_SEQ_CST) > 0) usleep(1000);
+        memcpy(next->traffic_factor, cur->traffic_factor, sizeof(double) * g->m);
+        memcpy(next->sampled_at, cur->sampled_at, sizeof(unsigned) * g->m);
+        Graph view = *g;
+        traffic_set_view(next, &view);
+        TrafficRefreshStats rs;
+        if (traffic_refresh(&view, &tr->fc, tr->sample_every_n, (long long)time(NULL), tr->max_age,
+                            tr->budget, &rs) && rs.fetched > rs.failed) {
+            apply_traffic_weights(&view);
+            next->traffic_lb = view.traffic_lb;
+            __atomic_store_n(&tr->live, next, __ATOMIC_SEQ_CST);
+            __atomic_add_fetch(&tr->published, 1, __ATOMIC_SEQ_CST);
+            save_traffic_cache(&view, TRAFFIC_CACHE_FILE);
+            save_traffic_profile(&view, TRAFFIC_PROFILE_FILE);
+        }
+        pthread_mutex_lock(&tr->lock);
+        if (!tr->stop && tr->interval_s > 0) {
+            struct timespec until;
+            clock_gettime(CLOCK_REALTIME, &until);
+            until.tv_sec += tr->interval_s;
+            pthread_cond_timedwait(&tr->wake, &tr->lock, &until);
+        }
+    }
+    pthread_mutex_unlock(&tr->lock);
+    return NULL;
+}
+
+/* Refresh g in the background: right away, then every interval_s seconds
+   (0: back to back). Call after the weights are loaded and applied; until
+   traffic_refresher_stop() queries must go through graph_pin() and nothing
+   else may change g's weights. Returns 0, leaving g alone, when no provider
+   is configured or the thread cannot start. */
+int traffic_refresher_start(TrafficRefresher *tr, Graph *g, int sample_every_n, int ttl_minutes,
+                            int interval_s) {
+    memset(tr, 0, sizeof(*tr));
+    if (!flow_config_from_env(&tr->fc)) return 0;
+    tr->g = g;
+    tr->sample_every_n = sample_every_n;
+    tr->budget = traffic_refresh_budget();
+    tr->max_age = (long long)ttl_minutes * 60LL;
+    tr->interval_s = interval_s;
+    TrafficSet *a = &tr->set[0], *b = &tr->set[1];
+    a->traffic_factor = g->traffic_factor;
+    a->traffic_km = g->traffic_km;
+    a->sampled_at = g->sampled_at;
+    a->traffic_lb = g->traffic_lb;
+    int hm = 0;
+    if (g->cch) { a->cch = *g->cch; b->cch = *g->cch; hm = g->cch->h.m; }
+    b->traffic_factor = malloc(sizeof(double) * (g->m > 0 ? g->m : 1));
+    b->traffic_km = malloc(sizeof(double) * (g->m > 0 ? g->m : 1));
+    b->sampled_at = malloc(sizeof(unsigned) * (g->m > 0 ? g->m : 1));
+    b->cch.h.up_w = g->cch ? malloc(sizeof(double) * (hm > 0 ? hm : 1)) : NULL;
+    b->cch.h.up_mid = g->cch ? malloc(sizeof(int) * (hm > 0 ? hm : 1)) : NULL;
+    tr->live = a;
+    pthread_mutex_init(&tr->lock, NULL);
+    pthread_cond_init(&tr->wake, NULL);
+    tr->running = 1;
+    g->refresher = tr;           /* before the thread copies g */
+    if (!b->traffic_factor || !b->traffic_km || !b->sampled_at || (g->cch && (!b->cch.h.up_w || !b->cch.h.up_mid)) ||
+        pthread_create(&tr->tid, NULL, traffic_refresher_main, tr) != 0) {
+        free(b->traffic_factor); free(b->traffic_km); free(b->sampled_at);
+        free(b->cch.h.up_w); free(b->cch.h.up_mid);
+        pthread_mutex_destroy(&tr->lock);
+        pthread_cond_destroy(&tr->wake);
+        tr->running = 0;
+        g->refresher = NULL;
+        return 0;
+    }
+    return 1;
+}
+
+/* Let the current refresh finish, stop the thread and fold the live set
+   back into g's own arrays. Every pin must have been released. */
+void traffic_refresher_stop(TrafficRefresher *tr) {
+    if (!tr->running) return;
+    pthread_mutex_lock(&tr->lock);
+    tr->stop = 1;
+    pthread_cond_signal(&tr->wake);
+    pthread_mutex_unlock(&tr->lock);
+    pthread_join(tr->tid, NULL);
+    Graph *g = tr->g;
+    TrafficSet *a = &tr->set[0], *b = &tr->set[1];
+    if (tr->live == b) {
+        memcpy(a->traffic_factor, b->traffic_factor, sizeof(double) * g->m);
+        memcpy(a->traffic_km, b->traffic_km, sizeof(double) * g->m);
+        memcpy(a->sampled_at, b->sampled_at, sizeof(unsigned) * g->m);
+        if (g->cch) {
+            memcpy(g->cch->h.up_w, b->cch.h.up_w, sizeof(double) * g->cch->h.m);
+            memcpy(g->cch->h.up_mid, b->cch.h.up_mid, sizeof(int) * g->cch->h.m);
+        }
+        a->traffic_lb = b->traffic_lb;
+    }
+    g->traffic_lb = a->traffic_lb;
+    free(b->traffic_factor); free(b->traffic_km); free(b->sampled_at);
+    free(b->cch.h.up_w); free(b->cch.h.up_mid);
+    pthread_mutex_destroy(&tr->lock);
+    pthread_cond_destroy(&tr->wake);
+    g->refresher = NULL;
+    tr->running = 0;
+}
+
+#else /* _WIN32: no refresher thread; callers fall back to cached weights */
+
+int traffic_refresher_start(TrafficRefresher *tr, Graph *g, int sample_every_n, int ttl_minutes,
+                            int interval_s) {
+    (void)g; (void)sample_every_n; (void)ttl_minutes; (void)interval_s;
+    memset(tr, 0, sizeof(*tr));
+    return 0;
+}
+
+void traffic_refresher_stop(TrafficRefresher *tr) { (void)tr; }
+
+#endif
+
+static double co2_grams(double traffic_km, double car_co2_g_per_km) {
+    return traffic_km * car_co2_g_per_km;
+}
+
+/* -------------------- Indexed binary heap (frontier) -------------------- */
+
+/* Min-heap of node ids keyed by key[node]; pos[node] tracks the heap slot
+   (-1 = not in heap) so decrease-key is O(log n). */
+typedef struct {
+    int *heap;
+    int *pos;
+    double *key;
+    int size;
+} IndexedHeap;
+
+static int iheap_init(IndexedHeap *h, int n) {
+    h->heap = malloc(sizeof(int) * (n > 0 ? n : 1));
+    h->pos = malloc(sizeof(int) * (n > 0 ? n : 1));
+    h->key = malloc(sizeof(double) * (n > 0 ? n : 1));
+    h->size = 0;
+    if (!h->heap || !h->pos || !h->key) {
+        free(h->heap); free(h->pos); free(h->key);
+        return 0;
+    }
+    for (int i = 0; i < n; ++i) h->pos[i] = -1;
+    return 1;
+}
+
+static void iheap_free(IndexedHeap *h) {
+    free(h->heap); free(h->pos); free(h->key);
+    h->heap = h->pos = NULL; h->key = NULL; h->size = 0;
+}
+
+static void iheap_swap(IndexedHeap *h, int a, int b) {
+    int ta = h->heap[a], tb = h->heap[b];
+    h->heap[a] = tb; h->pos[tb] = a;
+    h->heap[b] = ta; h->pos[ta] = b;
+}
+
+static void iheap_sift_up(IndexedHeap *h, int i) {
+    while (i > 0) {
+        int p = (i - 1) / 2;
+        if (h->key[h->heap[p]] <= h->key[h->heap[i]]) break;
+        iheap_swap(h, i, p);
+        i = p;
+    }
+}
+
+static void iheap_sift_down(IndexedHeap *h, int i) {
+    for (;;) {
+        int l = 2*i + 1, r = l + 1, m = i;
+        if (l < h->size && h->key[h->heap[l]] < h->key[h->heap[m]]) m = l;
+        if (r < h->size && h->key[h->heap[r]] < h->key[h->heap[m]]) m = r;
+        if (m == i) break;
+        iheap_swap(h, i, m);
+        i = m;
+    }
+}
+
+/* Insert v with key k, or lower its key if already queued */
+static void iheap_push_or_decrease(IndexedHeap *h, int v, double k) {
+    if (h->pos[v] < 0) {
+        h->heap[h->size] = v;
+        h->pos[v] = h->size++;
+    } else if (k >= h->key[v]) {
+        return;
     }
+    h->key[v] = k;
+    iheap_sift_up(h, h->pos[v]);
+}
+
+static int iheap_pop_min(IndexedHeap *h) {
+    if (h->size == 0) return -1;
+    int top = h->heap[0];
+    h->size--;
+    if (h->size > 0) {
+        h->heap[0] = h->heap[h->size];
+        h->pos[h->heap[0]] = 0;
+        iheap_sift_down(h, 0);
+    }
+    h->pos[top] = -1;
+    return top;
+}
+
+/* Empty the heap in O(size) so it can be reused */
+static void iheap_clear(IndexedHeap *h) {
+    for (int i = 0; i < h->size; ++i) h->pos[h->heap[i]] = -1;
+    h->size = 0;
+}
+
+/* -------------------- Query workspace -------------------- */
+
+/* Everything one search needs, allocated once and reused: keep one per
+   thread and pass it to dijkstra_ws(). Starting a search bumps the epoch
+   instead of resetting n entries, so a short query costs what it touches,
+   not O(n). */
+typedef struct {
+    int settled;   /* nodes removed from the frontier */
+} SearchStats;
+
+typedef struct {
+    int cap;                 /* nodes the buffers can hold */
+    unsigned epoch;
+    SearchStats stats;       /* of the last search on this workspace */
+    DijkNode *side[2];       /* forward / backward search state */
+    IndexedHeap pq[2];
+    ChWorkspace ch;
+} QueryWorkspace;
+
+void qws_free(QueryWorkspace *ws) {
+    for (int d = 0; d < 2; ++d) {
+        free(ws->side[d]);
+        if (ws->pq[d].heap) iheap_free(&ws->pq[d]);
+    }
+    if (ws->ch.dist[0]) ch_workspace_free(&ws->ch);
+    memset(ws, 0, sizeof(*ws));
+}
+
+/* Make room for an n-node graph; returns 0 on allocation failure */
+int qws_reserve(QueryWorkspace *ws, int n) {
+    if (n <= ws->cap) return 1;
+    qws_free(ws);
+    for (int d = 0; d < 2; ++d) {
+        ws->side[d] = calloc(n, sizeof(DijkNode));
+        if (!ws->side[d] || !iheap_init(&ws->pq[d], n)) { qws_free(ws); return 0; }
+    }
+    if (!ch_workspace_init(&ws->ch, n)) { qws_free(ws); return 0; }
+    ws->cap = n;
+    ws->epoch = 0;
+    return 1;
+}
+
+/* Invalidate all node state from the previous search */
+static void qws_begin(QueryWorkspace *ws) {
+    if (++ws->epoch == 0) {
+        for (int d = 0; d < 2; ++d) memset(ws->side[d], 0, sizeof(DijkNode) * ws->cap);
+        ws->epoch = 1;
+    }
+    iheap_clear(&ws->pq[0]);
+    iheap_clear(&ws->pq[1]);
+}
+
+/* State of v on one side, lazily reset on first touch in this search */
+static DijkNode *qws_node(QueryWorkspace *ws, int side, int v) {
+    DijkNode *x = &ws->side[side][v];
+    if (x->stamp != ws->epoch) {
+        x->stamp = ws->epoch;
+        x->dist = INF; x->pot = -1.0; x->prev = -1; x->visited = 0;
+    }
+    return x;
+}
+
+/* -------------------- Dijkstra (min traffic-weighted km = min CO2) -------------------- */
+
+/* src -> dst path of the forward tree of the last search; 0 if dst was not
+   reached or the path is too long */
+static int qws_forward_path(QueryWorkspace *ws, int dst, int *out_path, int *out_len, double *out_cost) {
+    DijkNode *nodes = ws->side[0];
+    if (qws_node(ws, 0, dst)->dist >= INF/2) return 0;
+    int len = 0;
+    for (int cur = dst; cur != -1; cur = nodes[cur].prev) len++;
+    if (len > MAX_PATH_NODES) return 0;
+    int k = len;
+    for (int cur = dst; cur != -1; cur = nodes[cur].prev) out_path[--k] = cur;
+    *out_len = len;
+    *out_cost = nodes[dst].dist;
+    return 1;
 }
 
-/* -------------------- Apply CO2 weights -------------------- */
+/* Search used by dijkstra(): HEAP is the default O((n+m) log n) queue,
+   DENSE is the original O(n) linear scan per pop, kept for benchmarking,
+   ASTAR is the heap search guided by haversine_km(node, dst) * traffic_lb,
+   BIDIR grows a forward ball from src and a backward ball from dst,
+   CCH runs an upward query on the customized hierarchy (g->cch). */
+typedef enum { DIJKSTRA_HEAP = 0, DIJKSTRA_DENSE = 1, DIJKSTRA_ASTAR = 2, DIJKSTRA_BIDIR = 3,
+               DIJKSTRA_CCH = 4 } DijkstraMode;
+#define DIJKSTRA_MODE_COUNT 5
+static DijkstraMode dijkstra_mode = DIJKSTRA_HEAP;
+
+void set_dijkstra_mode(DijkstraMode mode) { dijkstra_mode = mode; }
+
+static const char *dijkstra_mode_names[] = { "heap", "dense", "astar", "bidir", "cch" };
+
+/* ECO_SEARCH=heap|dense|astar|bidir|cch overrides the given default mode */
+static void dijkstra_mode_from_env(DijkstraMode fallback) {
+    const char *m = getenv("ECO_SEARCH");
+    dijkstra_mode = fallback;
+    if (!m) return;
+    if (strcasecmp(m, "dijkstra") == 0) { dijkstra_mode = DIJKSTRA_HEAP; return; }
+    for (int i = 0; i < DIJKSTRA_MODE_COUNT; ++i)
+        if (strcasecmp(m, dijkstra_mode_names[i]) == 0) dijkstra_mode = (DijkstraMode)i;
+}
+
+/* Counters of the most recent dijkstra() call (default workspace) */
+SearchStats dijkstra_stats;
 
-void apply_co2_weights(Graph *g, double car_co2_g_per_km) {
+static void dijkstra_dense(Graph *g, QueryWorkspace *ws, int dst) {
     int n = g->n;
-    for (int i = 0; i < n; ++i) {
-        for (int j = 0; j < n; ++j) {
-            Edge *e = &g->edges[i*n + j];
-            if (e->v >= 0) {
-                e->co2_cost = e->distance_km * e->traffic_factor * car_co2_g_per_km;
-            } else e->co2_cost = 0.0;
+    for (;;) {
+        int u = -1; double best = INF;
+        for (int i = 0; i < n; ++i) {
+            DijkNode *x = qws_node(ws, 0, i);
+            if (!x->visited && x->dist < best) { best = x->dist; u = i; }
+        }
+        if (u == -1) break;
+        ws->stats.settled++;
+        if (u == dst) break;
+        DijkNode *nu = qws_node(ws, 0, u);
+        nu->visited = 1;
+        for (int a = g->offsets[u]; a < g->offsets[u+1]; ++a) {
+            DijkNode *nv = qws_node(ws, 0, g->neighbour[a]);
+            if (!nv->visited) {
+                double alt = nu->dist + g->traffic_km[a];
+                if (alt < nv->dist) { nv->dist = alt; nv->prev = u; }
+            }
         }
     }
 }
 
-/* -------------------- Dijkstra (min CO2) -------------------- */
+/* Heap search; with astar the key is dist + potential, where the potential
+   (straight-line km to dst times traffic_lb) never overestimates and is
+   consistent, so the first time dst is popped its dist is optimal. */
+static void dijkstra_heap(Graph *g, QueryWorkspace *ws, int src, int dst, int astar) {
+    IndexedHeap *pq = &ws->pq[0];
+    iheap_push_or_decrease(pq, src, 0.0);
+    for (;;) {
+        int u = iheap_pop_min(pq);
+        if (u == -1) break;
+        ws->stats.settled++;
+        if (u == dst) break;
+        DijkNode *nu = qws_node(ws, 0, u);
+        nu->visited = 1;
+        for (int a = g->offsets[u]; a < g->offsets[u+1]; ++a) {
+            int v = g->neighbour[a];
+            DijkNode *nv = qws_node(ws, 0, v);
+            if (!nv->visited) {
+                double alt = nu->dist + g->traffic_km[a];
+                if (alt < nv->dist) {
+                    nv->dist = alt; nv->prev = u;
+                    double key = alt;
+                    if (astar) {
+                        if (nv->pot < 0)
+                            nv->pot = haversine_km(g->cities[v].lat, g->cities[v].lon,
+                                                   g->cities[dst].lat, g->cities[dst].lon)
+                                      * g->traffic_lb * (1.0 - 1e-12);
+                        key += nv->pot;
+                    }
+                    iheap_push_or_decrease(pq, v, key);
+                }
+            }
+        }
+    }
+}
+
+/* Bidirectional search: side 0 grows from src over arcs u->v, side 1 grows
+   from dst over reversed arcs (its prev is v's successor towards dst).
+   mu is the best src->dst cost seen through any node reached by both
+   sides; once the two frontier minima sum to at least mu no shorter
+   connection can appear. Returns the meeting node, or -1 if unreachable. */
+static int dijkstra_bidir(Graph *g, QueryWorkspace *ws, int src, int dst, double *out_mu) {
+    qws_node(ws, 1, dst)->dist = 0.0;
+    iheap_push_or_decrease(&ws->pq[0], src, 0.0);
+    iheap_push_or_decrease(&ws->pq[1], dst, 0.0);
+    double mu = (src == dst) ? 0.0 : INF;
+    int meet = (src == dst) ? src : -1;
+
+    while (ws->pq[0].size > 0 && ws->pq[1].size > 0) {
+        IndexedHeap *pq = ws->pq;
+        double top0 = pq[0].key[pq[0].heap[0]], top1 = pq[1].key[pq[1].heap[0]];
+        if (top0 + top1 >= mu) break;
+        int d = (top0 <= top1) ? 0 : 1;
+        int u = iheap_pop_min(&pq[d]);
+        ws->stats.settled++;
+        DijkNode *nu = qws_node(ws, d, u);
+        nu->visited = 1;
+        for (int a = g->offsets[u]; a < g->offsets[u+1]; ++a) {
+            int v = g->neighbour[a];
+            DijkNode *nv = qws_node(ws, d, v);
+            if (nv->visited) continue;
+            double c = (d == 0) ? g->traffic_km[a] : g->traffic_km[g->reverse_arc[a]];
+            double alt = nu->dist + c;
+            if (alt < nv->dist) {
+                nv->dist = alt; nv->prev = u;
+                iheap_push_or_decrease(&pq[d], v, alt);
+            }
+            DijkNode *ov = qws_node(ws, 1 - d, v);
+            if (ov->dist < INF/2 && nv->dist + ov->dist < mu) {
+                mu = nv->dist + ov->dist;
+                meet = v;
+            }
+        }
+    }
+    *out_mu = mu;
+    return meet;
+}
+
+/* CCH mode; the hierarchy is contracted and customized on first use */
+static int dijkstra_cch(Graph *g, QueryWorkspace *ws, int src, int dst,
+                        int *out_path, int *out_len, double *out_cost) {
+    if (!g->cch) { graph_prepare_cch(g); graph_customize_cch(g); }
+    double c = ch_query(&g->cch->h, &ws->ch, src, dst, out_path, out_len, MAX_PATH_NODES);
+    ws->stats.settled = ws->ch.settled;
+    if (c >= CH_INF) return 0;
+    *out_cost = c;
+    return 1;
+}
 
+/* Min-CO2 route src..dst using the caller's workspace (one per thread).
+   *out_cost is in traffic-weighted km, valid for every car:
+   co2_grams(*out_cost, g_per_km) gives that car's emissions. */
+int dijkstra_ws(Graph *g, QueryWorkspace *ws, int src, int dst,
+                int *out_path, int *out_len, double *out_cost) {
+    if (!qws_reserve(ws, g->n)) { perror("malloc"); return 0; }
+    ws->stats.settled = 0;
+    if (dijkstra_mode == DIJKSTRA_CCH) return dijkstra_cch(g, ws, src, dst, out_path, out_len, out_cost);
+    qws_begin(ws);
+    qws_node(ws, 0, src)->dist = 0.0;
+
+    if (dijkstra_mode == DIJKSTRA_BIDIR) {
+        double mu = INF;
+        int meet = dijkstra_bidir(g, ws, src, dst, &mu);
+        if (meet < 0) return 0;
+        DijkNode *fwd = ws->side[0], *bwd = ws->side[1];
+        int fl = 0, bl = 0;
+        for (int cur = meet; cur != -1; cur = fwd[cur].prev) fl++;
+        for (int cur = bwd[meet].prev; cur != -1; cur = bwd[cur].prev) bl++;
+        if (fl + bl > MAX_PATH_NODES) return 0;
+        int k = fl;
+        for (int cur = meet; cur != -1; cur = fwd[cur].prev) out_path[--k] = cur;
+        k = fl;
+        for (int cur = bwd[meet].prev; cur != -1; cur = bwd[cur].prev) out_path[k++] = cur;
+        *out_len = fl + bl;
+        *out_cost = mu;
+        return 1;
+    }
+
+    if (dijkstra_mode == DIJKSTRA_DENSE) dijkstra_dense(g, ws, dst);
+    else dijkstra_heap(g, ws, src, dst, dijkstra_mode == DIJKSTRA_ASTAR);
+    return qws_forward_path(ws, dst, out_path, out_len, out_cost);
+}
+
+/* Workspace behind dijkstra(); lives for the whole process */
+static QueryWorkspace default_ws;
+
+/* dijkstra_ws() on a shared workspace, for single-threaded callers */
 int dijkstra(Graph *g, int src, int dst, int *out_path, int *out_len, double *out_cost) {
-    int n = g->n;
-    DijkNode *nodes = malloc(sizeof(DijkNode) * n);
-    if (!nodes) { perror("malloc"); return 0; }
-    for (int i = 0; i < n; ++i) { nodes[i].dist = INF; nodes[i].prev = -1; nodes[i].visited = 0; }
-    nodes[src].dist = 0.0;
+    int ok = dijkstra_ws(g, &default_ws, src, dst, out_path, out_len, out_cost);
+    dijkstra_stats = default_ws.stats;
+    return ok;
+}
 
+/* Time-dependent search for a departure at depart_s seconds after local
+   midnight: each arc costs distance_km * profile_arc_factor() at the time
+   the car reaches its tail. Car time is traffic_km / CAR_FREEFLOW_KMPH, so
+   a node's dist also gives its arrival time, and minimising CO2 is
+   minimising travel time: arcs are FIFO by construction, so label setting
+   is exact. Uses A* on
+   traffic_lb, which bounds profile factors as well (both >= 1 or the
+   live minimum). Ignores the hierarchy, whose metric is one instant. */
+int dijkstra_td(Graph *g, QueryWorkspace *ws, int src, int dst, double depart_s,
+                int *out_path, int *out_len, double *out_cost) {
+    if (!qws_reserve(ws, g->n)) { perror("malloc"); return 0; }
+    qws_begin(ws);
+    ws->stats.settled = 0;
+    qws_node(ws, 0, src)->dist = 0.0;
+    IndexedHeap *pq = &ws->pq[0];
+    iheap_push_or_decrease(pq, src, 0.0);
+    const double s_per_km = 3600.0 / CAR_FREEFLOW_KMPH;
     for (;;) {
-        int u = -1; double best = INF;
-        for (int i = 0; i < n; ++i) if (!nodes[i].visited && nodes[i].dist < best) { best = nodes[i].dist; u = i; }
+        int u = iheap_pop_min(pq);
         if (u == -1) break;
+        ws->stats.settled++;
         if (u == dst) break;
-        nodes[u].visited = 1;
-        for (int v = 0; v < n; ++v) {
-            Edge *e = &g->edges[u*n + v];
-            if (e->v >= 0 && !nodes[v].visited) {
-                double alt = nodes[u].dist + e->co2_cost;
-                if (alt < nodes[v].dist) { nodes[v].dist = alt; nodes[v].prev = u; }
+        DijkNode *nu = qws_node(ws, 0, u);
+        nu->visited = 1;
+        double t = depart_s + nu->dist * s_per_km;
+        for (int a = g->offsets[u]; a < g->offsets[u+1]; ++a) {
+            int v = g->neighbour[a];
+            DijkNode *nv = qws_node(ws, 0, v);
+            if (nv->visited) continue;
+            double alt = nu->dist + g->distance_km[a] * profile_arc_factor(g, a, t);
+            if (alt < nv->dist) {
+                nv->dist = alt; nv->prev = u;
+                if (nv->pot < 0)
+                    nv->pot = haversine_km(g->cities[v].lat, g->cities[v].lon,
+                                           g->cities[dst].lat, g->cities[dst].lon)
+                              * g->traffic_lb * (1.0 - 1e-12);
+                iheap_push_or_decrease(pq, v, alt + nv->pot);
             }
         }
     }
+    return qws_forward_path(ws, dst, out_path, out_len, out_cost);
+}
 
-    if (nodes[dst].dist >= INF/2) { free(nodes); return 0; }
+/* Minutes by car over d km at a traffic factor (slower in traffic, >= 5 km/h) */
+static double segment_car_min(double d, double factor) {
+    double car_speed = CAR_FREEFLOW_KMPH / factor;
+    if (car_speed < 5) car_speed = 5;
+    return (d / car_speed) * 60;
+}
 
-    int tmp[1024];
-    int k = 0;
-    int cur = dst;
-    while (cur != -1 && k < 1024) {
-        tmp[k++] = cur;
-        cur = nodes[cur].prev;
+/* Road length and car minutes along a path of the graph */
+void route_totals(const Graph *g, const int *path, int len, double *out_km, double *out_car_min) {
+    double km = 0, car_min = 0;
+    for (int i = 0; i + 1 < len; ++i) {
+        int a = graph_find_arc(g, path[i], path[i+1]);
+        if (a < 0) continue;
+        km += g->distance_km[a];
+        car_min += segment_car_min(g->distance_km[a], g->traffic_factor[a]);
     }
-    int len = k;
-    for (int i = 0; i < len; ++i) out_path[i] = tmp[len - 1 - i];
-    *out_len = len;
-    *out_cost = nodes[dst].dist;
-    free(nodes);
+    *out_km = km;
+    *out_car_min = car_min;
+}
+
+/* route_totals() for a departure at depart_s seconds after local midnight,
+   each road at the factor of the time the car reaches it */
+void route_totals_td(const Graph *g, const int *path, int len, double depart_s,
+                     double *out_km, double *out_car_min) {
+    double km = 0, car_min = 0;
+    for (int i = 0; i + 1 < len; ++i) {
+        int a = graph_find_arc(g, path[i], path[i+1]);
+        if (a < 0) continue;
+        km += g->distance_km[a];
+        car_min += segment_car_min(g->distance_km[a], profile_arc_factor(g, a, depart_s + car_min * 60.0));
+    }
+    *out_km = km;
+    *out_car_min = car_min;
+}
+
+/* Seconds after midnight of "HH:MM"; -1 if s is not a valid time */
+int parse_clock_time(const char *s) {
+    int h, m;
+    char extra;
+    if (sscanf(s, "%d:%d %c", &h, &m, &extra) != 2 || h < 0 || h > 23 || m < 0 || m > 59) return -1;
+    return h * 3600 + m * 60;
+}
+
+/* Index of a city by case-insensitive name, -1 if absent */
+int find_city(const City *cities, int n, const char *name) {
+    for (int i = 0; i < n; ++i) if (strcasecmp(cities[i].name, name) == 0) return i;
+    return -1;
+}
+
+/* Index of a car model by case-insensitive name, -1 if absent */
+int find_car_model(const CarModel *cars, int n, const char *name) {
+    for (int i = 0; i < n; ++i) if (strcasecmp(cars[i].name, name) == 0) return i;
+    return -1;
+}
+
+/* -------------------- Best departure (profile search) -------------------- */
+
+/* One search for every departure in a window [t0, t1]: a node's label is
+   the piecewise-linear function "traffic_km to reach it" over departure
+   time. Crossing arc a maps f(t) to f(t) + distance_km * F_a(t + f(t) *
+   3600 / CAR_FREEFLOW_KMPH), where F_a is the FIFO arc factor of
+   profile_arc_factor(), piecewise linear in the entry time; the result is
+   again piecewise linear, with extra breakpoints where the entry time
+   passes one of F_a's. Labels merge
+   by their lower envelope. The search is label correcting: a node goes
+   back on the queue, keyed by the minimum of its function plus the A*
+   potential, whenever its function improves anywhere, and the search ends
+   once that key reaches the maximum of the target's function. */
+
+#ifndef PWL_REL_EPS
+#define PWL_REL_EPS 0.0            /* relative breakpoint merge tolerance of profile labels */
+#endif
+
+typedef struct { double t, c; } PwlPoint;
+typedef struct { PwlPoint *p; int n, cap; } PwlFn;   /* sorted by t */
+
+void pwl_free(PwlFn *f) {
+    free(f->p);
+    memset(f, 0, sizeof(*f));
+}
+
+static int pwl_push(PwlFn *f, double t, double c) {
+    if (f->n > 0 && t <= f->p[f->n-1].t) {     /* same instant after rounding: keep the lower */
+        if (c < f->p[f->n-1].c) f->p[f->n-1].c = c;
+        return 1;
+    }
+    if (f->n == f->cap) {
+        int cap = f->cap ? f->cap * 2 : 8;
+        PwlPoint *np = realloc(f->p, sizeof(PwlPoint) * cap);
+        if (!np) return 0;
+        f->p = np; f->cap = cap;
+    }
+    f->p[f->n].t = t; f->p[f->n].c = c;
+    f->n++;
+    return 1;
+}
+
+/* Value at t of a profile_search() curve, constant beyond the end points */
+double pwl_eval(const PwlFn *f, double t) {
+    if (t <= f->p[0].t) return f->p[0].c;
+    if (t >= f->p[f->n-1].t) return f->p[f->n-1].c;
+    int lo = 0, hi = f->n - 1;
+    while (hi - lo > 1) {
+        int mid = (lo + hi) / 2;
+        if (f->p[mid].t <= t) lo = mid; else hi = mid;
+    }
+    const PwlPoint *x = &f->p[lo], *y = &f->p[hi];
+    return x->c + (y->c - x->c) * (t - x->t) / (y->t - x->t);
+}
+
+/* Value at t where i is the first breakpoint at or after t (f->n if none) */
+static double pwl_at(const PwlFn *f, int i, double t) {
+    if (i >= f->n) return f->p[f->n-1].c;
+    if (i == 0 || f->p[i].t == t) return f->p[i].c;
+    const PwlPoint *x = &f->p[i-1], *y = &f->p[i];
+    return x->c + (y->c - x->c) * (t - x->t) / (y->t - x->t);
+}
+
+/* Drop breakpoints while the function moves down by at most a factor
+   PWL_REL_EPS and never up (beyond rounding): each kept segment x..z must
+   pass within [c (1 - eps), c] of every point it replaces. Keeping the
+   error one-sided means labels only ever decrease, so the search still
+   converges; a label under-estimates by at most about eps per road. */
+static void pwl_simplify(PwlFn *f) {
+    if (f->n < 3) return;
+    int k = 1, x = 0;                    /* p[x] = last kept point */
+    double lo = -INF, hi = INF;          /* slopes from p[x] the dropped points allow */
+    for (int i = 1; i < f->n; ++i) {
+        const PwlPoint *px = &f->p[x], *z = &f->p[i];
+        double s = (z->c - px->c) / (z->t - px->t);
+        if (s < lo || s > hi) {          /* p[i-1] must stay */
+            f->p[k++] = f->p[i-1];
+            x = i - 1;
+            px = &f->p[x];
+            lo = -INF; hi = INF;
+        }
+        if (i + 1 == f->n) break;
+        double dt = z->t - px->t, tol = 1e-9 * (1.0 + fabs(z->c));
+        double l = (z->c * (1.0 - PWL_REL_EPS) - tol - px->c) / dt, h = (z->c + tol - px->c) / dt;
+        if (l > lo) lo = l;
+        if (h < hi) hi = h;
+    }
+    f->p[k++] = f->p[f->n-1];
+    f->n = k;
+}
+
+static int pwl_reserve(PwlFn *f, int n) {
+    if (n <= f->cap) return 1;
+    PwlPoint *np = realloc(f->p, sizeof(PwlPoint) * n);
+    if (!np) return 0;
+    f->p = np; f->cap = n;
+    return 1;
+}
+
+/* *h = distance_km * profile_arc_factor() of arc a over entry times
+   [x0, x1]. Arrival is linear between bucket centres; its lower envelope
+   from the right adds at most one breakpoint per bucket, where a rising
+   stretch meets the best later arrival. raw is scratch. */
+static int pwl_arc(const Graph *g, int a, double x0, double x1, PwlFn *h, PwlFn *raw) {
+    const double s_per_km = 3600.0 / CAR_FREEFLOW_KMPH, bs = PROFILE_BUCKET_S;
+    double d = g->distance_km[a], x = x1;
+    raw->n = 0;
+    if (!pwl_push(raw, x0, x0 + d * profile_factor(g, a, x0) * s_per_km)) return 0;
+    if (g->profile)
+        for (x = (floor(x0 / bs - 0.5) + 1.5) * bs; x < x1; x += bs)
+            if (!pwl_push(raw, x, x + d * profile_factor(g, a, x) * s_per_km)) return 0;
+    if (x1 > x0 && !pwl_push(raw, x1, x1 + d * profile_factor(g, a, x1) * s_per_km)) return 0;
+    double m = raw->p[raw->n-1].c;                /* earliest arrival entering at or after x1 */
+    if (g->profile)
+        for (x += x <= x1 ? bs : 0; x < m; x += bs) {
+            double arr = x + d * profile_factor(g, a, x) * s_per_km;
+            if (arr < m) m = arr;
+        }
+    int n = raw->n, w = 2 * n;
+    if (!pwl_reserve(h, w)) return 0;
+    for (int i = n - 1; i >= 0; --i) {
+        const PwlPoint *p = &raw->p[i];
+        if (i + 1 < n && p->c < m && p[1].c > m) {
+            double xk = p->t + (m - p->c) / (p[1].c - p->c) * (p[1].t - p->t);
+            h->p[--w] = (PwlPoint){ xk, (m - xk) / s_per_km };
+        }
+        if (p->c < m) m = p->c;
+        h->p[--w] = (PwlPoint){ p->t, (m - p->t) / s_per_km };
+    }
+    h->n = 2 * n - w;
+    memmove(h->p, h->p + w, sizeof(PwlPoint) * h->n);
+    return 1;
+}
+
+/* out = f followed by arc a, as a function of the departure time. f is
+   FIFO, so the time of reaching the arc is nondecreasing along f and the
+   arc's function composes breakpoint by breakpoint. arc is scratch. */
+static int pwl_link(const Graph *g, int a, const PwlFn *f, PwlFn *out, PwlFn *arc) {
+    const double s_per_km = 3600.0 / CAR_FREEFLOW_KMPH;
+    double x0 = f->p[0].t + f->p[0].c * s_per_km, x1 = x0;
+    for (int i = 1; i < f->n; ++i) {
+        double x = f->p[i].t + f->p[i].c * s_per_km;
+        if (x > x1) x1 = x;
+    }
+    if (!pwl_arc(g, a, x0, x1, arc, out)) return 0;
+    out->n = 0;
+    int j = 0;
+    for (int i = 0; i < f->n; ++i) {
+        double t = f->p[i].t, c = f->p[i].c, x = t + c * s_per_km;
+        while (j < arc->n && arc->p[j].t < x) j++;
+        if (!pwl_push(out, t, c + pwl_at(arc, j, x))) return 0;
+        if (i + 1 == f->n) continue;
+        double t1 = f->p[i+1].t, c1 = f->p[i+1].c, xn = t1 + c1 * s_per_km;
+        for (int k = j; k < arc->n && arc->p[k].t < xn; ++k) {
+            if (arc->p[k].t <= x) continue;
+            double w = (arc->p[k].t - x) / (xn - x);
+            if (!pwl_push(out, t + w * (t1 - t), c + w * (c1 - c) + arc->p[k].c)) return 0;
+        }
+    }
+    pwl_simplify(out);
     return 1;
 }
 
+/* out = lower envelope of f (may be empty: no label yet) and h, both over
+   the same window; *gain is the least value of h where it is below f, INF
+   if nowhere */
+static int pwl_min(const PwlFn *f, const PwlFn *h, PwlFn *out, double *gain) {
+    out->n = 0;
+    *gain = INF;
+    if (f->n == 0) {
+        for (int i = 0; i < h->n; ++i) {
+            if (!pwl_push(out, h->p[i].t, h->p[i].c)) return 0;
+            if (h->p[i].c < *gain) *gain = h->p[i].c;
+        }
+        return 1;
+    }
+    int i = 0, j = 0;
+    double tp = 0, dp = 0, vp = 0;
+    for (int first = 1; i < f->n || j < h->n; first = 0) {
+        double t = j >= h->n || (i < f->n && f->p[i].t <= h->p[j].t) ? f->p[i].t : h->p[j].t;
+        double v = pwl_at(f, i, t), w = pwl_at(h, j, t), diff = v - w;
+        while (i < f->n && f->p[i].t <= t) i++;
+        while (j < h->n && h->p[j].t <= t) j++;
+        if (!first && ((dp < 0 && diff > 0) || (dp > 0 && diff < 0))) {
+            double s = dp / (dp - diff), tx = tp + s * (t - tp), cx = vp + s * (v - vp);
+            if (!pwl_push(out, tx, cx)) return 0;
+            if (cx < *gain) *gain = cx;
+        }
+        if (w < v - 1e-9 * (1.0 + v) && w < *gain) *gain = w;
+        if (!pwl_push(out, t, v < w ? v : w)) return 0;
+        tp = t; dp = diff; vp = v;
+    }
+    pwl_simplify(out);
+    return 1;
+}
+
+/* h + off >= f at every departure of the window: h cannot improve on f
+   anywhere. Both are linear between breakpoints, so the union of their
+   breakpoints is enough to check. */
+static int pwl_dominated(const PwlFn *h, double off, const PwlFn *f) {
+    if (f->n == 0) return 0;
+    int i = 0, j = 0;
+    while (i < f->n || j < h->n) {
+        double t = j >= h->n || (i < f->n && f->p[i].t <= h->p[j].t) ? f->p[i].t : h->p[j].t;
+        double v = pwl_at(f, i, t), w = pwl_at(h, j, t) + off;
+        if (w < v - 1e-9 * (1.0 + v)) return 0;
+        while (i < f->n && f->p[i].t <= t) i++;
+        while (j < h->n && h->p[j].t <= t) j++;
+    }
+    return 1;
+}
+
+/* Cost (traffic_km) of src -> dst for each departure in [t0, t1], seconds
+   after local midnight (t1 may pass midnight), as a curve in *curve, and
+   its minimum. Departures are evaluated on the time-of-day profiles, or on
+   the live factors where there are none. Returns 0 if dst is unreachable
+   or memory runs out. */
+int profile_search(Graph *g, QueryWorkspace *ws, int src, int dst, double t0, double t1,
+                   PwlFn *curve, double *out_best_t, double *out_best_cost) {
+    if (!qws_reserve(ws, g->n)) { perror("malloc"); return 0; }
+    qws_begin(ws);
+    ws->stats.settled = 0;
+    memset(curve, 0, sizeof(*curve));
+    PwlFn *lab = calloc(g->n, sizeof(PwlFn));
+    PwlFn link = {0}, merged = {0}, arc = {0};
+    if (!lab || !pwl_push(&lab[src], t0, 0.0) || (t1 > t0 && !pwl_push(&lab[src], t1, 0.0))) {
+        free(lab ? lab[src].p : NULL); free(lab);
+        return 0;
+    }
+    /* Seed dst with the cost over the window of the routes that are best
+       when leaving at t0 and at t1: from the first pop on, the search then
+       prunes labels that cannot beat them at any departure */
+    int ok = 1;
+    double bound = INF;                          /* max of dst's label */
+    int *path = malloc(sizeof(int) * MAX_PATH_NODES), len = 0;
+    double c;
+    for (int e = 0; e < 2 && path && ok; ++e) {
+        if (!dijkstra_td(g, ws, src, dst, e ? t1 : t0, path, &len, &c)) break;
+        PwlFn along = {0}, step = {0};
+        ok = pwl_push(&along, t0, 0.0) && (t1 <= t0 || pwl_push(&along, t1, 0.0));
+        for (int i = 0; ok && i + 1 < len; ++i) {
+            ok = pwl_link(g, graph_find_arc(g, path[i], path[i+1]), &along, &step, &arc);
+            PwlFn t = along; along = step; step = t;
+        }
+        double gain;
+        ok = ok && pwl_min(&lab[dst], &along, &step, &gain);
+        if (ok) { PwlFn t = lab[dst]; lab[dst] = step; step = t; }
+        free(along.p); free(step.p);
+    }
+    free(path);
+    if (lab[dst].n > 0) {
+        bound = 0;
+        for (int i = 0; i < lab[dst].n; ++i) if (lab[dst].p[i].c > bound) bound = lab[dst].p[i].c;
+    }
+    qws_begin(ws);                               /* the seeding searches used ws */
+    ws->stats.settled = 0;
+    /* A* potential: km to dst at traffic_lb over the roads, by a backward
+       search that stops at the bound. A node it leaves unsettled is at
+       least bound away and cannot improve dst's label. */
+    IndexedHeap *bq = &ws->pq[1];
+    qws_node(ws, 1, dst)->dist = 0.0;
+    iheap_push_or_decrease(bq, dst, 0.0);
+    for (;;) {
+        int v = iheap_pop_min(bq);
+        if (v == -1) break;
+        DijkNode *bv = qws_node(ws, 1, v);
+        if (bv->dist >= bound) break;
+        bv->visited = 1;
+        for (int a = g->offsets[v]; a < g->offsets[v+1]; ++a) {
+            int w = g->neighbour[a];
+            DijkNode *bw = qws_node(ws, 1, w);
+            double alt = bv->dist + g->distance_km[g->reverse_arc[a]] * g->traffic_lb;
+            if (!bw->visited && alt < bw->dist) {
+                bw->dist = alt;
+                iheap_push_or_decrease(bq, w, alt);
+            }
+        }
+    }
+    /* A node is queued by the least cost (plus potential) at which its label
+       improved since it was last expanded, not by the least of the whole
+       label: a later gain at rush hour then waits its turn instead of
+       re-expanding the node at off-peak priority. dist holds that key. */
+    IndexedHeap *pq = &ws->pq[0];
+    qws_node(ws, 0, src)->dist = 0.0;
+    iheap_push_or_decrease(pq, src, 0.0);
+    while (ok) {
+        int u = iheap_pop_min(pq);
+        if (u == -1) break;
+        DijkNode *nu = qws_node(ws, 0, u);
+        double key = nu->dist, umin = INF;
+        nu->dist = INF;
+        if (key >= bound) break;
+        for (int i = 0; i < lab[u].n; ++i) if (lab[u].p[i].c < umin) umin = lab[u].p[i].c;
+        ws->stats.settled++;
+        for (int a = g->offsets[u]; a < g->offsets[u+1] && ok; ++a) {
+            int v = g->neighbour[a];
+            DijkNode *nv = qws_node(ws, 0, v);
+            if (nv->pot < 0) {
+                const DijkNode *bv = qws_node(ws, 1, v);
+                nv->pot = bv->visited ? bv->dist * (1.0 - 1e-12) : bound;
+            }
+            if (umin + g->distance_km[a] * g->traffic_lb + nv->pot >= bound) continue;
+            if (!(ok = pwl_link(g, a, &lab[u], &link, &arc))) break;
+            /* no departure of the window reaches dst this way sooner */
+            if (v != dst && pwl_dominated(&link, nv->pot, &lab[dst])) continue;
+            double gain;
+            ok = pwl_min(&lab[v], &link, &merged, &gain);
+            if (!ok || gain >= INF) continue;
+            PwlFn t = lab[v]; lab[v] = merged; merged = t;
+            if (v == dst) {
+                bound = 0;
+                for (int i = 0; i < lab[v].n; ++i) if (lab[v].p[i].c > bound) bound = lab[v].p[i].c;
+                continue;
+            }
+            if (gain + nv->pot < bound && gain + nv->pot < nv->dist) {
+                nv->dist = gain + nv->pot;
+                iheap_push_or_decrease(pq, v, nv->dist);
+            }
+        }
+    }
+    ok = ok && lab[dst].n > 0;
+    if (ok) {
+        *curve = lab[dst];
+        memset(&lab[dst], 0, sizeof(PwlFn));
+        int best = 0;
+        for (int i = 1; i < curve->n; ++i) if (curve->p[i].c < curve->p[best].c) best = i;
+        *out_best_t = curve->p[best].t;
+        *out_best_cost = curve->p[best].c;
+    }
+    for (int v = 0; v < g->n; ++v) free(lab[v].p);
+    free(lab); free(link.p); free(merged.p); free(arc.p);
+    return ok;
+}
+
+/* -------------------- Many-to-many matrix -------------------- */
+
+/* out[i*nt + j] = min traffic-weighted km from src[i] to dst[j] (INF if
+   unreachable); co2_grams() turns an entry into any car's grams. Runs on
+   the customized hierarchy, preparing it first if the graph has none, so
+   the whole matrix costs about ns + nt upward searches. Returns 0 on
+   allocation failure. */
+int graph_matrix(Graph *g, QueryWorkspace *ws, const int *src, int ns, const int *dst, int nt,
+                 double *out) {
+    if (!g->cch) { graph_prepare_cch(g); graph_customize_cch(g); }
+    if (!qws_reserve(ws, g->n)) return 0;
+    int ok = ch_many_to_many(&g->cch->h, &ws->ch, src, ns, dst, nt, out);
+    ws->stats.settled = ws->ch.settled;
+    return ok;
+}
+
+/* -------------------- Alternative routes (plateau method) -------------------- */
+
+/* A forward tree from src and a backward tree to dst share "plateaus":
+   chains of roads that lie on both, i.e. u = prev_fwd(v) and v =
+   next_bwd(u). Every plateau a..b yields the route src ~> a (forward
+   tree), a..b, b ~> dst (backward tree). A long plateau means that much
+   of the route is itself a shortest path, so the detour is locally
+   optimal rather than a zig-zag. Candidates are taken cheapest first and
+   kept when they pass these filters:
+   - stretch: at most ALT_STRETCH more traffic-weighted km than the best;
+   - local optimality: the plateau covers at least ALT_LOCAL_OPT of it;
+   - similarity: at most ALT_MAX_SHARE of it overlaps any route already kept.
+   The two searches stop at (1 + ALT_STRETCH) times the best cost, so the
+   whole run costs about three one-to-one Dijkstra queries. */
+#define ALT_MAX_ROUTES 4           /* best + up to 3 alternatives */
+#define ALT_STRETCH 0.25
+#define ALT_LOCAL_OPT 0.25
+#define ALT_MAX_SHARE 0.70
+
+typedef struct {
+    int *nodes;              /* owned */
+    int len;
+    double traffic_km;       /* search cost; co2_grams() for a car's grams */
+    double shared;           /* fraction overlapping earlier routes (0 for the best) */
+} AltRoute;
+
+void alt_routes_free(AltRoute *r, int n) {
+    for (int i = 0; i < n; ++i) { free(r[i].nodes); r[i].nodes = NULL; }
+}
+
+/* Dijkstra tree from root on one workspace side (1 walks arcs backwards),
+   settling until the frontier passes *limit. Once `stop` is settled,
+   *limit tightens to (1 + ALT_STRETCH) times its cost. Settled nodes are
+   appended to order; returns their count. */
+static int alt_tree(Graph *g, QueryWorkspace *ws, int side, int root, int stop,
+                    double *limit, int *order) {
+    IndexedHeap *pq = &ws->pq[side];
+    int cnt = 0;
+    qws_node(ws, side, root)->dist = 0.0;
+    iheap_push_or_decrease(pq, root, 0.0);
+    while (pq->size > 0 && pq->key[pq->heap[0]] <= *limit) {
+        int u = iheap_pop_min(pq);
+        ws->stats.settled++;
+        DijkNode *nu = qws_node(ws, side, u);
+        nu->visited = 1;
+        order[cnt++] = u;
+        if (u == stop) *limit = nu->dist * (1.0 + ALT_STRETCH);
+        for (int a = g->offsets[u]; a < g->offsets[u+1]; ++a) {
+            int v = g->neighbour[a];
+            DijkNode *nv = qws_node(ws, side, v);
+            if (nv->visited) continue;
+            double alt = nu->dist + g->traffic_km[side ? g->reverse_arc[a] : a];
+            if (alt < nv->dist) { nv->dist = alt; nv->prev = u; iheap_push_or_decrease(pq, v, alt); }
+        }
+    }
+    return cnt;
+}
+
+typedef struct { int a, b; double cost, plateau; } AltPlateau;   /* plateau a..b */
+
+static int cmp_alt_plateau(const void *x, const void *y) {
+    const AltPlateau *p = x, *q = y;
+    return (p->cost > q->cost) - (p->cost < q->cost);
+}
+
+/* Traffic-weighted km of route r's roads already marked in arc_mark */
+static double alt_overlap(const Graph *g, const int *nodes, int len, const unsigned char *arc_mark) {
+    double km = 0;
+    for (int i = 0; i + 1 < len; ++i) {
+        int a = graph_find_arc(g, nodes[i], nodes[i+1]);
+        if (a >= 0 && arc_mark[a]) km += g->traffic_km[a];
+    }
+    return km;
+}
+
+/* Best route plus up to max_routes-1 alternatives, cheapest first. Returns
+   the count (0 if dst is unreachable); free with alt_routes_free(). */
+int alternative_routes(Graph *g, QueryWorkspace *ws, int src, int dst, int max_routes, AltRoute *out) {
+    if (max_routes < 1) return 0;
+    if (max_routes > ALT_MAX_ROUTES) max_routes = ALT_MAX_ROUTES;
+    if (!qws_reserve(ws, g->n)) { perror("malloc"); return 0; }
+    int n = g->n;
+    int *order = malloc(sizeof(int) * n * 2), *onroute = calloc(n, sizeof(int));
+    unsigned char *arc_mark = calloc(g->m > 0 ? g->m : 1, 1);
+    int *buf = malloc(sizeof(int) * n);
+    if (!order || !onroute || !arc_mark || !buf) { perror("malloc"); exit(1); }
+    qws_begin(ws);
+    ws->stats.settled = 0;
+
+    double limit = INF;
+    int nf = alt_tree(g, ws, 0, src, dst, &limit, order);
+    DijkNode *fw = ws->side[0], *bw = ws->side[1];
+    int found = 0;
+    if (qws_node(ws, 0, dst)->visited) {
+        double best = fw[dst].dist;
+        alt_tree(g, ws, 1, dst, -1, &limit, order + n);
+
+        /* plateaus: start where the chain cannot be extended towards src */
+        int np = 0, pcap = 64;
+        AltPlateau *pl = malloc(sizeof(AltPlateau) * pcap);
+        if (!pl) { perror("malloc"); exit(1); }
+        for (int i = 0; i < nf; ++i) {
+            int v = order[i];
+            DijkNode *bv = qws_node(ws, 1, v);
+            if (!bv->visited) continue;
+            int u = fw[v].prev;
+            if (u >= 0 && qws_node(ws, 1, u)->visited && bw[u].prev == v) continue;
+            int w = v;
+            while (bw[w].prev >= 0 && qws_node(ws, 0, bw[w].prev)->visited && fw[bw[w].prev].prev == w)
+                w = bw[w].prev;
+            if (w == v) continue;
+            double cost = fw[v].dist + bv->dist;
+            if (cost > best * (1.0 + ALT_STRETCH)) continue;
+            if (np == pcap) {
+                AltPlateau *np2 = realloc(pl, sizeof(AltPlateau) * (pcap *= 2));
+                if (!np2) { perror("realloc"); exit(1); }
+                pl = np2;
+            }
+            pl[np].a = v; pl[np].b = w; pl[np].cost = cost;
+            pl[np].plateau = fw[w].dist - fw[v].dist;
+            np++;
+        }
+        qsort(pl, np, sizeof(AltPlateau), cmp_alt_plateau);
+
+        /* the cheapest plateau is the best route itself (src..dst) */
+        for (int p = 0; p < np && found < max_routes; ++p) {
+            /* src ~> a on the forward tree, then the backward tree (through
+               the plateau a..b) on to dst */
+            int a = pl[p].a, len = 0, simple = 1;
+            for (int v = a; v != -1; v = fw[v].prev) len++;
+            for (int i = len, v = a; v != -1; v = fw[v].prev) buf[--i] = v;
+            for (int v = bw[a].prev; v != -1 && len < n; v = bw[v].prev) buf[len++] = v;
+            if (buf[len-1] != dst) continue;
+            /* the two tree halves may cross: such a route has a loop */
+            for (int i = 0; i < len && simple; ++i) {
+                if (onroute[buf[i]] == p + 1) simple = 0;
+                onroute[buf[i]] = p + 1;
+            }
+            if (!simple) continue;
+            double cost = pl[p].cost;
+            if (found > 0 && pl[p].plateau < ALT_LOCAL_OPT * cost) continue;
+            double shared = found > 0 ? alt_overlap(g, buf, len, arc_mark) / cost : 0.0;
+            if (shared > ALT_MAX_SHARE) continue;
+            AltRoute *r = &out[found++];
+            r->nodes = malloc(sizeof(int) * len);
+            if (!r->nodes) { perror("malloc"); exit(1); }
+            memcpy(r->nodes, buf, sizeof(int) * len);
+            r->len = len;
+            r->traffic_km = cost;
+            r->shared = shared;
+            for (int i = 0; i + 1 < len; ++i) {
+                int x = graph_find_arc(g, buf[i], buf[i+1]);
+                if (x >= 0) { arc_mark[x] = 1; arc_mark[g->reverse_arc[x]] = 1; }
+            }
+        }
+        free(pl);
+    }
+    free(order); free(onroute); free(arc_mark); free(buf);
+    return found;
+}
+
+/* -------------------- Pareto routes (CO2, car time, distance) -------------------- */
+
+/* Multi-criteria label-setting search. A label is one route to a node with
+   three costs: traffic_km (CO2 for any car, through co2_grams()), car
+   minutes and km. Each node keeps a bag of labels that no other label there
+   dominates (no worse on all three). The queue holds each node once, keyed
+   by the least traffic_km plus potential among its unsettled labels, so
+   labels settle in traffic_km order and a settled label is final. A label
+   is dropped when a label already at dst dominates it with lower bounds of
+   the remaining costs added (straight-line km, times traffic_lb for CO2 and
+   time, as for A*).
+
+   Two knobs keep the work bounded on large graphs:
+   - eps > 0 drops a label when another is within a factor 1 + eps of it
+     on every criterion (epsilon-dominance), which thins the front to one
+     route per such step. It applies at every node, so the slack can
+     compound along a route: a dropped route may be up to a few eps worse
+     than its nearest kept one;
+   - max_labels caps each bag; a label reaching a full bag is dropped, so
+     routes through crowded nodes can go missing from the front. */
+#define PARETO_EPS 0.01            /* default epsilon-dominance for shortp() */
+#define PARETO_MAX_LABELS 64       /* default bag size per node */
+#define PARETO_MAX_ROUTES 6        /* routes shortp() prints */
+
+typedef struct {
+    int *nodes;              /* owned */
+    int len;
+    double traffic_km;       /* co2_grams() for a car's grams */
+    double car_min;
+    double km;
+} ParetoRoute;
+
+void pareto_routes_free(ParetoRoute *r, int n) {
+    for (int i = 0; i < n; ++i) { free(r[i].nodes); r[i].nodes = NULL; }
+}
+
+typedef struct {
+    double c[3];             /* traffic_km, car minutes, km */
+    int node;
+    int prev;                /* label it extends, -1 at src */
+    int next;                /* next label in the node's bag, -1 at the end */
+    int settled;
+} ParetoLabel;
+
+/* x within a factor 1 + eps of y on every criterion */
+static int pareto_covers(const double *x, const double *y, double eps) {
+    for (int k = 0; k < 3; ++k) if (x[k] > y[k] * (1.0 + eps)) return 0;
+    return 1;
+}
+
+/* Unsettled label of the bag with the least traffic_km (ties by time,
+   then km), -1 if none */
+static int pareto_bag_min(const ParetoLabel *lab, int head) {
+    int best = -1;
+    for (int i = head; i != -1; i = lab[i].next) {
+        if (lab[i].settled) continue;
+        if (best < 0 || lab[i].c[0] < lab[best].c[0]
+            || (lab[i].c[0] == lab[best].c[0] && (lab[i].c[1] < lab[best].c[1]
+                || (lab[i].c[1] == lab[best].c[1] && lab[i].c[2] < lab[best].c[2]))))
+            best = i;
+    }
+    return best;
+}
+
+static int cmp_pareto_route(const void *x, const void *y) {
+    const ParetoRoute *p = x, *q = y;
+    if (p->traffic_km != q->traffic_km) return (p->traffic_km > q->traffic_km) - (p->traffic_km < q->traffic_km);
+    return (p->km > q->km) - (p->km < q->km);
+}
+
+/* Pareto front of src -> dst over CO2, car time and distance on the live
+   traffic factors, lowest CO2 first. A front longer than max_routes is
+   thinned to evenly spaced routes that keep both ends. eps and max_labels
+   as above (0 and a large cap for the exact front). Returns the count, 0 if
+   dst is unreachable; *out_front (optional) gets the size before thinning.
+   ws->stats.settled counts settled labels. Free with pareto_routes_free(). */
+int pareto_routes(Graph *g, QueryWorkspace *ws, int src, int dst, double eps, int max_labels,
+                  int max_routes, ParetoRoute *out, int *out_front) {
+    if (out_front) *out_front = 0;
+    if (max_routes < 1 || max_labels < 1) return 0;
+    if (!qws_reserve(ws, g->n)) { perror("malloc"); return 0; }
+    qws_begin(ws);
+    ws->stats.settled = 0;
+    int cap = 1024, nl = 0;
+    ParetoLabel *lab = malloc(sizeof(ParetoLabel) * cap);
+    if (!lab) { perror("malloc"); return 0; }
+    const double t_per_km = 60.0 / CAR_FREEFLOW_KMPH;
+
+    /* DijkNode use: dist = queue key, pot = straight-line km to dst,
+       prev = bag head, visited = bag size */
+    IndexedHeap *pq = &ws->pq[0];
+    DijkNode *ns = qws_node(ws, 0, src), *nd = qws_node(ws, 0, dst);
+    lab[nl++] = (ParetoLabel){ {0.0, 0.0, 0.0}, src, -1, -1, 0 };
+    ns->prev = 0; ns->visited = 1;
+    ns->dist = 0.0;
+    iheap_push_or_decrease(pq, src, 0.0);
+
+    while (pq->size > 0) {
+        int u = iheap_pop_min(pq);
+        DijkNode *nu = qws_node(ws, 0, u);
+        int l = pareto_bag_min(lab, nu->prev);
+        if (l < 0) { nu->dist = INF; continue; }
+        double key = lab[l].c[0] + nu->pot * g->traffic_lb;
+        if (key > nu->dist * (1.0 + 1e-12) + 1e-12) {   /* its best label was replaced */
+            nu->dist = key;
+            iheap_push_or_decrease(pq, u, key);
+            continue;
+        }
+        lab[l].settled = 1;
+        ws->stats.settled++;
+        int next = pareto_bag_min(lab, nu->prev);
+        nu->dist = next < 0 ? INF : lab[next].c[0] + nu->pot * g->traffic_lb;
+        if (next >= 0) iheap_push_or_decrease(pq, u, nu->dist);
+        if (u == dst) continue;
+
+        /* Settled after a dst label that dominates it arrived */
+        int pruned = 0;
+        double lbu[3] = { lab[l].c[0] + nu->pot * g->traffic_lb, lab[l].c[1] + nu->pot * g->traffic_lb * t_per_km,
+                          lab[l].c[2] + nu->pot };
+        for (int d = nd->prev; d != -1 && !pruned; d = lab[d].next) pruned = pareto_covers(lab[d].c, lbu, eps);
+        if (pruned) continue;
+
+        for (int a = g->offsets[u]; a < g->offsets[u+1]; ++a) {
+            int v = g->neighbour[a];
+            if (v == src) continue;
+            DijkNode *nv = qws_node(ws, 0, v);
+            if (nv->pot < 0)
+                nv->pot = haversine_km(g->cities[v].lat, g->cities[v].lon,
+                                       g->cities[dst].lat, g->cities[dst].lon) * (1.0 - 1e-12);
+            double c[3] = { lab[l].c[0] + g->traffic_km[a],
+                            lab[l].c[1] + segment_car_min(g->distance_km[a], g->traffic_factor[a]),
+                            lab[l].c[2] + g->distance_km[a] };
+            double lb[3] = { c[0] + nv->pot * g->traffic_lb, c[1] + nv->pot * g->traffic_lb * t_per_km,
+                             c[2] + nv->pot };
+            int drop = 0;
+            for (int d = nd->prev; d != -1 && !drop; d = lab[d].next) drop = pareto_covers(lab[d].c, lb, eps);
+            for (int i = nv->prev; i != -1 && !drop; i = lab[i].next) drop = pareto_covers(lab[i].c, c, eps);
+            if (drop) continue;
+            /* Unlink the unsettled labels the new one dominates */
+            for (int *link = &nv->prev; *link != -1; ) {
+                ParetoLabel *x = &lab[*link];
+                if (!x->settled && pareto_covers(c, x->c, 0.0)) { *link = x->next; nv->visited--; }
+                else link = &x->next;
+            }
+            if (nv->visited >= max_labels) continue;
+            if (nl == cap) {
+                ParetoLabel *nb = realloc(lab, sizeof(ParetoLabel) * cap * 2);
+                if (!nb) { perror("realloc"); free(lab); return 0; }
+                lab = nb; cap *= 2;
+            }
+            lab[nl] = (ParetoLabel){ {c[0], c[1], c[2]}, v, l, nv->prev, 0 };
+            nv->prev = nl++;
+            nv->visited++;
+            double k = c[0] + nv->pot * g->traffic_lb;
+            if (k < nv->dist) { nv->dist = k; iheap_push_or_decrease(pq, v, k); }
+        }
+    }
+
+    /* dst's bag is the front */
+    int front = 0;
+    for (int i = nd->prev; i != -1; i = lab[i].next) front++;
+    ParetoRoute *all = calloc(front > 0 ? front : 1, sizeof(ParetoRoute));
+    if (!all) { perror("malloc"); free(lab); return 0; }
+    int k = 0;
+    for (int i = nd->prev; i != -1; i = lab[i].next) {
+        int len = 0;
+        for (int x = i; x != -1; x = lab[x].prev) len++;
+        ParetoRoute *r = &all[k];
+        r->nodes = malloc(sizeof(int) * len);
+        if (!r->nodes) { perror("malloc"); exit(1); }
+        r->len = len;
+        for (int x = i, j = len; x != -1; x = lab[x].prev) r->nodes[--j] = lab[x].node;
+        r->traffic_km = lab[i].c[0]; r->car_min = lab[i].c[1]; r->km = lab[i].c[2];
+        k++;
+    }
+    free(lab);
+    qsort(all, front, sizeof(ParetoRoute), cmp_pareto_route);
+    int cnt = front < max_routes ? front : max_routes;
+    for (int i = 0; i < cnt; ++i) {
+        int j = cnt > 1 ? (int)((long long)i * (front - 1) / (cnt - 1)) : 0;
+        out[i] = all[j];
+        all[j].nodes = NULL;
+    }
+    pareto_routes_free(all, front);
+    free(all);
+    if (out_front) *out_front = front;
+    return cnt;
+}
+
 /* -------------------- RDP Simplify helpers (new) -------------------- */
 
 /* Simple 2D point for RDP */
@@ -464,9 +2599,11 @@ static int rdp_simplify(const Pt *pts, int n, double eps, Pt *out, int out_max)
 
 /* -------------------- Interactive HTML output (simplified/speedy) -------------------- */
 /* New signature includes car_co2 so JS displays exact numbers used in C */
-/* Replacement write_html_map — builds interpolated points, simplifies in C, embeds simplified coords */
+/* Replacement write_html_map — builds interpolated points, simplifies in C, embeds simplified coords.
+   alts (n_alts, may be 0) are drawn dashed under the main route and listed in the panel. */
 void write_html_map(const char *fn, Graph *g, int *path, int path_len, double total_co2,
-                    double total_car_min, double total_bike_min, double total_walk_min, double car_co2) {
+                    double total_car_min, double total_bike_min, double total_walk_min, double car_co2,
+                    const AltRoute *alts, int n_alts) {
     FILE *f = fopen(fn, "w");
     if (!f) { perror("fopen html"); return; }
 
@@ -503,6 +2640,7 @@ void write_html_map(const char *fn, Graph *g, int *path, int path_len, double to
         idx++;
     }
     int raw_n = idx;
+    if (raw_n == 0) { free(raw); fclose(f); return; }   /* empty path: no map to centre */
 
     /* Simplify raw -> simp */
     Pt *simp = (Pt*)malloc(sizeof(Pt) * raw_n);
@@ -533,8 +2671,18 @@ void write_html_map(const char *fn, Graph *g, int *path, int path_len, double to
 "<script src='https://unpkg.com/leaflet@1.9.4/dist/leaflet.js'></script>\n"
 "<style>html,body,#map{height:100%%;margin:0} .panel{position:absolute;left:10px;top:10px;background:#fff;padding:10px;border-radius:8px;box-shadow:0 2px 10px rgba(0,0,0,.15);z-index:9999;font-family:sans-serif} .btn{display:inline-block;padding:6px 8px;background:#007bff;color:#fff;border-radius:6px;text-decoration:none;margin-right:6px}</style>\n"
 "</head>\n<body>\n<div id='map'></div>\n"
-"<div class='panel'><b>CO2-Optimized Route</b><br/>Total CO2: <span id='totalCo2'>%.2f</span> g<br/>Total time (car): <span id='totalCar'>%.1f</span> min<br/><div style='margin-top:8px'><a id='playBtn' class='btn'>Play</a><a id='pauseBtn' class='btn' style='background:#6c757d'>Pause</a><a id='downloadBtn' class='btn' style='background:#28a745'>Download GeoJSON</a></div></div>\n"
+"<div class='panel'><b>CO2-Optimized Route</b><br/>Total CO2: <span id='totalCo2'>%.2f</span> g<br/>Total time (car): <span id='totalCar'>%.1f</span> min<br/>\n"
 , total_co2, total_car_min);
+    static const char *alt_colors[] = { "#FF7A00", "#2CA02C", "#9467BD" };
+    for (int r = 0; r < n_alts; ++r) {
+        double km = 0, car_min = 0;
+        route_totals(g, alts[r].nodes, alts[r].len, &km, &car_min);
+        fprintf(f, "<div style='margin-top:6px;border-left:4px solid %s;padding-left:6px'>Alternative %d: %.2f g (+%.1f%%), %.1f min, %.0f%% shared</div>\n",
+                alt_colors[r % 3], r + 1, co2_grams(alts[r].traffic_km, car_co2),
+                total_co2 > 0 ? (co2_grams(alts[r].traffic_km, car_co2) / total_co2 - 1.0) * 100.0 : 0.0,
+                car_min, alts[r].shared * 100.0);
+    }
+    fprintf(f, "<div style='margin-top:8px'><a id='playBtn' class='btn'>Play</a><a id='pauseBtn' class='btn' style='background:#6c757d'>Pause</a><a id='downloadBtn' class='btn' style='background:#28a745'>Download GeoJSON</a></div></div>\n");
 
     fprintf(f, "<script>\n");
     fprintf(f, "var map = L.map('map').setView([%f,%f], 12);\n", simp[0].lat, simp[0].lon);
@@ -564,6 +2712,16 @@ void write_html_map(const char *fn, Graph *g, int *path, int path_len, double to
     }
     fprintf(f, "];\n");
 
+    /* alternatives first, so the main route is drawn on top */
+    for (int r = 0; r < n_alts; ++r) {
+        fprintf(f, "L.polyline([");
+        for (int i = 0; i < alts[r].len; ++i)
+            fprintf(f, "[%.7f,%.7f]%s", g->cities[alts[r].nodes[i]].lat, g->cities[alts[r].nodes[i]].lon,
+                    (i + 1 < alts[r].len ? "," : ""));
+        fprintf(f, "], {color:'%s', weight:5, opacity:0.8, dashArray:'8,6'}).addTo(map).bindPopup('Alternative %d: %.2f g CO2');\n",
+                alt_colors[r % 3], r + 1, co2_grams(alts[r].traffic_km, car_co2));
+    }
+
     /* add markers and polyline */
     fprintf(f,
 "for(var i=0;i<nodeIdx.length;i++){ var p = coordsAll[nodeIdx[i]]; if(p){ L.marker(p).addTo(map).bindPopup(nodeNames[i]); } }\n"
@@ -600,6 +2758,68 @@ void write_html_map(const char *fn, Graph *g, int *path, int path_len, double to
 
 /* -------------------- Main -------------------- */
 
+/* The interactive app's CO2 graph, kept between shortp() calls until
+   cities.txt changes, and its traffic refresher, which runs as long as the
+   graph does: a query never waits for the provider, not even to finish. */
+static Graph app_co2_graph;
+static TrafficRefresher app_refresher;
+static time_t app_co2_mtime;
+static int app_co2_ready;
+
+/* The app graph over cities (n entries, freshly loaded from cities.txt):
+   reused, freeing cities, while the file is unchanged; otherwise rebuilt,
+   taking ownership of cities. */
+static Graph *app_co2_graph_get(City *cities, int n, int force_refresh, int ttl_minutes) {
+    struct stat st;
+    time_t mt = stat("cities.txt", &st) == 0 ? st.st_mtime : 0;
+    Graph *g = &app_co2_graph;
+    if (app_co2_ready && mt == app_co2_mtime && n == g->n) {
+        free(cities);
+        if (!app_refresher.running) {    /* no provider: pick up the cache as it is now */
+            load_traffic_factors(g, ttl_minutes);
+            apply_traffic_weights(g);
+        }
+        printf("Road graph: %d places, %d roads (reused)\n", g->n, g->m/2);
+        return g;
+    }
+    if (app_co2_ready) {
+        traffic_refresher_stop(&app_refresher);
+        save_traffic_cache(g, TRAFFIC_CACHE_FILE);
+        free_graph(g);
+    }
+
+    /* Build graph (takes ownership of cities) */
+    g->n = n;
+    g->cities = cities;
+    build_sparse_graph(g, GRAPH_KNN_K);
+    printf("Road graph: %d places, %d roads (k=%d nearest)\n", g->n, g->m/2, GRAPH_KNN_K);
+
+    dijkstra_mode_from_env(DIJKSTRA_CCH);
+    if (dijkstra_mode == DIJKSTRA_CCH) {
+        clock_t t0 = clock();
+        graph_prepare_cch(g);
+        printf("Hierarchy: %d arcs, contracted in %.1f ms\n", g->cch->h.m,
+               (double)(clock() - t0) * 1000.0 / CLOCKS_PER_SEC);
+    }
+
+    printf("\nPreparing traffic factors (cache TTL = %d minutes)...\n", ttl_minutes);
+    if (force_refresh) build_edge_midpoint_traffic_factors_cached(g, SAMPLE_EVERY_N, 1, ttl_minutes);
+    else load_traffic_factors(g, ttl_minutes);
+
+    clock_t t_apply = clock();
+    apply_traffic_weights(g);
+    if (g->cch)
+        printf("Hierarchy customized for current traffic in %.1f ms\n",
+               (double)(clock() - t_apply) * 1000.0 / CLOCKS_PER_SEC);
+
+    /* Stale samples are refreshed in the background from now on */
+    if (traffic_refresher_start(&app_refresher, g, SAMPLE_EVERY_N, ttl_minutes, TRAFFIC_REFRESH_INTERVAL))
+        printf("Refreshing stale traffic samples in the background\n");
+    app_co2_mtime = mt;
+    app_co2_ready = 1;
+    return g;
+}
+
 int shortp(){
 
     printf("\n=== MIN CO2 ROUTE (Dijkstra + Interactive Map) ===\n\n");
@@ -618,9 +2838,9 @@ int shortp(){
     }
 
     /* Load cities */
-    City cities[MAX_CITIES];
+    City *cities = NULL;
     int n = 0;
-    if (!load_cities_comma("cities.txt", cities, &n)) {
+    if (!load_cities_comma("cities.txt", &cities, &n)) {
         fprintf(stderr, "Failed to load cities.txt\n");
         return 1;
     }
@@ -660,36 +2880,50 @@ int shortp(){
         if (strcmp(cl, tl)==0) dst = i;
     }
 
-    if (src < 0) { printf("City not found: %s\n", from_name); return 1; }
-    if (dst < 0) { printf("City not found: %s\n", to_name); return 1; }
+    if (src < 0) { printf("City not found: %s\n", from_name); free(cities); return 1; }
+    if (dst < 0) { printf("City not found: %s\n", to_name); free(cities); return 1; }
 
     printf("Found route: %s -> %s\n", cities[src].name, cities[dst].name);
 
     /* ---- Car model ---- */
     char car_model[128];
     printf("\nEnter car model (or press ENTER for Default):\n> ");
-    if (!fgets(car_model, sizeof(car_model), stdin)) return 1;
+    if (!fgets(car_model, sizeof(car_model), stdin)) { free(cities); return 1; }
     car_model[strcspn(car_model,"\n")]=0;
     if(strlen(car_model)==0) strcpy(car_model,"Default");
 
-    double car_co2 = DEFAULT_CO2_GKM;
-    FILE *cf = fopen("cars.txt","r");
-    if (cf) {
-        char line[MAX_LINE], model[128];
-        double val;
-        int found=0;
-        while (fgets(line,sizeof(line),cf)) {
-            if (sscanf(line,"%127[^,],%lf",model,&val)==2) {
-                trim(model);
-                char ml[128], cl[128];
-                strcpy(ml,model); for(char*q=ml;*q;q++)*q=tolower(*q);
-                strcpy(cl,car_model); for(char*q=cl;*q;q++)*q=tolower(*q);
-                if(strcmp(ml,cl)==0){car_co2=val;found=1;break;}
+    /* ---- Departure (time-dependent route from the traffic profiles) ---- */
+    char depart_in[64] = {0};
+    int depart_s = -1, window_end = -1;
+    printf("\nEnter departure time HH:MM, or a window HH:MM-HH:MM to find the best one\n"
+           "(or press ENTER for now):\n> ");
+    if (fgets(depart_in, sizeof(depart_in), stdin)) {
+        depart_in[strcspn(depart_in, "\n")] = 0;
+        trim(depart_in);
+        char *dash = strchr(depart_in, '-');
+        if (dash) {
+            *dash = 0;
+            trim(depart_in); trim(dash + 1);
+            depart_s = parse_clock_time(depart_in);
+            window_end = parse_clock_time(dash + 1);
+            if (depart_s < 0 || window_end < 0) {
+                printf("Invalid window, leaving now\n");
+                depart_s = window_end = -1;
+            } else if (window_end <= depart_s) {
+                window_end += 24 * 3600;         /* window across midnight */
             }
+        } else if (depart_in[0] && (depart_s = parse_clock_time(depart_in)) < 0) {
+            printf("Invalid time '%s', leaving now\n", depart_in);
         }
-        fclose(cf);
+    }
 
-        if(!found)
+    double car_co2 = DEFAULT_CO2_GKM;
+    CarModel *cars = NULL;
+    int ncars = 0, car_idx = -1;
+    if (load_car_models("cars.txt", &cars, &ncars)) {
+        car_idx = find_car_model(cars, ncars, car_model);
+        if (car_idx >= 0) car_co2 = cars[car_idx].co2_gkm;
+        else
             printf("Car model not found, using default %.1f g/km\n", car_co2);
     } else {
         printf("cars.txt not found; using default CO2\n");
@@ -697,25 +2931,66 @@ int shortp(){
 
     printf("Using CO2 factor: %.2f g/km\n", car_co2);
 
-    /* Build graph */
-    Graph g;
-    g.n = n;
-    for(int i=0;i<n;i++) g.cities[i]=cities[i];
-    g.edges = build_complete_graph(g.cities, g.n);
-
-    printf("\nPreparing traffic factors (cache TTL = %d minutes)...\n", ttl_minutes);
-    build_edge_midpoint_traffic_factors_cached(&g, SAMPLE_EVERY_N, force_refresh, ttl_minutes);
-
-    apply_co2_weights(&g, car_co2);
-
-    /* Run Dijkstra */
-    int path[1024], path_len=0;
-    double total_co2=0;
+    /* Graph and traffic, kept from the previous query while cities.txt
+       is unchanged; this query runs on the weights published when it
+       starts */
+    Graph *g = app_co2_graph_get(cities, n, force_refresh, ttl_minutes);
+    Graph view;
+    TrafficSet *pin = graph_pin(g, &view);
+
+    /* Run Dijkstra (car-independent; scaled by g/km below) */
+    int path[MAX_PATH_NODES], path_len=0;
+    double route_traffic_km=0;
+
+    /* A window is searched once for the whole curve; the route below is
+       the one for its best departure */
+    if (window_end >= 0) {
+        PwlFn curve;
+        double best_t, best_km;
+        clock_t t_prof = clock();
+        if (profile_search(&view, &default_ws, src, dst, depart_s, window_end, &curve, &best_t, &best_km)) {
+            double start_km = pwl_eval(&curve, depart_s);
+            printf("Departure window %02d:%02d-%02d:%02d searched in %.1f ms (%d nodes, %d breakpoints)\n",
+                   depart_s / 3600, depart_s / 60 % 60, window_end / 3600 % 24, window_end / 60 % 60,
+                   (double)(clock() - t_prof) * 1000.0 / CLOCKS_PER_SEC, default_ws.stats.settled, curve.n);
+            printf("  %-6s %10s %10s\n", "Leave", "CO2 (g)", "Car (min)");
+            for (int t = depart_s; t <= window_end; t += 15 * 60) {
+                double km = pwl_eval(&curve, t);
+                printf("  %02d:%02d  %10.1f %10.1f\n", t / 3600 % 24, t / 60 % 60,
+                       co2_grams(km, car_co2), km / CAR_FREEFLOW_KMPH * 60.0);
+            }
+            /* the better of the whole minutes around the best departure */
+            int m0 = (int)(best_t / 60.0) * 60;
+            depart_s = m0 + 60 <= window_end && pwl_eval(&curve, m0 + 60) < pwl_eval(&curve, m0) ? m0 + 60 : m0;
+            best_km = pwl_eval(&curve, depart_s);
+            printf("Best departure %02d:%02d: %.1f g CO2, %.1f g (%.1f%%) less than leaving at the start\n",
+                   depart_s / 3600 % 24, depart_s / 60 % 60, co2_grams(best_km, car_co2),
+                   co2_grams(start_km - best_km, car_co2),
+                   start_km > 0 ? 100.0 * (start_km - best_km) / start_km : 0.0);
+            depart_s %= 24 * 3600;
+            pwl_free(&curve);
+        } else {
+            printf("Profile search failed; leaving at the window start\n");
+            depart_s %= 24 * 3600;
+        }
+    }
 
-    if(!dijkstra(&g,src,dst,path,&path_len,&total_co2)){
+    int found = depart_s >= 0
+        ? dijkstra_td(&view, &default_ws, src, dst, depart_s, path, &path_len, &route_traffic_km)
+        : dijkstra(&view, src, dst, path, &path_len, &route_traffic_km);
+    if (depart_s >= 0) dijkstra_stats = default_ws.stats;
+    if(!found){
         printf("No path found.\n");
+        graph_unpin(pin);
+        free(cars);
         return 1;
     }
+    traffic_note_path(&view, path, path_len);
+    double total_co2 = co2_grams(route_traffic_km, car_co2);
+    printf("Search settled %d nodes on a %d-place graph (%s)\n", dijkstra_stats.settled, view.n,
+           depart_s >= 0 ? "time-dependent" : dijkstra_mode_names[dijkstra_mode]);
+    if (depart_s >= 0)
+        printf("Departing %02d:%02d, traffic from the time-of-day profiles\n", depart_s / 3600, depart_s / 60 % 60);
 
     /* Compute mode times */
     double total_car_min=0,total_bike_min=0,total_walk_min=0;
@@ -723,14 +2998,11 @@ int shortp(){
     printf("\nRoute steps:\n");
     for(int i=0;i<path_len-1;i++){
         int u=path[i], v=path[i+1];
-        Edge*e=&g.edges[u*g.n+v];
-        double d=e->distance_km;
-        double factor=e->traffic_factor;
-
-        double car_speed = CAR_FREEFLOW_KMPH/factor;
-        if(car_speed<5) car_speed=5;
+        int a=graph_find_arc(&view,u,v);
+        double d=view.distance_km[a];
+        double factor=depart_s >= 0 ? profile_arc_factor(&view, a, depart_s + total_car_min*60) : view.traffic_factor[a];
 
-        double car_min=(d/car_speed)*60;
+        double car_min=segment_car_min(d,factor);
         double bike_min=(d/BIKE_KMPH)*60;
         double walk_min=(d/WALK_KMPH)*60;
 
@@ -738,20 +3010,78 @@ int shortp(){
         total_bike_min+=bike_min;
         total_walk_min+=walk_min;
 
-        printf("%s -> %s  %.2f km\n", g.cities[u].name,g.cities[v].name,d);
+        printf("%s -> %s  %.2f km\n", view.cities[u].name,view.cities[v].name,d);
+    }
+
+    /* Same route for every model: the search above is shared, only the
+       g/km factor differs */
+    if (ncars > 0) {
+        printf("\nCO2 on this route by car model (%.2f traffic-weighted km):\n", route_traffic_km);
+        for (int i = 0; i < ncars; i++)
+            printf("  %-24s %7.1f g/km  %10.1f g%s\n", cars[i].name, cars[i].co2_gkm,
+                   co2_grams(route_traffic_km, cars[i].co2_gkm), i == car_idx ? "  <- selected" : "");
+    }
+
+    /* Alternatives: plateaus of the forward and backward trees */
+    AltRoute alts[ALT_MAX_ROUTES];
+    clock_t t_alt = clock();
+    int n_routes = depart_s >= 0 ? 0 : alternative_routes(&view, &default_ws, src, dst, ALT_MAX_ROUTES, alts);
+    double alt_ms = (double)(clock() - t_alt) * 1000.0 / CLOCKS_PER_SEC;
+    if (depart_s >= 0) {
+        printf("\nAlternatives are offered for departures now only.\n");
+    } else if (n_routes > 1) {
+        printf("\nAlternative routes (%.1f ms, %d nodes settled):\n", alt_ms, default_ws.stats.settled);
+        for (int r = 1; r < n_routes; r++) {
+            double km = 0, car_min = 0, co2 = co2_grams(alts[r].traffic_km, car_co2);
+            route_totals(&view, alts[r].nodes, alts[r].len, &km, &car_min);
+            printf("  %d) %.2f g CO2 (+%.1f%%), %.2f km, %.1f min by car, %.0f%% shared:\n     ",
+                   r, co2, total_co2 > 0 ? (co2 / total_co2 - 1.0) * 100.0 : 0.0, km, car_min,
+                   alts[r].shared * 100.0);
+            for (int i = 0; i < alts[r].len; i++)
+                printf("%s%s", view.cities[alts[r].nodes[i]].name, i + 1 < alts[r].len ? " -> " : "\n");
+        }
+    } else {
+        printf("\nNo alternative within %.0f%% of the best route's CO2.\n", ALT_STRETCH * 100.0);
+    }
+
+    /* Trade-offs: the Pareto front of CO2, car time and distance */
+    if (depart_s < 0) {
+        ParetoRoute front[PARETO_MAX_ROUTES];
+        int front_size = 0;
+        clock_t t_par = clock();
+        int n_front = pareto_routes(&view, &default_ws, src, dst, PARETO_EPS, PARETO_MAX_LABELS,
+                                    PARETO_MAX_ROUTES, front, &front_size);
+        if (n_front > 1) {
+            printf("\nTrade-offs, CO2 vs car time vs distance (%.1f ms, %d labels, %d of %d shown):\n",
+                   (double)(clock() - t_par) * 1000.0 / CLOCKS_PER_SEC, default_ws.stats.settled,
+                   n_front, front_size);
+            for (int r = 0; r < n_front; r++) {
+                printf("  %d) %.2f g CO2, %.1f min by car, %.2f km:\n     ",
+                       r + 1, co2_grams(front[r].traffic_km, car_co2), front[r].car_min, front[r].km);
+                for (int i = 0; i < front[r].len; i++)
+                    printf("%s%s", view.cities[front[r].nodes[i]].name, i + 1 < front[r].len ? " -> " : "\n");
+            }
+        }
+        pareto_routes_free(front, n_front);
     }
 
     /* Write HTML */
     write_html_map(
-        "route_co2_map.html", &g,
+        "route_co2_map.html", &view,
         path, path_len,
         total_co2,
         total_car_min, total_bike_min, total_walk_min,
-        car_co2
+        car_co2,
+        n_routes > 1 ? alts + 1 : NULL, n_routes > 1 ? n_routes - 1 : 0
     );
 
     open_in_browser("route_co2_map.html");
-    free(g.edges);
+    alt_routes_free(alts, n_routes);
+    graph_unpin(pin);
+    /* keeps the route counts; a running refresher saves them with its next
+       swap instead, so the two never write the cache at once */
+    if (!app_refresher.running) save_traffic_cache(g, TRAFFIC_CACHE_FILE);
+    free(cars);
 
     return 0;
 }
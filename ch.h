@@ -0,0 +1,876 @@
+/* ch.h -- Contraction Hierarchies for the undirected routing graphs
+   Build:   nodes are contracted in order of (edge difference + contracted
+            neighbours), kept in a lazily updated priority queue. Contracting
+            v adds a shortcut u-x (via v) unless a witness search finds a
+            path u..x avoiding v that is no longer.
+   Query:   a forward and a backward search, both over upward arcs only,
+            meet at the highest node of the shortest path; shortcuts are
+            unpacked recursively through their middle node.
+   Matrix:  many-to-many costs from one upward search per source and per
+            target, joined through per-node buckets.
+   Storage: upward arcs in CSR form, saved/loaded as a small binary file
+            tagged with a fingerprint of the source graph.
+   CCH:     a customizable variant (cch_build / cch_customize) whose
+            topology is metric-independent, for weights that keep changing.
+*/
+#ifndef CH_H
+#define CH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#define CH_INF 1e18
+/* witness searches give up after this many pops; ordering simulations use
+   the cheaper limit (a missed witness only costs an extra shortcut) */
+#ifndef CH_WITNESS_SETTLE_LIMIT
+#define CH_WITNESS_SETTLE_LIMIT 500
+#endif
+#ifndef CH_SIMULATE_SETTLE_LIMIT
+#define CH_SIMULATE_SETTLE_LIMIT 50
+#endif
+#define CH_FILE_MAGIC "ECOCH1"
+
+typedef struct {
+    int n;
+    int m;             /* upward arcs */
+    int *rank;         /* contraction position of each node */
+    int *up_off;       /* n+1: upward arcs of u are [up_off[u], up_off[u+1]) */
+    int *up_to;        /* higher-ranked endpoint */
+    int *up_mid;       /* middle node of a shortcut, -1 for an original edge */
+    double *up_w;
+} ContractionHierarchy;
+
+/* ----------------------------- indexed heap ------------------------------ */
+
+typedef struct {
+    int *q, *pos, n;
+    double *key;
+} ChHeap;
+
+static int chheap_init(ChHeap *h, int n) {
+    int cap = n > 0 ? n : 1;
+    h->q = malloc(sizeof(int) * cap);
+    h->pos = malloc(sizeof(int) * cap);
+    h->key = malloc(sizeof(double) * cap);
+    h->n = 0;
+    if (!h->q || !h->pos || !h->key) { free(h->q); free(h->pos); free(h->key); return 0; }
+    for (int i = 0; i < n; ++i) h->pos[i] = -1;
+    return 1;
+}
+
+static void chheap_free(ChHeap *h) {
+    free(h->q); free(h->pos); free(h->key);
+    h->q = h->pos = NULL; h->key = NULL; h->n = 0;
+}
+
+static void chheap_swap(ChHeap *h, int a, int b) {
+    int x = h->q[a], y = h->q[b];
+    h->q[a] = y; h->pos[y] = a;
+    h->q[b] = x; h->pos[x] = b;
+}
+
+static void chheap_up(ChHeap *h, int i) {
+    while (i > 0) {
+        int p = (i - 1) / 2;
+        if (h->key[h->q[p]] <= h->key[h->q[i]]) break;
+        chheap_swap(h, i, p); i = p;
+    }
+}
+
+static void chheap_down(ChHeap *h, int i) {
+    for (;;) {
+        int l = 2*i + 1, r = l + 1, m = i;
+        if (l < h->n && h->key[h->q[l]] < h->key[h->q[m]]) m = l;
+        if (r < h->n && h->key[h->q[r]] < h->key[h->q[m]]) m = r;
+        if (m == i) break;
+        chheap_swap(h, i, m); i = m;
+    }
+}
+
+/* insert, or move to a new key (either direction) */
+static void chheap_set(ChHeap *h, int v, double key) {
+    if (h->pos[v] < 0) {
+        h->q[h->n] = v; h->pos[v] = h->n++;
+        h->key[v] = key;
+        chheap_up(h, h->pos[v]);
+    } else {
+        double old = h->key[v];
+        h->key[v] = key;
+        if (key < old) chheap_up(h, h->pos[v]); else chheap_down(h, h->pos[v]);
+    }
+}
+
+static int chheap_pop(ChHeap *h) {
+    if (h->n == 0) return -1;
+    int u = h->q[0];
+    h->n--;
+    if (h->n > 0) { h->q[0] = h->q[h->n]; h->pos[h->q[0]] = 0; chheap_down(h, 0); }
+    h->pos[u] = -1;
+    return u;
+}
+
+/* Empty the heap in O(size) so it can be reused */
+static void chheap_clear(ChHeap *h) {
+    for (int i = 0; i < h->n; ++i) h->pos[h->q[i]] = -1;
+    h->n = 0;
+}
+
+/* ----------------------------- construction ------------------------------ */
+
+static int cmp_ch_int(const void *a, const void *b) {
+    int x = *(const int*)a, y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+typedef struct { int to; int mid; double w; } ChEdge;
+typedef struct { int n, cap; ChEdge *e; } ChAdj;
+
+typedef struct {
+    int n;
+    ChAdj *adj;             /* remaining (uncontracted) graph */
+    ChAdj *up;              /* upward arcs fixed at contraction time */
+    char *contracted;
+    int *deleted_nbrs;
+    int *level;             /* 1 + highest level of a contracted neighbour */
+    double *wdist; int *wstamp; int wcur;   /* witness search state */
+    int *tstamp; int targets_left;          /* neighbours still to be settled */
+    ChHeap wheap;
+} ChBuilder;
+
+static void chadj_push(ChAdj *a, int to, int mid, double w) {
+    if (a->n == a->cap) {
+        a->cap = a->cap ? a->cap * 2 : 4;
+        a->e = realloc(a->e, sizeof(ChEdge) * a->cap);
+        if (!a->e) { perror("realloc"); exit(1); }
+    }
+    a->e[a->n].to = to; a->e[a->n].mid = mid; a->e[a->n].w = w;
+    a->n++;
+}
+
+/* Add or shorten the undirected edge u-v in the remaining graph */
+static void ch_add_edge(ChBuilder *b, int u, int v, int mid, double w) {
+    for (int side = 0; side < 2; ++side) {
+        int x = side ? v : u, y = side ? u : v;
+        ChAdj *a = &b->adj[x];
+        int i;
+        for (i = 0; i < a->n; ++i) if (a->e[i].to == y) break;
+        if (i < a->n) {
+            if (w < a->e[i].w) { a->e[i].w = w; a->e[i].mid = mid; }
+        } else {
+            chadj_push(a, y, mid, w);
+        }
+    }
+}
+
+/* Dijkstra from u in the remaining graph without `skip`, up to max_d or
+   until every vertex tagged with tstamp == wcur has been settled */
+static void ch_witness(ChBuilder *b, int u, int skip, double max_d, int limit) {
+    chheap_clear(&b->wheap);
+    b->wdist[u] = 0.0; b->wstamp[u] = b->wcur;
+    chheap_set(&b->wheap, u, 0.0);
+    int settled = 0;
+    while (b->wheap.n > 0 && settled < limit && b->targets_left > 0) {
+        int x = chheap_pop(&b->wheap);
+        settled++;
+        if (b->tstamp[x] == b->wcur) b->targets_left--;
+        double dx = b->wdist[x];
+        if (dx > max_d) break;
+        ChAdj *a = &b->adj[x];
+        for (int i = 0; i < a->n; ++i) {
+            int y = a->e[i].to;
+            if (y == skip || b->contracted[y]) continue;
+            double nd = dx + a->e[i].w;
+            if (b->wstamp[y] != b->wcur || nd < b->wdist[y]) {
+                b->wstamp[y] = b->wcur; b->wdist[y] = nd;
+                chheap_set(&b->wheap, y, nd);
+            }
+        }
+    }
+}
+
+static double ch_witness_dist(const ChBuilder *b, int x) {
+    return b->wstamp[x] == b->wcur ? b->wdist[x] : CH_INF;
+}
+
+/* Contract v (or just count shortcuts when simulate is set) */
+static int ch_contract(ChBuilder *b, int v, int simulate) {
+    ChAdj *a = &b->adj[v];
+    int shortcuts = 0;
+    double max_w = 0;
+    for (int i = 0; i < a->n; ++i) if (a->e[i].w > max_w) max_w = a->e[i].w;
+    for (int i = 0; i < a->n; ++i) {
+        int u = a->e[i].to;
+        double wu = a->e[i].w;
+        if (a->n - i <= 1) break;
+        b->wcur++;
+        b->targets_left = 0;
+        for (int j = i + 1; j < a->n; ++j) { b->tstamp[a->e[j].to] = b->wcur; b->targets_left++; }
+        ch_witness(b, u, v, wu + max_w, simulate ? CH_SIMULATE_SETTLE_LIMIT : CH_WITNESS_SETTLE_LIMIT);
+        for (int j = i + 1; j < a->n; ++j) {
+            int x = a->e[j].to;
+            double via = wu + a->e[j].w;
+            if (ch_witness_dist(b, x) <= via) continue;
+            shortcuts++;
+            if (!simulate) ch_add_edge(b, u, x, v, via);
+        }
+    }
+    return shortcuts;
+}
+
+static double ch_priority(ChBuilder *b, int v) {
+    int sc = ch_contract(b, v, 1);
+    return 2.0 * (sc - b->adj[v].n) + b->deleted_nbrs[v] + b->level[v];
+}
+
+/* Remove v's entry from u's remaining-graph list */
+static void ch_unlink(ChBuilder *b, int u, int v) {
+    ChAdj *a = &b->adj[u];
+    for (int i = 0; i < a->n; ++i)
+        if (a->e[i].to == v) { a->e[i] = a->e[--a->n]; return; }
+}
+
+static void ch_free(ContractionHierarchy *ch) {
+    free(ch->rank); free(ch->up_off); free(ch->up_to); free(ch->up_mid); free(ch->up_w);
+    memset(ch, 0, sizeof(*ch));
+}
+
+/* Build from an undirected edge list (duplicates allowed; the lightest
+   copy wins). Returns 1 on success. */
+static int ch_build(ContractionHierarchy *ch, int n, int ne,
+                    const int *eu, const int *ev, const double *ew) {
+    ChBuilder b;
+    memset(&b, 0, sizeof(b));
+    memset(ch, 0, sizeof(*ch));
+    b.n = n;
+    b.adj = calloc(n > 0 ? n : 1, sizeof(ChAdj));
+    b.up = calloc(n > 0 ? n : 1, sizeof(ChAdj));
+    b.contracted = calloc(n > 0 ? n : 1, 1);
+    b.deleted_nbrs = calloc(n > 0 ? n : 1, sizeof(int));
+    b.level = calloc(n > 0 ? n : 1, sizeof(int));
+    b.tstamp = calloc(n > 0 ? n : 1, sizeof(int));
+    b.wdist = malloc(sizeof(double) * (n > 0 ? n : 1));
+    b.wstamp = calloc(n > 0 ? n : 1, sizeof(int));
+    ch->rank = malloc(sizeof(int) * (n > 0 ? n : 1));
+    ChHeap order;
+    if (!b.adj || !b.up || !b.contracted || !b.deleted_nbrs || !b.level || !b.tstamp ||
+        !b.wdist || !b.wstamp || !ch->rank ||
+        !chheap_init(&b.wheap, n) || !chheap_init(&order, n)) {
+        perror("malloc"); exit(1);
+    }
+    for (int i = 0; i < ne; ++i)
+        if (eu[i] != ev[i] && eu[i] >= 0 && eu[i] < n && ev[i] >= 0 && ev[i] < n)
+            ch_add_edge(&b, eu[i], ev[i], -1, ew[i]);
+
+    for (int v = 0; v < n; ++v) chheap_set(&order, v, ch_priority(&b, v));
+
+    int next_rank = 0;
+    while (order.n > 0) {
+        int v = chheap_pop(&order);
+        double p = ch_priority(&b, v);
+        if (order.n > 0 && p > order.key[order.q[0]]) { chheap_set(&order, v, p); continue; }
+
+        ch_contract(&b, v, 0);
+        ch->rank[v] = next_rank++;
+        b.contracted[v] = 1;
+        ChAdj *a = &b.adj[v];
+        for (int i = 0; i < a->n; ++i) {
+            int u = a->e[i].to;
+            chadj_push(&b.up[v], u, a->e[i].mid, a->e[i].w);
+            ch_unlink(&b, u, v);
+            b.deleted_nbrs[u]++;
+            if (b.level[u] < b.level[v] + 1) b.level[u] = b.level[v] + 1;
+        }
+        for (int i = 0; i < a->n; ++i) {
+            int u = a->e[i].to;
+            chheap_set(&order, u, ch_priority(&b, u));
+        }
+        free(a->e); a->e = NULL; a->n = a->cap = 0;
+    }
+
+    /* freeze upward arcs into CSR */
+    ch->n = n;
+    ch->up_off = malloc(sizeof(int) * (n + 1));
+    if (!ch->up_off) { perror("malloc"); exit(1); }
+    ch->up_off[0] = 0;
+    for (int v = 0; v < n; ++v) ch->up_off[v+1] = ch->up_off[v] + b.up[v].n;
+    ch->m = ch->up_off[n];
+    int m = ch->m > 0 ? ch->m : 1;
+    ch->up_to = malloc(sizeof(int) * m);
+    ch->up_mid = malloc(sizeof(int) * m);
+    ch->up_w = malloc(sizeof(double) * m);
+    if (!ch->up_to || !ch->up_mid || !ch->up_w) { perror("malloc"); exit(1); }
+    for (int v = 0; v < n; ++v) {
+        for (int i = 0; i < b.up[v].n; ++i) {
+            int k = ch->up_off[v] + i;
+            ch->up_to[k] = b.up[v].e[i].to;
+            ch->up_mid[k] = b.up[v].e[i].mid;
+            ch->up_w[k] = b.up[v].e[i].w;
+        }
+        free(b.up[v].e);
+    }
+    free(b.adj); free(b.up); free(b.contracted); free(b.deleted_nbrs); free(b.level); free(b.tstamp);
+    free(b.wdist); free(b.wstamp);
+    chheap_free(&b.wheap); chheap_free(&order);
+    return 1;
+}
+
+/* -------------------------------- query ---------------------------------- */
+
+/* Per-query scratch; one per thread, reused across queries */
+typedef struct {
+    int n;
+    double *dist[2];
+    int *pred[2];      /* upward arc used to reach the node, -1 at the root */
+    int *from[2];      /* node that arc starts at */
+    int *stamp[2];
+    int cur;
+    ChHeap heap[2];
+    int settled;
+} ChWorkspace;
+
+static int ch_workspace_init(ChWorkspace *ws, int n) {
+    memset(ws, 0, sizeof(*ws));
+    ws->n = n;
+    int cap = n > 0 ? n : 1;
+    for (int d = 0; d < 2; ++d) {
+        ws->dist[d] = malloc(sizeof(double) * cap);
+        ws->pred[d] = malloc(sizeof(int) * cap);
+        ws->from[d] = malloc(sizeof(int) * cap);
+        ws->stamp[d] = calloc(cap, sizeof(int));
+        if (!ws->dist[d] || !ws->pred[d] || !ws->from[d] || !ws->stamp[d] ||
+            !chheap_init(&ws->heap[d], n)) return 0;
+    }
+    return 1;
+}
+
+static void ch_workspace_free(ChWorkspace *ws) {
+    for (int d = 0; d < 2; ++d) {
+        free(ws->dist[d]); free(ws->pred[d]); free(ws->from[d]); free(ws->stamp[d]);
+        chheap_free(&ws->heap[d]);
+    }
+    memset(ws, 0, sizeof(*ws));
+}
+
+static double ch_ws_dist(const ChWorkspace *ws, int d, int v) {
+    return ws->stamp[d][v] == ws->cur ? ws->dist[d][v] : CH_INF;
+}
+
+/* Upward arc between a and b (one of them is the lower-ranked owner) */
+static int ch_find_arc(const ContractionHierarchy *ch, int a, int b) {
+    int lo = ch->rank[a] < ch->rank[b] ? a : b, hi = lo == a ? b : a;
+    int best = -1;
+    for (int k = ch->up_off[lo]; k < ch->up_off[lo+1]; ++k)
+        if (ch->up_to[k] == hi && (best < 0 || ch->up_w[k] < ch->up_w[best])) best = k;
+    return best;
+}
+
+/* Append the original-graph vertices after `a` up to and including `b`
+   for arc k between a and b. Returns 0 if out would overflow. */
+static int ch_unpack(const ContractionHierarchy *ch, int a, int b, int k, int *out, int *len, int max) {
+    int mid = ch->up_mid[k];
+    if (mid < 0) {
+        if (*len >= max) return 0;
+        out[(*len)++] = b;
+        return 1;
+    }
+    int k1 = ch_find_arc(ch, a, mid), k2 = ch_find_arc(ch, mid, b);
+    if (k1 < 0 || k2 < 0) return 0;
+    return ch_unpack(ch, a, mid, k1, out, len, max) && ch_unpack(ch, mid, b, k2, out, len, max);
+}
+
+/* Shortest s-t cost; fills path (s..t, original vertices) when path != NULL.
+   Returns CH_INF if t is unreachable or the path does not fit in max_len. */
+static double ch_query(const ContractionHierarchy *ch, ChWorkspace *ws, int s, int t,
+                       int *path, int *path_len, int max_len) {
+    ws->cur++;
+    ws->settled = 0;
+    int src[2] = { s, t };
+    for (int d = 0; d < 2; ++d) {
+        chheap_clear(&ws->heap[d]);
+        ws->stamp[d][src[d]] = ws->cur;
+        ws->dist[d][src[d]] = 0.0;
+        ws->pred[d][src[d]] = -1;
+        chheap_set(&ws->heap[d], src[d], 0.0);
+    }
+    double mu = CH_INF;
+    int meet = -1;
+    int d = 0;
+    while (ws->heap[0].n > 0 || ws->heap[1].n > 0) {
+        /* alternate, skipping a side that is empty or already past mu */
+        int live[2];
+        for (int k = 0; k < 2; ++k)
+            live[k] = ws->heap[k].n > 0 && ws->heap[k].key[ws->heap[k].q[0]] < mu;
+        if (!live[0] && !live[1]) break;
+        if (!live[d]) d = 1 - d;
+
+        int u = chheap_pop(&ws->heap[d]);
+        ws->settled++;
+        double du = ws->dist[d][u];
+        double other = ch_ws_dist(ws, 1 - d, u);
+        if (du + other < mu) { mu = du + other; meet = u; }
+        for (int k = ch->up_off[u]; k < ch->up_off[u+1]; ++k) {
+            int v = ch->up_to[k];
+            double nd = du + ch->up_w[k];
+            if (nd < ch_ws_dist(ws, d, v)) {
+                ws->stamp[d][v] = ws->cur;
+                ws->dist[d][v] = nd;
+                ws->pred[d][v] = k;
+                ws->from[d][v] = u;
+                chheap_set(&ws->heap[d], v, nd);
+            }
+        }
+        d = 1 - d;
+    }
+    if (meet < 0) return CH_INF;
+    if (!path) return mu;
+
+    /* s .. meet: collect the forward arcs from meet back to s, then unpack */
+    int nf = 0;
+    for (int v = meet; ws->pred[0][v] >= 0; v = ws->from[0][v]) nf++;
+    int *arcs = malloc(sizeof(int) * (nf > 0 ? nf : 1));
+    if (!arcs) return CH_INF;
+    int i = nf;
+    for (int v = meet; ws->pred[0][v] >= 0; v = ws->from[0][v]) arcs[--i] = v;
+    int len = 0;
+    if (max_len < 1) { free(arcs); return CH_INF; }
+    path[len++] = s;
+    int ok = 1;
+    for (i = 0; i < nf && ok; ++i) {
+        int v = arcs[i];
+        ok = ch_unpack(ch, ws->from[0][v], v, ws->pred[0][v], path, &len, max_len);
+    }
+    free(arcs);
+    /* meet .. t: backward tree already points towards t */
+    for (int v = meet; ok && ws->pred[1][v] >= 0; v = ws->from[1][v])
+        ok = ch_unpack(ch, v, ws->from[1][v], ws->pred[1][v], path, &len, max_len);
+    if (!ok) return CH_INF;
+    *path_len = len;
+    return mu;
+}
+
+/* ----------------------------- many-to-many ------------------------------ */
+
+typedef struct { int col; double d; } ChBucketEntry;
+
+/* Settle the whole upward search space of s on side 0, appending the nodes
+   whose distance is exact to *vis. A node is stalled (neither expanded nor
+   reported) when a higher neighbour already offers a shorter way to it;
+   the top node of a shortest up-down path is never stalled. Returns the
+   node count, -1 on allocation failure. */
+static int ch_upward(const ContractionHierarchy *ch, ChWorkspace *ws, int s, int **vis, int *cap) {
+    ws->cur++;
+    chheap_clear(&ws->heap[0]);
+    ws->stamp[0][s] = ws->cur;
+    ws->dist[0][s] = 0.0;
+    chheap_set(&ws->heap[0], s, 0.0);
+    int cnt = 0;
+    while (ws->heap[0].n > 0) {
+        int u = chheap_pop(&ws->heap[0]);
+        ws->settled++;
+        double du = ws->dist[0][u];
+        int stalled = 0;
+        for (int k = ch->up_off[u]; k < ch->up_off[u+1] && !stalled; ++k)
+            stalled = ch_ws_dist(ws, 0, ch->up_to[k]) + ch->up_w[k] < du;
+        if (stalled) continue;
+        if (cnt == *cap) {
+            int nc = *cap ? *cap * 2 : 256;
+            int *nv = realloc(*vis, sizeof(int) * nc);
+            if (!nv) return -1;
+            *vis = nv; *cap = nc;
+        }
+        (*vis)[cnt++] = u;
+        for (int k = ch->up_off[u]; k < ch->up_off[u+1]; ++k) {
+            int v = ch->up_to[k];
+            double nd = du + ch->up_w[k];
+            if (nd < ch_ws_dist(ws, 0, v)) {
+                ws->stamp[0][v] = ws->cur;
+                ws->dist[0][v] = nd;
+                chheap_set(&ws->heap[0], v, nd);
+            }
+        }
+    }
+    return cnt;
+}
+
+/* Cost matrix out[i*nt + j] = shortest src[i]-dst[j] cost (CH_INF if
+   unreachable). Each target's upward search leaves (target, distance) in
+   a bucket at every node it settles; each source's upward search then
+   scans the buckets of its own nodes. That is ns + nt searches instead of
+   ns * nt point queries. ws->settled counts all of them. Returns 0 on
+   allocation failure. */
+static int ch_many_to_many(const ContractionHierarchy *ch, ChWorkspace *ws,
+                           const int *src, int ns, const int *dst, int nt, double *out) {
+    for (long long i = 0; i < (long long)ns * nt; ++i) out[i] = CH_INF;
+    ws->settled = 0;
+    int *vis = NULL, vcap = 0, ok = 1;
+    int *off = calloc(ch->n + 1, sizeof(int));
+    int *enode = NULL;
+    ChBucketEntry *ent = NULL, *bucket = NULL;
+    long long ne = 0, ecap = 0;
+    if (!off) return 0;
+
+    /* targets: collect (node, column, distance), then bucket them by node */
+    for (int j = 0; j < nt && ok; ++j) {
+        int cnt = ch_upward(ch, ws, dst[j], &vis, &vcap);
+        if (cnt < 0) { ok = 0; break; }
+        if (ne + cnt > ecap) {
+            long long nc = ecap ? ecap * 2 : 1024;
+            while (nc < ne + cnt) nc *= 2;
+            int *nn = realloc(enode, sizeof(int) * nc);
+            if (nn) enode = nn;
+            ChBucketEntry *nb = realloc(ent, sizeof(ChBucketEntry) * nc);
+            if (nb) ent = nb;
+            if (!nn || !nb) { ok = 0; break; }
+            ecap = nc;
+        }
+        for (int i = 0; i < cnt; ++i) {
+            enode[ne] = vis[i];
+            ent[ne].col = j;
+            ent[ne].d = ws->dist[0][vis[i]];
+            ne++;
+            off[vis[i] + 1]++;
+        }
+    }
+    if (ok && !(bucket = malloc(sizeof(ChBucketEntry) * (ne > 0 ? ne : 1)))) ok = 0;
+    if (ok) {
+        for (int v = 0; v < ch->n; ++v) off[v+1] += off[v];
+        for (long long e = 0; e < ne; ++e) bucket[off[enode[e]]++] = ent[e];
+        for (int v = ch->n; v > 0; --v) off[v] = off[v-1];
+        off[0] = 0;
+    }
+    free(enode); free(ent);
+
+    /* sources: meet the buckets from below */
+    for (int i = 0; i < ns && ok; ++i) {
+        int cnt = ch_upward(ch, ws, src[i], &vis, &vcap);
+        if (cnt < 0) { ok = 0; break; }
+        double *row = out + (long long)i * nt;
+        for (int k = 0; k < cnt; ++k) {
+            int v = vis[k];
+            double dv = ws->dist[0][v];
+            for (int e = off[v]; e < off[v+1]; ++e)
+                if (dv + bucket[e].d < row[bucket[e].col]) row[bucket[e].col] = dv + bucket[e].d;
+        }
+    }
+    free(vis); free(off); free(bucket);
+    return ok;
+}
+
+/* ------------------------------ persistence ------------------------------ */
+
+/* FNV-1a over raw bytes, used to tag a hierarchy with its source graph */
+static uint64_t ch_fnv1a(uint64_t h, const void *data, size_t len) {
+    const unsigned char *p = data;
+    for (size_t i = 0; i < len; ++i) { h ^= p[i]; h *= 1099511628211ULL; }
+    return h;
+}
+
+static int ch_save(const ContractionHierarchy *ch, const char *fn, uint64_t fingerprint) {
+    FILE *f = fopen(fn, "wb");
+    if (!f) return 0;
+    int ok = fwrite(CH_FILE_MAGIC, 1, 6, f) == 6 &&
+             fwrite(&ch->n, sizeof(int), 1, f) == 1 &&
+             fwrite(&ch->m, sizeof(int), 1, f) == 1 &&
+             fwrite(&fingerprint, sizeof(fingerprint), 1, f) == 1 &&
+             fwrite(ch->rank, sizeof(int), ch->n, f) == (size_t)ch->n &&
+             fwrite(ch->up_off, sizeof(int), ch->n + 1, f) == (size_t)ch->n + 1 &&
+             fwrite(ch->up_to, sizeof(int), ch->m, f) == (size_t)ch->m &&
+             fwrite(ch->up_mid, sizeof(int), ch->m, f) == (size_t)ch->m &&
+             fwrite(ch->up_w, sizeof(double), ch->m, f) == (size_t)ch->m;
+    if (fclose(f) != 0) ok = 0;
+    return ok;
+}
+
+/* Returns 1 only if the file exists, is well-formed and matches fingerprint */
+static int ch_load(ContractionHierarchy *ch, const char *fn, uint64_t fingerprint) {
+    FILE *f = fopen(fn, "rb");
+    if (!f) return 0;
+    char magic[6];
+    uint64_t fp = 0;
+    int n = 0, m = 0;
+    memset(ch, 0, sizeof(*ch));
+    if (fread(magic, 1, 6, f) != 6 || memcmp(magic, CH_FILE_MAGIC, 6) != 0 ||
+        fread(&n, sizeof(int), 1, f) != 1 || fread(&m, sizeof(int), 1, f) != 1 ||
+        fread(&fp, sizeof(fp), 1, f) != 1 || fp != fingerprint || n < 0 || m < 0) {
+        fclose(f); return 0;
+    }
+    ch->n = n; ch->m = m;
+    ch->rank = malloc(sizeof(int) * (n > 0 ? n : 1));
+    ch->up_off = malloc(sizeof(int) * (n + 1));
+    ch->up_to = malloc(sizeof(int) * (m > 0 ? m : 1));
+    ch->up_mid = malloc(sizeof(int) * (m > 0 ? m : 1));
+    ch->up_w = malloc(sizeof(double) * (m > 0 ? m : 1));
+    int ok = ch->rank && ch->up_off && ch->up_to && ch->up_mid && ch->up_w &&
+             fread(ch->rank, sizeof(int), n, f) == (size_t)n &&
+             fread(ch->up_off, sizeof(int), n + 1, f) == (size_t)n + 1 &&
+             fread(ch->up_to, sizeof(int), m, f) == (size_t)m &&
+             fread(ch->up_mid, sizeof(int), m, f) == (size_t)m &&
+             fread(ch->up_w, sizeof(double), m, f) == (size_t)m &&
+             ch->up_off[0] == 0 && ch->up_off[n] == m;
+    fclose(f);
+    if (!ok) { ch_free(ch); return 0; }
+    return 1;
+}
+
+/* ------------------------ customizable hierarchy ------------------------- */
+
+/* Customizable CH (metric-independent): the order comes from geometric
+   nested dissection and every shortcut of the elimination is kept (no
+   witness searches), so the topology is valid for any weights. A
+   customization pass then fills in weights bottom-up over lower triangles
+   in O(triangles), which is cheap enough to rerun on every metric change.
+   The result is a ContractionHierarchy, queried with ch_query as usual. */
+
+#define CCH_ND_LEAF 16     /* cells this small are ordered as they come */
+
+typedef struct {
+    ContractionHierarchy h;  /* topology plus the current metric */
+    int *by_rank;            /* n: node contracted at each position */
+    int ne;                  /* input edges */
+    int *input_arc;          /* ne: upward arc carrying each input edge, -1 for loops */
+    int *arc_pos;            /* n scratch for customization, all -1 between passes */
+} CustomizableCH;
+
+typedef struct { int n, cap; int *v; } CchList;
+
+static void cchlist_push(CchList *l, int x) {
+    if (l->n == l->cap) {
+        l->cap = l->cap ? l->cap * 2 : 4;
+        l->v = realloc(l->v, sizeof(int) * l->cap);
+        if (!l->v) { perror("realloc"); exit(1); }
+    }
+    l->v[l->n++] = x;
+}
+
+typedef struct {
+    const int *off, *adj;        /* input graph as CSR */
+    const double *lat, *lon;
+    int *ids, *tmp, *cell;
+    double *key;                 /* cut coordinate per node */
+    int next_cell;
+    int *rank, next_rank;
+} CchDissect;
+
+/* Quickselect ids[lo..hi) so ids[k] holds the median of c[] */
+static void cch_select(int *ids, int lo, int hi, int k, const double *c) {
+    hi--;
+    while (hi > lo) {
+        int m = lo + (hi - lo) / 2, t;
+        if (c[ids[m]] < c[ids[lo]]) { t = ids[m]; ids[m] = ids[lo]; ids[lo] = t; }
+        if (c[ids[hi]] < c[ids[lo]]) { t = ids[hi]; ids[hi] = ids[lo]; ids[lo] = t; }
+        if (c[ids[hi]] < c[ids[m]]) { t = ids[hi]; ids[hi] = ids[m]; ids[m] = t; }
+        double pivot = c[ids[m]];
+        int i = lo, j = hi;
+        while (i <= j) {
+            while (c[ids[i]] < pivot) i++;
+            while (c[ids[j]] > pivot) j--;
+            if (i <= j) { t = ids[i]; ids[i] = ids[j]; ids[j] = t; i++; j--; }
+        }
+        if (k <= j) hi = j;
+        else if (k >= i) lo = i;
+        else return;
+    }
+}
+
+/* Boundary of cell `from` towards cell `to` within ids[lo..hi) */
+static int cch_boundary(CchDissect *d, int lo, int hi, int from, int to, char *mark) {
+    int cnt = 0;
+    for (int i = lo; i < hi; ++i) {
+        int v = d->ids[i];
+        mark[i - lo] = 0;
+        if (d->cell[v] != from) continue;
+        for (int a = d->off[v]; a < d->off[v+1]; ++a)
+            if (d->cell[d->adj[a]] == to) { mark[i - lo] = 1; cnt++; break; }
+    }
+    return cnt;
+}
+
+/* Order ids[lo..hi): halve at the median along the best of four
+   directions, take the smaller boundary as separator, order both halves
+   first and the separator last */
+static void cch_dissect(CchDissect *d, int lo, int hi, char *mark) {
+    if (hi - lo <= CCH_ND_LEAF) {
+        for (int i = lo; i < hi; ++i) d->rank[d->ids[i]] = d->next_rank++;
+        return;
+    }
+    double la0 = d->lat[d->ids[lo]], la1 = la0, lo0 = d->lon[d->ids[lo]], lo1 = lo0;
+    for (int i = lo + 1; i < hi; ++i) {
+        int v = d->ids[i];
+        if (d->lat[v] < la0) la0 = d->lat[v];
+        if (d->lat[v] > la1) la1 = d->lat[v];
+        if (d->lon[v] < lo0) lo0 = d->lon[v];
+        if (d->lon[v] > lo1) lo1 = d->lon[v];
+    }
+    double shrink = cos((la0 + la1) * 0.5 * 3.14159265358979323846 / 180.0);
+    int mid = (lo + hi) / 2;
+    int left = d->next_cell++, right = d->next_cell++;
+    char *alt = mark + (hi - lo);
+
+    /* try four cut directions (lat, lon, both diagonals), keep the one with
+       the smallest boundary */
+    int best_dir = 0, best_size = -1;
+    for (int pass = 0; pass < 5; ++pass) {
+        int dir = pass < 4 ? pass : best_dir;
+        for (int i = lo; i < hi; ++i) {
+            int v = d->ids[i];
+            double x = d->lon[v] * shrink, y = d->lat[v];
+            d->key[v] = dir == 0 ? y : dir == 1 ? x : dir == 2 ? x + y : x - y;
+        }
+        cch_select(d->ids, lo, hi, mid, d->key);
+        for (int i = lo; i < hi; ++i) d->cell[d->ids[i]] = i < mid ? left : right;
+        int bl = cch_boundary(d, lo, hi, left, right, mark);
+        int br = bl > 0 ? cch_boundary(d, lo, hi, right, left, alt) : 0;
+        if (br < bl) { memcpy(mark, alt, hi - lo); bl = br; }
+        if (pass < 4 && (best_size < 0 || bl < best_size)) { best_size = bl; best_dir = dir; }
+        if (pass == 3 && best_dir == 3) break;
+    }
+
+    /* [left rest][right rest][separator]; separator leaves every cell */
+    int nl = 0, nr = 0;
+    for (int i = lo; i < hi; ++i) {
+        if (mark[i - lo]) continue;
+        if (d->cell[d->ids[i]] == left) nl++; else nr++;
+    }
+    int pl = lo, pr = lo + nl, ps = lo + nl + nr;
+    for (int i = lo; i < hi; ++i) {
+        int v = d->ids[i];
+        if (mark[i - lo]) { d->tmp[ps++] = v; d->cell[v] = -1; }
+        else if (d->cell[v] == left) d->tmp[pl++] = v;
+        else d->tmp[pr++] = v;
+    }
+    memcpy(d->ids + lo, d->tmp + lo, sizeof(int) * (hi - lo));
+    cch_dissect(d, lo, lo + nl, mark);
+    cch_dissect(d, lo + nl, lo + nl + nr, mark);
+    for (int i = lo + nl + nr; i < hi; ++i) d->rank[d->ids[i]] = d->next_rank++;
+}
+
+static void cch_free(CustomizableCH *c) {
+    ch_free(&c->h);
+    free(c->by_rank); free(c->input_arc); free(c->arc_pos);
+    memset(c, 0, sizeof(*c));
+}
+
+/* Topology-only build from an undirected edge list and node coordinates
+   (degrees). Weights are all CH_INF until cch_customize. Returns 1 on success. */
+static int cch_build(CustomizableCH *c, int n, int ne, const int *eu, const int *ev,
+                     const double *lat, const double *lon) {
+    memset(c, 0, sizeof(*c));
+    int cap = n > 0 ? n : 1;
+    int *off = calloc(n + 1, sizeof(int));
+    int *adj = malloc(sizeof(int) * (ne > 0 ? 2 * ne : 1));
+    CchDissect d;
+    memset(&d, 0, sizeof(d));
+    d.ids = malloc(sizeof(int) * cap);
+    d.tmp = malloc(sizeof(int) * cap);
+    d.cell = calloc(cap, sizeof(int));
+    d.key = malloc(sizeof(double) * cap);
+    char *mark = malloc(2 * (size_t)cap);
+    c->h.rank = malloc(sizeof(int) * cap);
+    c->by_rank = malloc(sizeof(int) * cap);
+    c->input_arc = malloc(sizeof(int) * (ne > 0 ? ne : 1));
+    c->arc_pos = malloc(sizeof(int) * cap);
+    CchList *up = calloc(cap, sizeof(CchList));
+    if (!off || !adj || !d.ids || !d.tmp || !d.cell || !d.key || !mark || !c->h.rank ||
+        !c->by_rank || !c->input_arc || !c->arc_pos || !up) { perror("malloc"); exit(1); }
+
+    /* nested dissection order */
+    for (int i = 0; i < ne; ++i) if (eu[i] != ev[i]) { off[eu[i]+1]++; off[ev[i]+1]++; }
+    for (int v = 0; v < n; ++v) off[v+1] += off[v];
+    int *fill = malloc(sizeof(int) * cap);
+    if (!fill) { perror("malloc"); exit(1); }
+    memcpy(fill, off, sizeof(int) * n);
+    for (int i = 0; i < ne; ++i)
+        if (eu[i] != ev[i]) { adj[fill[eu[i]]++] = ev[i]; adj[fill[ev[i]]++] = eu[i]; }
+    d.off = off; d.adj = adj; d.lat = lat; d.lon = lon;
+    d.rank = c->h.rank;
+    for (int v = 0; v < n; ++v) d.ids[v] = v;
+    cch_dissect(&d, 0, n, mark);
+    for (int v = 0; v < n; ++v) c->by_rank[c->h.rank[v]] = v;
+
+    /* eliminate in order: the upper neighbours of v become a clique, which it
+       is enough to hand to the lowest of them (lists hold ranks) */
+    for (int i = 0; i < ne; ++i) {
+        if (eu[i] == ev[i]) continue;
+        int ru = c->h.rank[eu[i]], rv = c->h.rank[ev[i]];
+        if (ru < rv) cchlist_push(&up[eu[i]], rv); else cchlist_push(&up[ev[i]], ru);
+    }
+    for (int r = 0; r < n; ++r) {
+        CchList *l = &up[c->by_rank[r]];
+        if (l->n == 0) continue;
+        qsort(l->v, l->n, sizeof(int), cmp_ch_int);
+        int k = 0;
+        for (int i = 0; i < l->n; ++i) if (i == 0 || l->v[i] != l->v[i-1]) l->v[k++] = l->v[i];
+        l->n = k;
+        CchList *low = &up[c->by_rank[l->v[0]]];
+        for (int i = 1; i < l->n; ++i) cchlist_push(low, l->v[i]);
+    }
+
+    ContractionHierarchy *h = &c->h;
+    h->n = n;
+    h->up_off = malloc(sizeof(int) * (n + 1));
+    if (!h->up_off) { perror("malloc"); exit(1); }
+    h->up_off[0] = 0;
+    for (int v = 0; v < n; ++v) h->up_off[v+1] = h->up_off[v] + up[v].n;
+    h->m = h->up_off[n];
+    int m = h->m > 0 ? h->m : 1;
+    h->up_to = malloc(sizeof(int) * m);
+    h->up_mid = malloc(sizeof(int) * m);
+    h->up_w = malloc(sizeof(double) * m);
+    if (!h->up_to || !h->up_mid || !h->up_w) { perror("malloc"); exit(1); }
+    for (int v = 0; v < n; ++v) {
+        for (int i = 0; i < up[v].n; ++i) {
+            int k = h->up_off[v] + i;
+            h->up_to[k] = c->by_rank[up[v].v[i]];
+            h->up_mid[k] = -1;
+            h->up_w[k] = CH_INF;
+        }
+        free(up[v].v);
+        c->arc_pos[v] = -1;
+    }
+
+    c->ne = ne;
+    for (int i = 0; i < ne; ++i) {
+        c->input_arc[i] = -1;
+        if (eu[i] == ev[i]) continue;
+        int lo_v = h->rank[eu[i]] < h->rank[ev[i]] ? eu[i] : ev[i];
+        int hi_v = lo_v == eu[i] ? ev[i] : eu[i];
+        for (int k = h->up_off[lo_v]; k < h->up_off[lo_v+1]; ++k)
+            if (h->up_to[k] == hi_v) { c->input_arc[i] = k; break; }
+    }
+    free(up); free(off); free(adj); free(fill); free(mark);
+    free(d.ids); free(d.tmp); free(d.cell); free(d.key);
+    return 1;
+}
+
+/* Load a metric: edge_w[i] is the weight of input edge i. Each arc starts
+   at its lightest input edge, then for every node u in rank order and each
+   pair of upper neighbours v < w the shortcut v-w is relaxed via u. */
+static void cch_customize(CustomizableCH *c, const double *edge_w) {
+    ContractionHierarchy *h = &c->h;
+    for (int k = 0; k < h->m; ++k) { h->up_w[k] = CH_INF; h->up_mid[k] = -1; }
+    for (int i = 0; i < c->ne; ++i) {
+        int k = c->input_arc[i];
+        if (k >= 0 && edge_w[i] < h->up_w[k]) h->up_w[k] = edge_w[i];
+    }
+    for (int r = 0; r < h->n; ++r) {
+        int u = c->by_rank[r];
+        int b = h->up_off[u], e = h->up_off[u+1];
+        for (int i = b; i + 1 < e; ++i) {
+            if (h->up_w[i] >= CH_INF) continue;
+            int v = h->up_to[i];
+            for (int j = h->up_off[v]; j < h->up_off[v+1]; ++j) c->arc_pos[h->up_to[j]] = j;
+            /* rows are sorted by rank, so arcs after i lead above v */
+            for (int j = i + 1; j < e; ++j) {
+                double nd = h->up_w[i] + h->up_w[j];
+                int k = c->arc_pos[h->up_to[j]];
+                if (k >= 0 && nd < h->up_w[k]) { h->up_w[k] = nd; h->up_mid[k] = u; }
+            }
+            for (int j = h->up_off[v]; j < h->up_off[v+1]; ++j) c->arc_pos[h->up_to[j]] = -1;
+        }
+    }
+}
+
+#endif /* CH_H */
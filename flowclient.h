@@ -0,0 +1,475 @@
+/* flowclient.h -- in-process traffic-flow sampler (HTTP/1.1 keep-alive pool)
+   Replaces one curl process per sampled point: a bounded pool of worker
+   threads, each owning one persistent connection to the provider, pulls
+   points from a shared index and issues
+       GET <path>?point=<lat>,<lon>&key=<key>
+   back to back on that connection. Responses are read by Content-Length or
+   chunked encoding; a connection the server closed between requests is
+   reopened and the request retried once. A point whose request fails gets
+   factor 0, so callers can keep their previous value.
+   Endpoint selection (flow_config_from_env):
+     ECO_FLOW_URL    provider base URL, e.g. http://127.0.0.1:8080/flow for a
+                     mock server ("bench mockflow"); default is the TomTom
+                     flowSegmentData endpoint when built with -DUSE_TOMTOM,
+                     otherwise sampling is off
+     ECO_FLOW_KEY    API key appended as &key= (default: TOMTOM_API_KEY)
+     ECO_FLOW_CONNS  concurrent connections, 1..FLOW_MAX_CONNS (default 8)
+   https:// needs -DUSE_TOMTOM (or -DFLOW_TLS) and -lssl -lcrypto; plain
+   http:// only needs -lpthread. On Windows there is no socket client:
+   points are fetched one at a time through curl (http or https), so
+   neither OpenSSL nor pthreads is needed there. Include after the TomTom
+   key is defined.
+*/
+#ifndef FLOWCLIENT_H
+#define FLOWCLIENT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(USE_TOMTOM) && !defined(FLOW_TLS)
+#define FLOW_TLS
+#endif
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#ifdef FLOW_TLS
+#include <openssl/ssl.h>
+#endif
+#endif
+
+#define FLOW_DEFAULT_URL "https://api.tomtom.com/traffic/services/4/flowSegmentData/absolute/10/json"
+#define FLOW_DEFAULT_CONNS 8
+#define FLOW_MAX_CONNS 64
+#define FLOW_TIMEOUT_MS 5000       /* connect, send and per-read limit */
+#define FLOW_BODY_MAX 16384        /* longer bodies are read but truncated */
+#define FLOW_RECV_BUF 4096
+
+typedef struct {
+    int tls;                       /* https */
+    char host[256];
+    char port[8];
+    char path[512];                /* path plus any fixed query string */
+    char key[128];
+    int conns;
+    int timeout_ms;
+} FlowConfig;
+
+typedef struct {
+    int requests;                  /* points requested */
+    int failures;                  /* points set to 0 after a failed request (caller keeps its value) */
+    int connects;                  /* connections opened, including reconnects */
+    double seconds;                /* wall time of the last flow_sample_points */
+} FlowStats;
+
+static double flow_now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Number after "name": in a JSON body, or -1. (A "%*[^:]" scanset cannot
+   match the empty gap in "name":45, so scanf patterns do not work here.) */
+static double flow_json_number(const char *body, const char *name) {
+    const char *p = strstr(body, name);
+    if (!p) return -1;
+    p = strchr(p + strlen(name), ':');
+    return p ? strtod(p + 1, NULL) : -1;
+}
+
+/* freeFlowSpeed / currentSpeed from a flowSegmentData body, clamped to
+   [1, 4]; 1.0 if either speed is missing */
+static double flow_factor_from_json(const char *body) {
+    double cur = flow_json_number(body, "\"currentSpeed\"");
+    double freef = flow_json_number(body, "\"freeFlowSpeed\"");
+    if (cur > 0 && freef > 0) {
+        double fac = freef / cur;
+        if (fac < 1.0) fac = 1.0;
+        if (fac > 4.0) fac = 4.0;
+        return fac;
+    }
+    return 1.0;
+}
+
+/* Split http[s]://host[:port][/path] into cfg. Returns 0 on a malformed URL. */
+static int flow_parse_url(FlowConfig *cfg, const char *url) {
+    const char *p;
+    if (strncmp(url, "http://", 7) == 0) { cfg->tls = 0; p = url + 7; }
+    else if (strncmp(url, "https://", 8) == 0) { cfg->tls = 1; p = url + 8; }
+    else return 0;
+    size_t hl = strcspn(p, ":/?");
+    if (hl == 0 || hl >= sizeof(cfg->host)) return 0;
+    memcpy(cfg->host, p, hl);
+    cfg->host[hl] = 0;
+    p += hl;
+    if (*p == ':') {
+        size_t pl = strspn(p + 1, "0123456789");
+        if (pl == 0 || pl >= sizeof(cfg->port)) return 0;
+        memcpy(cfg->port, p + 1, pl);
+        cfg->port[pl] = 0;
+        p += 1 + pl;
+    } else {
+        strcpy(cfg->port, cfg->tls ? "443" : "80");
+    }
+    if (*p == 0) strcpy(cfg->path, "/");
+    else if (*p == '/' && strlen(p) < sizeof(cfg->path)) strcpy(cfg->path, p);
+    else return 0;
+    return 1;
+}
+
+/* Fill cfg from the environment. Returns 0 when no provider is configured
+   (sampling off) or the URL cannot be used, with a message for the latter. */
+static int flow_config_from_env(FlowConfig *cfg) {
+    memset(cfg, 0, sizeof(*cfg));
+    const char *url = getenv("ECO_FLOW_URL");
+#ifdef USE_TOMTOM
+    if (!url || !*url) url = FLOW_DEFAULT_URL;
+#endif
+    if (!url || !*url) return 0;
+    if (!flow_parse_url(cfg, url)) {
+        fprintf(stderr, "flow: cannot parse provider URL '%s'\n", url);
+        return 0;
+    }
+#if !defined(FLOW_TLS) && !defined(_WIN32)
+    if (cfg->tls) {
+        fprintf(stderr, "flow: '%s' needs TLS; rebuild with -DUSE_TOMTOM -lssl -lcrypto\n", url);
+        return 0;
+    }
+#endif
+    const char *key = getenv("ECO_FLOW_KEY");
+#ifdef TOMTOM_API_KEY
+    if (!key) key = TOMTOM_API_KEY;
+#endif
+    snprintf(cfg->key, sizeof(cfg->key), "%s", key ? key : "");
+    const char *c = getenv("ECO_FLOW_CONNS");
+    cfg->conns = c ? atoi(c) : FLOW_DEFAULT_CONNS;
+    if (cfg->conns < 1) cfg->conns = 1;
+    if (cfg->conns > FLOW_MAX_CONNS) cfg->conns = FLOW_MAX_CONNS;
+    cfg->timeout_ms = FLOW_TIMEOUT_MS;
+    return 1;
+}
+
+#ifndef _WIN32
+
+/* One persistent provider connection with its receive buffer */
+typedef struct {
+    int fd;                        /* -1 when closed */
+#ifdef FLOW_TLS
+    SSL *ssl;
+#endif
+    char buf[FLOW_RECV_BUF];
+    int lo, hi;                    /* unread bytes are buf[lo, hi) */
+} FlowConn;
+
+static void flow_close(FlowConn *c) {
+#ifdef FLOW_TLS
+    if (c->ssl) { SSL_free(c->ssl); c->ssl = NULL; }
+#endif
+    if (c->fd >= 0) close(c->fd);
+    c->fd = -1;
+    c->lo = c->hi = 0;
+}
+
+/* Non-blocking connect bounded by the timeout, then blocking I/O with
+   send/receive timeouts */
+static int flow_connect(const FlowConfig *cfg, void *tls_ctx, FlowConn *c) {
+    struct addrinfo hints, *res = NULL, *ai;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(cfg->host, cfg->port, &hints, &res) != 0) return 0;
+    c->fd = -1;
+    c->lo = c->hi = 0;
+    for (ai = res; ai && c->fd < 0; ai = ai->ai_next) {
+        int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) continue;
+        int fl = fcntl(fd, F_GETFL, 0);
+        fcntl(fd, F_SETFL, fl | O_NONBLOCK);
+        int ok = connect(fd, ai->ai_addr, ai->ai_addrlen) == 0;
+        if (!ok && errno == EINPROGRESS) {
+            struct pollfd pfd = { fd, POLLOUT, 0 };
+            int err = 0;
+            socklen_t el = sizeof(err);
+            ok = poll(&pfd, 1, cfg->timeout_ms) == 1 &&
+                 getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &el) == 0 && err == 0;
+        }
+        if (!ok) { close(fd); continue; }
+        fcntl(fd, F_SETFL, fl);
+        struct timeval tv = { cfg->timeout_ms / 1000, (cfg->timeout_ms % 1000) * 1000 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        c->fd = fd;
+    }
+    freeaddrinfo(res);
+    if (c->fd < 0) return 0;
+#ifdef FLOW_TLS
+    c->ssl = NULL;
+    if (cfg->tls) {
+        c->ssl = SSL_new((SSL_CTX *)tls_ctx);
+        if (!c->ssl) { flow_close(c); return 0; }
+        SSL_set_fd(c->ssl, c->fd);
+        SSL_set_tlsext_host_name(c->ssl, cfg->host);
+        SSL_set1_host(c->ssl, cfg->host);
+        if (SSL_connect(c->ssl) != 1) { flow_close(c); return 0; }
+    }
+#else
+    (void)tls_ctx;
+#endif
+    return 1;
+}
+
+static int flow_send_all(FlowConn *c, const char *p, int len) {
+    while (len > 0) {
+        int w;
+#ifdef FLOW_TLS
+        if (c->ssl) w = SSL_write(c->ssl, p, len);
+        else
+#endif
+        w = (int)send(c->fd, p, len, MSG_NOSIGNAL);
+        if (w <= 0) return 0;
+        p += w; len -= w;
+    }
+    return 1;
+}
+
+/* Refill the receive buffer; 0 on EOF, timeout or error */
+static int flow_fill(FlowConn *c) {
+    int r;
+#ifdef FLOW_TLS
+    if (c->ssl) r = SSL_read(c->ssl, c->buf, sizeof(c->buf));
+    else
+#endif
+    r = (int)recv(c->fd, c->buf, sizeof(c->buf), 0);
+    if (r <= 0) return 0;
+    c->lo = 0; c->hi = r;
+    return 1;
+}
+
+/* One CRLF-terminated line without the terminator (truncated to cap-1) */
+static int flow_read_line(FlowConn *c, char *line, int cap) {
+    int n = 0;
+    for (;;) {
+        if (c->lo == c->hi && !flow_fill(c)) return 0;
+        char ch = c->buf[c->lo++];
+        if (ch == '\n') break;
+        if (n < cap - 1) line[n++] = ch;
+    }
+    if (n > 0 && line[n-1] == '\r') n--;
+    line[n] = 0;
+    return 1;
+}
+
+/* Append len body bytes to body[*blen] (truncating at cap-1) */
+static int flow_read_body(FlowConn *c, long len, char *body, int cap, int *blen) {
+    while (len > 0) {
+        if (c->lo == c->hi && !flow_fill(c)) return 0;
+        int take = c->hi - c->lo;
+        if (take > len) take = (int)len;
+        int room = cap - 1 - *blen;
+        int copy = take < room ? take : room;
+        if (copy > 0) { memcpy(body + *blen, c->buf + c->lo, copy); *blen += copy; }
+        c->lo += take;
+        len -= take;
+    }
+    return 1;
+}
+
+/* Read one response into body. Returns the HTTP status, 0 if nothing was
+   received (stale keep-alive connection), -1 on a broken response.
+   *keep is cleared when the server will close the connection. */
+static int flow_read_response(FlowConn *c, char *body, int cap, int *keep) {
+    char line[512];
+    int status = 0, chunked = 0, blen = 0;
+    long clen = -1;
+    if (!flow_read_line(c, line, sizeof(line))) return 0;
+    if (sscanf(line, "HTTP/%*d.%*d %d", &status) != 1) return -1;
+    *keep = strncmp(line, "HTTP/1.0", 8) != 0;
+    for (;;) {
+        if (!flow_read_line(c, line, sizeof(line))) return -1;
+        if (line[0] == 0) break;
+        if (strncasecmp(line, "Content-Length:", 15) == 0) clen = atol(line + 15);
+        else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0 && strstr(line + 18, "chunked")) chunked = 1;
+        else if (strncasecmp(line, "Connection:", 11) == 0) {
+            if (strstr(line + 11, "close")) *keep = 0;
+            else if (strstr(line + 11, "keep-alive")) *keep = 1;
+        }
+    }
+    if (chunked) {
+        for (;;) {
+            if (!flow_read_line(c, line, sizeof(line))) return -1;
+            long n = strtol(line, NULL, 16);
+            if (n <= 0) break;
+            if (!flow_read_body(c, n, body, cap, &blen)) return -1;
+            if (!flow_read_line(c, line, sizeof(line))) return -1;
+        }
+        /* trailers up to the blank line */
+        do { if (!flow_read_line(c, line, sizeof(line))) return -1; } while (line[0]);
+    } else if (clen >= 0) {
+        if (!flow_read_body(c, clen, body, cap, &blen)) return -1;
+    } else {
+        /* no length: body runs to EOF */
+        while (c->lo < c->hi || flow_fill(c)) {
+            long n = c->hi - c->lo;
+            flow_read_body(c, n, body, cap, &blen);
+        }
+        *keep = 0;
+    }
+    body[blen] = 0;
+    return status;
+}
+
+typedef struct {
+    const FlowConfig *cfg;
+    void *tls_ctx;
+    const double *lat, *lon;
+    double *fac;
+    int n, next;
+    pthread_mutex_t lock;
+    FlowStats st;
+} FlowPool;
+
+/* Request one point on c, reconnecting as needed; factor or -1 on failure */
+static double flow_fetch(FlowPool *p, FlowConn *c, int i, char *body, int *connects) {
+    const FlowConfig *cfg = p->cfg;
+    char req[1024];
+    int len = snprintf(req, sizeof(req),
+        "GET %s%cpoint=%f,%f&key=%s HTTP/1.1\r\nHost: %s\r\nConnection: keep-alive\r\n\r\n",
+        cfg->path, strchr(cfg->path, '?') ? '&' : '?', p->lat[i], p->lon[i], cfg->key, cfg->host);
+    if (len <= 0 || len >= (int)sizeof(req)) return -1;
+    for (int attempt = 0; attempt < 2; attempt++) {
+        int fresh = c->fd < 0;
+        if (fresh) {
+            if (!flow_connect(cfg, p->tls_ctx, c)) return -1;
+            (*connects)++;
+        }
+        int keep = 1, status = 0;
+        if (flow_send_all(c, req, len)) status = flow_read_response(c, body, FLOW_BODY_MAX, &keep);
+        if (status > 0) {
+            if (!keep) flow_close(c);
+            return status == 200 ? flow_factor_from_json(body) : -1;
+        }
+        flow_close(c);
+        /* only a reused connection earns a retry; a fresh one really failed */
+        if (fresh || status < 0) return -1;
+    }
+    return -1;
+}
+
+static void *flow_worker(void *arg) {
+    FlowPool *p = arg;
+    FlowConn c;
+    c.fd = -1;
+#ifdef FLOW_TLS
+    c.ssl = NULL;
+#endif
+    char *body = malloc(FLOW_BODY_MAX);
+    int requests = 0, failures = 0, connects = 0;
+    for (;;) {
+        pthread_mutex_lock(&p->lock);
+        int i = p->next < p->n ? p->next++ : -1;
+        pthread_mutex_unlock(&p->lock);
+        if (i < 0) break;
+        double f = body ? flow_fetch(p, &c, i, body, &connects) : -1;
+        requests++;
+        if (f < 0) { failures++; f = 0; }
+        p->fac[i] = f;
+    }
+    flow_close(&c);
+    free(body);
+    pthread_mutex_lock(&p->lock);
+    p->st.requests += requests;
+    p->st.failures += failures;
+    p->st.connects += connects;
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+/* Sample n points on min(cfg->conns, n) concurrent keep-alive connections.
+   fac[i] gets the factor for (lat[i], lon[i]), 0 where the request failed.
+   Returns the number of points sampled successfully. */
+static int flow_sample_points(const FlowConfig *cfg, const double *lat, const double *lon,
+                              int n, double *fac, FlowStats *stats) {
+    FlowPool p;
+    memset(&p, 0, sizeof(p));
+    p.cfg = cfg; p.lat = lat; p.lon = lon; p.fac = fac; p.n = n;
+    for (int i = 0; i < n; i++) fac[i] = 0;
+    double t0 = flow_now_sec();
+#ifdef FLOW_TLS
+    SSL_CTX *ctx = NULL;
+    if (cfg->tls) {
+        signal(SIGPIPE, SIG_IGN);      /* SSL_write has no MSG_NOSIGNAL */
+        ctx = SSL_CTX_new(TLS_client_method());
+        if (!ctx) { if (stats) memset(stats, 0, sizeof(*stats)); return 0; }
+        SSL_CTX_set_default_verify_paths(ctx);
+        SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, NULL);
+    }
+    p.tls_ctx = ctx;
+#endif
+    pthread_mutex_init(&p.lock, NULL);
+    int nt = cfg->conns < n ? cfg->conns : n;
+    if (nt > FLOW_MAX_CONNS) nt = FLOW_MAX_CONNS;
+    pthread_t tid[FLOW_MAX_CONNS];
+    int started = 0;
+    for (int t = 0; t < nt; t++) {
+        if (pthread_create(&tid[t], NULL, flow_worker, &p) != 0) break;
+        started++;
+    }
+    if (started == 0 && n > 0) flow_worker(&p);
+    for (int t = 0; t < started; t++) pthread_join(tid[t], NULL);
+    pthread_mutex_destroy(&p.lock);
+#ifdef FLOW_TLS
+    if (ctx) SSL_CTX_free(ctx);
+#endif
+    p.st.seconds = flow_now_sec() - t0;
+    if (stats) *stats = p.st;
+    return p.st.requests - p.st.failures;
+}
+
+#else /* _WIN32: one curl process per point, as before the socket client */
+
+/* Sample n points sequentially with curl (which also handles https).
+   fac[i] gets the factor for (lat[i], lon[i]), 0 where curl failed or
+   returned nothing. Returns the number of points sampled successfully. */
+static int flow_sample_points(const FlowConfig *cfg, const double *lat, const double *lon,
+                              int n, double *fac, FlowStats *stats) {
+    FlowStats st;
+    memset(&st, 0, sizeof(st));
+    double t0 = flow_now_sec();
+    char *body = malloc(FLOW_BODY_MAX);
+    for (int i = 0; i < n; i++) {
+        char cmd[1536];
+        fac[i] = 0;
+        st.requests++;
+        int len = snprintf(cmd, sizeof(cmd), "curl -s -m %d \"%s://%s:%s%s%cpoint=%f,%f&key=%s\"",
+                           (cfg->timeout_ms + 999) / 1000, cfg->tls ? "https" : "http", cfg->host, cfg->port,
+                           cfg->path, strchr(cfg->path, '?') ? '&' : '?', lat[i], lon[i], cfg->key);
+        FILE *fp = body && len > 0 && len < (int)sizeof(cmd) ? _popen(cmd, "r") : NULL;
+        if (!fp) { st.failures++; continue; }
+        st.connects++;
+        size_t r = fread(body, 1, FLOW_BODY_MAX - 1, fp);
+        body[r] = 0;
+        if (_pclose(fp) != 0 || r == 0) { st.failures++; continue; }
+        fac[i] = flow_factor_from_json(body);
+    }
+    free(body);
+    st.seconds = flow_now_sec() - t0;
+    if (stats) *stats = st;
+    return st.requests - st.failures;
+}
+
+#endif
+
+#endif /* FLOWCLIENT_H */
@@ -0,0 +1,172 @@
+/* geoindex.h -- k-d tree over lat/lon points for k-nearest-neighbour queries
+   Implicit tree over a permuted copy of the points (median splits on the
+   wider axis), so build is O(n log n) and a query touches O(log n + k)
+   points even when places are tightly clustered (campus nodes next to
+   far-away cities). Pruning uses haversine lower bounds for a latitude or
+   longitude gap. Longitude wrap-around at +/-180 is not handled (inputs are
+   regional).
+*/
+#ifndef GEOINDEX_H
+#define GEOINDEX_H
+
+#include <stdlib.h>
+#include <math.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define GEO_EARTH_R_KM 6371.0
+#define GEOINDEX_LEAF 8
+
+typedef struct {
+    int n;
+    int *perm;             /* tree order -> original point id */
+    double *lat, *lon;     /* coordinates in tree order */
+    unsigned char *axis;   /* split axis at each internal node's mid (0=lat, 1=lon) */
+    double cos_max;        /* cos of the largest |lat|, for lon gap bounds */
+} GeoIndex;
+
+static double geo_haversine_km(double lat1, double lon1, double lat2, double lon2) {
+    double dlat = (lat2 - lat1) * M_PI / 180.0;
+    double dlon = (lon2 - lon1) * M_PI / 180.0;
+    double a = sin(dlat/2)*sin(dlat/2) +
+               cos(lat1*M_PI/180.0)*cos(lat2*M_PI/180.0)*sin(dlon/2)*sin(dlon/2);
+    return 2.0 * GEO_EARTH_R_KM * atan2(sqrt(a), sqrt(1.0 - a));
+}
+
+/* Lower bound (km) between two points whose lat (axis 0) or lon (axis 1)
+   differ by at least gap_deg */
+static double geoindex_gap_km(const GeoIndex *gi, int axis, double gap_deg) {
+    if (gap_deg <= 0) return 0.0;
+    if (axis == 0) return GEO_EARTH_R_KM * gap_deg * M_PI / 180.0;
+    double half = gap_deg * M_PI / 360.0;
+    if (half > M_PI / 2) half = M_PI / 2;
+    double s = gi->cos_max * sin(half);
+    if (s > 1.0) s = 1.0;
+    return 2.0 * GEO_EARTH_R_KM * asin(s);
+}
+
+static void geoindex_swap(GeoIndex *gi, int a, int b) {
+    int tp = gi->perm[a]; gi->perm[a] = gi->perm[b]; gi->perm[b] = tp;
+    double t = gi->lat[a]; gi->lat[a] = gi->lat[b]; gi->lat[b] = t;
+    t = gi->lon[a]; gi->lon[a] = gi->lon[b]; gi->lon[b] = t;
+}
+
+/* Quickselect so that position k holds the median on `axis` within [lo,hi) */
+static void geoindex_select(GeoIndex *gi, int lo, int hi, int k, int axis) {
+    double *c = axis == 0 ? gi->lat : gi->lon;
+    hi--;
+    while (hi > lo) {
+        int m = lo + (hi - lo) / 2;
+        if (c[m] < c[lo]) geoindex_swap(gi, m, lo);
+        if (c[hi] < c[lo]) geoindex_swap(gi, hi, lo);
+        if (c[hi] < c[m]) geoindex_swap(gi, hi, m);
+        double pivot = c[m];
+        int i = lo, j = hi;
+        while (i <= j) {
+            while (c[i] < pivot) i++;
+            while (c[j] > pivot) j--;
+            if (i <= j) { geoindex_swap(gi, i, j); i++; j--; }
+        }
+        if (k <= j) hi = j;
+        else if (k >= i) lo = i;
+        else return;
+    }
+}
+
+static void geoindex_build_range(GeoIndex *gi, int lo, int hi) {
+    while (hi - lo > GEOINDEX_LEAF) {
+        double la0 = gi->lat[lo], la1 = la0, lo0 = gi->lon[lo], lo1 = lo0;
+        for (int i = lo + 1; i < hi; ++i) {
+            if (gi->lat[i] < la0) la0 = gi->lat[i];
+            if (gi->lat[i] > la1) la1 = gi->lat[i];
+            if (gi->lon[i] < lo0) lo0 = gi->lon[i];
+            if (gi->lon[i] > lo1) lo1 = gi->lon[i];
+        }
+        int axis = ((lo1 - lo0) * gi->cos_max > (la1 - la0)) ? 1 : 0;
+        int mid = (lo + hi) / 2;
+        geoindex_select(gi, lo, hi, mid, axis);
+        gi->axis[mid] = (unsigned char)axis;
+        geoindex_build_range(gi, lo, mid);
+        lo = mid + 1;
+    }
+}
+
+static void geoindex_free(GeoIndex *gi) {
+    free(gi->perm); free(gi->lat); free(gi->lon); free(gi->axis);
+    gi->perm = NULL; gi->lat = gi->lon = NULL; gi->axis = NULL;
+    gi->n = 0;
+}
+
+/* Returns 1 on success, 0 on allocation failure */
+static int geoindex_build(GeoIndex *gi, int n, const double *lat, const double *lon) {
+    int cap = n > 0 ? n : 1;
+    gi->n = n;
+    gi->perm = malloc(sizeof(int) * cap);
+    gi->lat = malloc(sizeof(double) * cap);
+    gi->lon = malloc(sizeof(double) * cap);
+    gi->axis = calloc(cap, 1);
+    if (!gi->perm || !gi->lat || !gi->lon || !gi->axis) { geoindex_free(gi); return 0; }
+    double amax = 0;
+    for (int i = 0; i < n; ++i) {
+        gi->perm[i] = i; gi->lat[i] = lat[i]; gi->lon[i] = lon[i];
+        if (fabs(lat[i]) > amax) amax = fabs(lat[i]);
+    }
+    gi->cos_max = cos(amax * M_PI / 180.0);
+    geoindex_build_range(gi, 0, n);
+    return 1;
+}
+
+typedef struct {
+    double la, lo;
+    int exclude, k, found;
+    int *idx;
+    double *dist;
+} GeoQuery;
+
+static void geoindex_offer(GeoQuery *q, int id, double d) {
+    if (id == q->exclude) return;
+    if (q->found == q->k && d >= q->dist[q->k - 1]) return;
+    int pos = (q->found < q->k) ? q->found++ : q->k - 1;
+    while (pos > 0 && q->dist[pos-1] > d) {
+        q->dist[pos] = q->dist[pos-1]; q->idx[pos] = q->idx[pos-1]; pos--;
+    }
+    q->dist[pos] = d; q->idx[pos] = id;
+}
+
+static void geoindex_search(const GeoIndex *gi, GeoQuery *q, int lo, int hi) {
+    if (hi - lo <= GEOINDEX_LEAF) {
+        for (int i = lo; i < hi; ++i)
+            geoindex_offer(q, gi->perm[i], geo_haversine_km(q->la, q->lo, gi->lat[i], gi->lon[i]));
+        return;
+    }
+    int mid = (lo + hi) / 2;
+    int axis = gi->axis[mid];
+    double split = axis == 0 ? gi->lat[mid] : gi->lon[mid];
+    double qv = axis == 0 ? q->la : q->lo;
+    geoindex_offer(q, gi->perm[mid], geo_haversine_km(q->la, q->lo, gi->lat[mid], gi->lon[mid]));
+    int near_lo = qv < split ? lo : mid + 1, near_hi = qv < split ? mid : hi;
+    int far_lo = qv < split ? mid + 1 : lo, far_hi = qv < split ? hi : mid;
+    geoindex_search(gi, q, near_lo, near_hi);
+    if (q->found < q->k || geoindex_gap_km(gi, axis, fabs(qv - split)) < q->dist[q->k - 1])
+        geoindex_search(gi, q, far_lo, far_hi);
+}
+
+/* k nearest points to (la, lo), skipping point id `exclude` (-1 for none).
+   Results are sorted by distance; returns how many were found (<= k). */
+static int geoindex_knn_point(const GeoIndex *gi, double la, double lo, int exclude,
+                              int k, int *out_idx, double *out_dist) {
+    if (k <= 0 || gi->n == 0) return 0;
+    GeoQuery q = { la, lo, exclude, k, 0, out_idx, out_dist };
+    geoindex_search(gi, &q, 0, gi->n);
+    return q.found;
+}
+
+/* k nearest neighbours of point id p (p itself excluded) */
+static int geoindex_knn(const GeoIndex *gi, const double *lat, const double *lon, int p,
+                        int k, int *out_idx, double *out_dist) {
+    return geoindex_knn_point(gi, lat[p], lon[p], p, k, out_idx, out_dist);
+}
+
+#endif /* GEOINDEX_H */
@@ -3,13 +3,19 @@
 #include "login.h"
 #include "adb[1].h"
 #include "carbon.c"
+#include "batch.h"
 #include <unistd.h>
 //#include "history.h"
 void mainMenu();
 void userMenu();
 
-int main() {
+int main(int argc, char **argv) {
     int choice;
+    if (argc > 1) {
+        if (strcmp(argv[1], "--matrix") == 0) return matrix_main(argc, argv);
+        if (strcmp(argv[1], "--traffic") == 0) return traffic_main(argc, argv);
+        return batch_main(argc, argv);
+    }
     while(1) {
         mainMenu();
         printf("Enter choice: ");